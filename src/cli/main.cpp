@@ -0,0 +1,469 @@
+#include <core/Common.h>
+#include <core/Hash.h>
+#include <core/Path.h>
+#include <core/devices/Extraction.h>
+#include <core/devices/LocalDevice.h>
+#include <core/files/Container.h>
+#include <core/files/File.h>
+#include <core/files/WAD.h>
+#include <core/streams/FileStream.h>
+#include <cstdlib>
+#include <exception>
+#include <filesystem>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace noire::cli
+{
+	namespace fs = std::filesystem;
+
+	static constexpr std::string_view Usage{
+		"Usage: noire-cli <command> [arguments]\n"
+		"\n"
+		"Commands:\n"
+		"  list <archive> [directory]\n"
+		"      Lists the files inside the archive.\n"
+		"  extract <archive> <destination> [path...] [--threads <count>]\n"
+		"      Extracts the files (or directories ending in '/') inside the archive, or all of\n"
+		"      them if no paths are given.\n"
+		"  replace <archive> <path> <file> [--in-place]\n"
+		"      Replaces the file at 'path' inside the archive with the contents of 'file'. With\n"
+		"      '--in-place', only the changed data is written to the existing archive instead of\n"
+		"      writing a new one.\n"
+		"  pack <directory> <archive>\n"
+		"      Creates a new archive with the contents of the directory, a container if its name\n"
+		"      ends in '.big.pc' or a WAD otherwise.\n"
+		"  stat <archive> [path]\n"
+		"      Prints information about the archive or about a file inside it.\n"
+		"  compile-hashes <hashes.db> [output]\n"
+		"      Builds the compiled version of a hashes database (by default 'hashes.bin' next to\n"
+		"      it), which is loaded instead of 'hashes.db' while it is up to date.\n"
+		"\n"
+		"Paths inside archives are absolute and use '/' as separator, e.g. '/final/pc/'.\n"
+	};
+
+	// Error reported to the user, the message is printed and the tool exits with a failure code
+	class Error : public std::exception
+	{
+	public:
+		Error(std::string message) : mMessage{ std::move(message) } {}
+
+		const char* what() const noexcept override { return mMessage.c_str(); }
+
+	private:
+		std::string mMessage;
+	};
+
+	// Archive on the local file system, opened through a LocalDevice rooted at its directory.
+	struct Archive
+	{
+		std::unique_ptr<LocalDevice> Root;
+		std::shared_ptr<noire::File> File;
+		noire::Device* Device;
+	};
+
+	static Archive OpenArchive(const fs::path& archivePath, bool enableFileMapping)
+	{
+		std::error_code ec;
+		if (!fs::is_regular_file(archivePath, ec))
+		{
+			throw Error{ "'" + archivePath.string() + "' is not a file" };
+		}
+
+		const fs::path fullPath = fs::absolute(archivePath);
+
+		Archive a{};
+		a.Root = std::make_unique<LocalDevice>(fullPath.parent_path());
+		a.Root->EnableFileMapping(enableFileMapping);
+		a.File = a.Root->Open(Path::Root / fullPath.filename().string());
+		a.Device = dynamic_cast<noire::Device*>(a.File.get());
+		if (!a.Device)
+		{
+			throw Error{ "'" + archivePath.string() + "' is not a supported archive" };
+		}
+
+		a.File->Load();
+		return a;
+	}
+
+	static Path ArchivePath(std::string_view str, bool directory)
+	{
+		Path p{ str.empty() || str.front() != Path::DirectorySeparator ? "/" : "" };
+		p += str;
+		if (directory && !p.IsDirectory())
+		{
+			p += Path::DirectorySeparator;
+		}
+		return p;
+	}
+
+	static std::string_view TypeName(const File& file)
+	{
+		if (dynamic_cast<const WAD*>(&file))
+		{
+			return "WAD";
+		}
+		else if (dynamic_cast<const Container*>(&file))
+		{
+			return "Container";
+		}
+		else
+		{
+			return "File";
+		}
+	}
+
+	static std::vector<Path> CollectFiles(Device& device, PathView directory)
+	{
+		std::vector<Path> files{};
+		device.Visit([](PathView) {},
+					 [&files](PathView p) { files.emplace_back(p); },
+					 directory,
+					 true);
+		return files;
+	}
+
+	static int List(const std::vector<std::string_view>& args)
+	{
+		if (args.size() < 1 || args.size() > 2)
+		{
+			throw Error{ "list: expected <archive> [directory]" };
+		}
+
+		Archive a = OpenArchive(args[0], true);
+		const Path directory = args.size() > 1 ? ArchivePath(args[1], true) : Path{ Path::Root };
+		for (const Path& p : CollectFiles(*a.Device, directory))
+		{
+			std::cout << a.Device->OpenStream(p).Size() << '\t' << p.String() << '\n';
+		}
+
+		return EXIT_SUCCESS;
+	}
+
+	static int Extract(const std::vector<std::string_view>& args)
+	{
+		std::vector<std::string_view> positional{};
+		ExtractOptions options{};
+		for (size i = 0; i < args.size(); i++)
+		{
+			if (args[i] == "--threads")
+			{
+				if (++i == args.size())
+				{
+					throw Error{ "extract: expected a thread count after '--threads'" };
+				}
+
+				options.ThreadCount = std::stoul(std::string{ args[i] });
+			}
+			else
+			{
+				positional.emplace_back(args[i]);
+			}
+		}
+
+		if (positional.size() < 2)
+		{
+			throw Error{ "extract: expected <archive> <destination> [path...]" };
+		}
+
+		Archive a = OpenArchive(positional[0], true);
+
+		std::vector<Path> files{};
+		if (positional.size() == 2)
+		{
+			files = CollectFiles(*a.Device, PathView::Root);
+		}
+		else
+		{
+			for (size i = 2; i < positional.size(); i++)
+			{
+				const Path p = ArchivePath(positional[i], false);
+				if (p.IsDirectory())
+				{
+					const std::vector<Path> dirFiles = CollectFiles(*a.Device, p);
+					files.insert(files.end(), dirFiles.begin(), dirFiles.end());
+				}
+				else if (a.Device->Exists(p))
+				{
+					files.emplace_back(p);
+				}
+				else
+				{
+					throw Error{ "extract: '" + p.String() + "' not found in the archive" };
+				}
+			}
+		}
+
+		const ExtractResult result = ExtractFiles(*a.Device, files, positional[1], options);
+		for (const Path& p : result.FailedFiles)
+		{
+			std::cerr << "Failed to extract '" << p.String() << "'\n";
+		}
+		std::cout << "Extracted " << result.ExtractedFiles << " files (" << result.ExtractedBytes
+				  << " bytes)\n";
+
+		return result.FailedFiles.empty() ? EXIT_SUCCESS : EXIT_FAILURE;
+	}
+
+	// Copies the contents of a local file to a new file created in the device
+	static void CreateFromLocalFile(Device& device, PathView path, const fs::path& localPath)
+	{
+		// created as a raw file, its actual type is detected when the archive is opened again
+		FileStream input{ localPath };
+		std::shared_ptr<File> f = device.Create(path, File::Type.Id);
+		input.CopyTo(f->Raw());
+	}
+
+	static int Replace(const std::vector<std::string_view>& args)
+	{
+		std::vector<std::string_view> positional{};
+		bool inPlace = false;
+		for (std::string_view arg : args)
+		{
+			if (arg == "--in-place")
+			{
+				inPlace = true;
+			}
+			else
+			{
+				positional.emplace_back(arg);
+			}
+		}
+
+		if (positional.size() != 3)
+		{
+			throw Error{ "replace: expected <archive> <path> <file>" };
+		}
+
+		const fs::path localPath{ positional[2] };
+		std::error_code ec;
+		if (!fs::is_regular_file(localPath, ec))
+		{
+			throw Error{ "replace: '" + localPath.string() + "' is not a file" };
+		}
+
+		// the archive is rewritten, so it must not be mapped while committing
+		Archive a = OpenArchive(positional[0], false);
+		a.Root->EnableInPlaceCommit(inPlace);
+		const Path p = ArchivePath(positional[1], false);
+		if (!a.Device->Exists(p))
+		{
+			throw Error{ "replace: '" + p.String() + "' not found in the archive" };
+		}
+
+		if (inPlace)
+		{
+			// keep the entry and overwrite its data, adding or removing entries needs to rewrite
+			// the archive. Streams can't be truncated, so the entry can only keep or grow its size.
+			std::shared_ptr<File> f = a.Device->Open(p);
+			FileStream input{ localPath };
+			Stream& output = f->Raw();
+			if (input.Size() < output.Size())
+			{
+				throw Error{ "replace: '--in-place' needs a file at least as big as the entry" };
+			}
+
+			output.Seek(0, StreamSeekOrigin::Begin);
+			input.CopyTo(output);
+		}
+		else
+		{
+			a.Device->Delete(p);
+			CreateFromLocalFile(*a.Device, p, localPath);
+		}
+		a.Root->Commit();
+
+		return EXIT_SUCCESS;
+	}
+
+	static int Pack(const std::vector<std::string_view>& args)
+	{
+		if (args.size() != 2)
+		{
+			throw Error{ "pack: expected <directory> <archive>" };
+		}
+
+		const fs::path directory{ args[0] };
+		const fs::path archivePath = fs::absolute(args[1]);
+		std::error_code ec;
+		if (!fs::is_directory(directory, ec))
+		{
+			throw Error{ "pack: '" + directory.string() + "' is not a directory" };
+		}
+		if (fs::exists(archivePath, ec))
+		{
+			throw Error{ "pack: '" + archivePath.string() + "' already exists" };
+		}
+
+		// containers only store the hash of the names, the files get the same hash as their
+		// path in the directory without the first '/'
+		const std::string fileName = archivePath.filename().string();
+		constexpr std::string_view ContainerExtension{ ".big.pc" };
+		const bool isContainer =
+			fileName.size() > ContainerExtension.size() &&
+			fileName.compare(fileName.size() - ContainerExtension.size(),
+							 ContainerExtension.size(),
+							 ContainerExtension) == 0;
+
+		LocalDevice root{ archivePath.parent_path() };
+		std::shared_ptr<File> archive = root.Create(
+			Path::Root / fileName, isContainer ? Container::Type.Id : WAD::Type.Id);
+		Device* archiveDevice = dynamic_cast<Device*>(archive.get());
+		Expects(archiveDevice != nullptr);
+
+		LocalDevice source{ directory };
+		const std::vector<Path> files = CollectFiles(source, PathView::Root);
+		for (const Path& p : files)
+		{
+			CreateFromLocalFile(*archiveDevice, p, directory / p.String().substr(1));
+		}
+
+		root.Commit();
+		std::cout << "Packed " << files.size() << " files\n";
+
+		return EXIT_SUCCESS;
+	}
+
+	static int Stat(const std::vector<std::string_view>& args)
+	{
+		if (args.size() < 1 || args.size() > 2)
+		{
+			throw Error{ "stat: expected <archive> [path]" };
+		}
+
+		Archive a = OpenArchive(args[0], true);
+		if (args.size() == 1)
+		{
+			const std::vector<Path> files = CollectFiles(*a.Device, PathView::Root);
+			u64 dataSize = 0;
+			for (const Path& p : files)
+			{
+				dataSize += a.Device->OpenStream(p).Size();
+			}
+
+			std::cout << "Type:      " << TypeName(*a.File) << '\n'
+					  << "Size:      " << a.File->Raw().Size() << '\n'
+					  << "Files:     " << files.size() << '\n'
+					  << "Data size: " << dataSize << '\n';
+		}
+		else
+		{
+			const Path p = ArchivePath(args[1], false);
+			if (!a.Device->Exists(p))
+			{
+				throw Error{ "stat: '" + p.String() + "' not found in the archive" };
+			}
+
+			std::shared_ptr<File> f = a.Device->Open(p);
+			std::cout << "Path:      " << p.String() << '\n'
+					  << "Type:      " << TypeName(*f) << '\n'
+					  << "Size:      " << a.Device->OpenStream(p).Size() << '\n';
+
+			if (const WAD* wad = dynamic_cast<const WAD*>(a.File.get()); wad)
+			{
+				const WADEntry& e = wad->GetEntry(p);
+				std::cout << "Offset:    " << e.Offset << '\n' << "Hash:      " << std::hex
+						  << e.PathHash << std::dec << '\n';
+			}
+			else if (const Container* cont = dynamic_cast<const Container*>(a.File.get()); cont)
+			{
+				const ContainerEntry& e = cont->GetEntry(p);
+				std::cout << "Offset:    " << e.Offset() << '\n' << "Hash:      " << std::hex
+						  << e.NameHash << std::dec << '\n';
+			}
+		}
+
+		return EXIT_SUCCESS;
+	}
+
+	static int CompileHashes(const std::vector<std::string_view>& args)
+	{
+		if (args.size() < 1 || args.size() > 2)
+		{
+			throw Error{ "compile-hashes: expected <hashes.db> [output]" };
+		}
+
+		const fs::path textPath{ args[0] };
+		std::error_code ec;
+		if (!fs::is_regular_file(textPath, ec))
+		{
+			throw Error{ "compile-hashes: '" + textPath.string() + "' is not a file" };
+		}
+
+		const fs::path compiledPath =
+			args.size() > 1 ? fs::path{ args[1] } : HashLookup::CompiledPath(textPath);
+		HashLookup::Compile(textPath, compiledPath);
+		std::cout << "Compiled '" << textPath.string() << "' to '" << compiledPath.string()
+				  << "' (" << fs::file_size(compiledPath) << " bytes)\n";
+
+		return EXIT_SUCCESS;
+	}
+
+	static int Run(std::string_view command, const std::vector<std::string_view>& args)
+	{
+		if (command == "list")
+		{
+			return List(args);
+		}
+		else if (command == "extract")
+		{
+			return Extract(args);
+		}
+		else if (command == "replace")
+		{
+			return Replace(args);
+		}
+		else if (command == "pack")
+		{
+			return Pack(args);
+		}
+		else if (command == "stat")
+		{
+			return Stat(args);
+		}
+		else if (command == "compile-hashes")
+		{
+			return CompileHashes(args);
+		}
+		else if (command == "help" || command == "--help" || command == "-h")
+		{
+			std::cout << Usage;
+			return EXIT_SUCCESS;
+		}
+		else
+		{
+			throw Error{ "unknown command '" + std::string{ command } + "'" };
+		}
+	}
+}
+
+int main(int argc, char* argv[])
+{
+	using namespace noire::cli;
+
+	if (argc < 2)
+	{
+		std::cerr << Usage;
+		return EXIT_FAILURE;
+	}
+
+	const std::vector<std::string_view> args(argv + 2, argv + argc);
+	try
+	{
+		return Run(argv[1], args);
+	}
+	catch (const Error& e)
+	{
+		std::cerr << "Error: " << e.what() << '\n' << "Run 'noire-cli help' for usage.\n";
+	}
+	catch (const std::exception& e)
+	{
+		// contract violations in noire-core end up here
+		std::cerr << "Error: " << e.what() << '\n';
+	}
+
+	return EXIT_FAILURE;
+}
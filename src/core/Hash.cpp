@@ -1,25 +1,352 @@
 #include "Hash.h"
+#include "ThreadPool.h"
+#include "streams/FileStream.h"
+#include "streams/MappedFileStream.h"
 #include <algorithm>
 #include <array>
 #include <charconv>
+#include <cstring>
 #include <doctest/doctest.h>
 #include <fstream>
+#include <type_traits>
+#include <vector>
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define NOIRE_CRC32_PCLMUL
+#include <emmintrin.h>
+#include <smmintrin.h>
+#include <wmmintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#define NOIRE_TARGET_PCLMUL
+#else
+#include <cpuid.h>
+#define NOIRE_TARGET_PCLMUL __attribute__((target("pclmul,sse4.1")))
+#endif
+#endif
 
 namespace noire
 {
+	using Crc32Tables = std::array<std::array<u32, 256>, 8>;
+
+	// crc32Tables[k][b] is the CRC of byte 'b' followed by 'k' zero bytes
+	static constexpr Crc32Tables MakeCrc32Tables()
+	{
+		Crc32Tables tables{};
+		for (size i = 0; i < 256; i++)
+		{
+			tables[0][i] = crc32Table[i];
+		}
+
+		for (size k = 1; k < tables.size(); k++)
+		{
+			for (size i = 0; i < 256; i++)
+			{
+				const u32 prev = tables[k - 1][i];
+				tables[k][i] = (prev >> 8) ^ crc32Table[prev & 0xFF];
+			}
+		}
+
+		return tables;
+	}
+
+	static constexpr Crc32Tables crc32Tables{ MakeCrc32Tables() };
+
+	static inline u32 LoadLE32(const u8* p)
+	{
+		return static_cast<u32>(p[0]) | (static_cast<u32>(p[1]) << 8) |
+			   (static_cast<u32>(p[2]) << 16) | (static_cast<u32>(p[3]) << 24);
+	}
+
+	// Lowercases 'A'-'Z' in the 4 bytes of 'v', other bytes are not modified
+	static inline u32 ToLower4(u32 v)
+	{
+		const u32 heptets = v & 0x7F7F7F7F;
+		const u32 aboveZ = heptets + 0x25252525; // high bit set if above 'Z'
+		const u32 fromA = heptets + 0x3F3F3F3F;  // high bit set if 'A' or above
+		const u32 upper = ~v & (fromA ^ aboveZ) & 0x80808080;
+		return v | (upper >> 2);
+	}
+
+	static inline u8 ToLower(u8 c) { return (c >= 'A' && c <= 'Z') ? c + 32 : c; }
+
+	template<bool Lowercase>
+	static u32 crc32Slicing8(const u8* p, size n, u32 hash)
+	{
+		for (; n >= 8; p += 8, n -= 8)
+		{
+			u32 lo = LoadLE32(p);
+			u32 hi = LoadLE32(p + 4);
+			if constexpr (Lowercase)
+			{
+				lo = ToLower4(lo);
+				hi = ToLower4(hi);
+			}
+
+			lo ^= hash;
+			hash = crc32Tables[7][lo & 0xFF] ^ crc32Tables[6][(lo >> 8) & 0xFF] ^
+				   crc32Tables[5][(lo >> 16) & 0xFF] ^ crc32Tables[4][lo >> 24] ^
+				   crc32Tables[3][hi & 0xFF] ^ crc32Tables[2][(hi >> 8) & 0xFF] ^
+				   crc32Tables[1][(hi >> 16) & 0xFF] ^ crc32Tables[0][hi >> 24];
+		}
+
+		for (; n > 0; p++, n--)
+		{
+			const u8 c = Lowercase ? ToLower(*p) : *p;
+			hash = crc32Table[c ^ (hash & 0xFF)] ^ (hash >> 8);
+		}
+
+		return hash;
+	}
+
+#ifdef NOIRE_CRC32_PCLMUL
+	// strings shorter than this don't gain enough from the folding to make up for the setup
+	static constexpr size PclmulMinLength{ 64 };
+
+	static bool HasPclmul()
+	{
+		static const bool hasPclmul = []() {
+			// CPUID leaf 1, ECX bit 1 is PCLMULQDQ and bit 19 is SSE4.1
+#ifdef _MSC_VER
+			int info[4]{};
+			__cpuid(info, 1);
+			const unsigned int ecx = static_cast<unsigned int>(info[2]);
+#else
+			unsigned int eax = 0, ebx = 0, ecx = 0, edx = 0;
+			if (!__get_cpuid(1, &eax, &ebx, &ecx, &edx))
+			{
+				return false;
+			}
+#endif
+			return (ecx & (1u << 1)) != 0 && (ecx & (1u << 19)) != 0;
+		}();
+		return hasPclmul;
+	}
+
+	template<bool Lowercase>
+	NOIRE_TARGET_PCLMUL static inline __m128i Load128(const u8* p)
+	{
+		__m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+		if constexpr (Lowercase)
+		{
+			// bytes above 0x7F are negative and never between 'A' and 'Z'
+			const __m128i upper = _mm_and_si128(_mm_cmpgt_epi8(v, _mm_set1_epi8('A' - 1)),
+												_mm_cmplt_epi8(v, _mm_set1_epi8('Z' + 1)));
+			v = _mm_or_si128(v, _mm_and_si128(upper, _mm_set1_epi8(0x20)));
+		}
+		return v;
+	}
+
+	NOIRE_TARGET_PCLMUL static inline __m128i Fold128(__m128i x, __m128i next, __m128i k)
+	{
+		const __m128i lo = _mm_clmulepi64_si128(x, k, 0x00);
+		const __m128i hi = _mm_clmulepi64_si128(x, k, 0x11);
+		return _mm_xor_si128(_mm_xor_si128(hi, next), lo);
+	}
+
+	// Folds 'n' bytes into the CRC with carry-less multiplications, as described in Intel's
+	// "Fast CRC Computation for Generic Polynomials Using PCLMULQDQ Instruction". 'n' must be a
+	// multiple of 16 and at least 64.
+	template<bool Lowercase>
+	NOIRE_TARGET_PCLMUL static u32 crc32Pclmul(const u8* p, size n, u32 hash)
+	{
+		Expects(n >= 64 && (n % 16) == 0);
+
+		// constants for the bit-reflected CRC-32 polynomial
+		const __m128i k1k2 = _mm_set_epi64x(0x01C6E41596, 0x0154442BD4);
+		const __m128i k3k4 = _mm_set_epi64x(0x00CCAA009E, 0x01751997D0);
+		const __m128i k5 = _mm_set_epi64x(0, 0x0163CD6124);
+		const __m128i poly = _mm_set_epi64x(0x01F7011641, 0x01DB710641);
+		const __m128i mask32 = _mm_setr_epi32(~0, 0, ~0, 0);
+
+		__m128i x1 = Load128<Lowercase>(p + 0x00);
+		__m128i x2 = Load128<Lowercase>(p + 0x10);
+		__m128i x3 = Load128<Lowercase>(p + 0x20);
+		__m128i x4 = Load128<Lowercase>(p + 0x30);
+		x1 = _mm_xor_si128(x1, _mm_cvtsi32_si128(static_cast<int>(hash)));
+		p += 64;
+		n -= 64;
+
+		// fold 64 bytes at a time
+		for (; n >= 64; p += 64, n -= 64)
+		{
+			const __m128i x5 = _mm_clmulepi64_si128(x1, k1k2, 0x00);
+			const __m128i x6 = _mm_clmulepi64_si128(x2, k1k2, 0x00);
+			const __m128i x7 = _mm_clmulepi64_si128(x3, k1k2, 0x00);
+			const __m128i x8 = _mm_clmulepi64_si128(x4, k1k2, 0x00);
+
+			x1 = _mm_clmulepi64_si128(x1, k1k2, 0x11);
+			x2 = _mm_clmulepi64_si128(x2, k1k2, 0x11);
+			x3 = _mm_clmulepi64_si128(x3, k1k2, 0x11);
+			x4 = _mm_clmulepi64_si128(x4, k1k2, 0x11);
+
+			x1 = _mm_xor_si128(_mm_xor_si128(x1, x5), Load128<Lowercase>(p + 0x00));
+			x2 = _mm_xor_si128(_mm_xor_si128(x2, x6), Load128<Lowercase>(p + 0x10));
+			x3 = _mm_xor_si128(_mm_xor_si128(x3, x7), Load128<Lowercase>(p + 0x20));
+			x4 = _mm_xor_si128(_mm_xor_si128(x4, x8), Load128<Lowercase>(p + 0x30));
+		}
+
+		// fold the 4 lanes and the remaining 16-byte blocks into one
+		x1 = Fold128(x1, x2, k3k4);
+		x1 = Fold128(x1, x3, k3k4);
+		x1 = Fold128(x1, x4, k3k4);
+		for (; n >= 16; p += 16, n -= 16)
+		{
+			x1 = Fold128(x1, Load128<Lowercase>(p), k3k4);
+		}
+
+		// fold 128 bits to 64 bits
+		x2 = _mm_clmulepi64_si128(x1, k3k4, 0x10);
+		x1 = _mm_xor_si128(_mm_srli_si128(x1, 8), x2);
+
+		x2 = _mm_srli_si128(x1, 4);
+		x1 = _mm_and_si128(x1, mask32);
+		x1 = _mm_clmulepi64_si128(x1, k5, 0x00);
+		x1 = _mm_xor_si128(x1, x2);
+
+		// Barrett reduction to 32 bits
+		x2 = _mm_and_si128(x1, mask32);
+		x2 = _mm_clmulepi64_si128(x2, poly, 0x10);
+		x2 = _mm_and_si128(x2, mask32);
+		x2 = _mm_clmulepi64_si128(x2, poly, 0x00);
+		x1 = _mm_xor_si128(x1, x2);
+
+		return static_cast<u32>(_mm_extract_epi32(x1, 1));
+	}
+#endif
+
+	template<bool Lowercase>
+	static u32 crc32Runtime(std::string_view str, u32 hash)
+	{
+		const u8* p = reinterpret_cast<const u8*>(str.data());
+		size n = str.size();
+
+#ifdef NOIRE_CRC32_PCLMUL
+		if (n >= PclmulMinLength && HasPclmul())
+		{
+			const size blocksSize = n & ~size{ 15 };
+			hash = crc32Pclmul<Lowercase>(p, blocksSize, hash);
+			p += blocksSize;
+			n -= blocksSize;
+		}
+#endif
+
+		return crc32Slicing8<Lowercase>(p, n, hash);
+	}
+
+	u32 crc32PartialRuntime(std::string_view str, u32 hash)
+	{
+		return crc32Runtime<false>(str, hash);
+	}
+
+	u32 crc32LowercasePartialRuntime(std::string_view str, u32 hash)
+	{
+		return crc32Runtime<true>(str, hash);
+	}
+
+	// The compiled database has a header, followed by the hashes and string offsets of each
+	// table and the strings. The hashes of a table are sorted in Eytzinger order (the implicit
+	// binary tree of a heap), so searches touch few cache lines. Each line of the text database is
+	// stored once, terminated by '\0', and the string offsets also tell which case of the line has
+	// the hash.
+	struct HashDbRawHeader
+	{
+		u32 Magic;
+		u32 Version;
+		u32 Counts[3]; // of each HashDbTable
+		u32 StringsSize;
+	};
+	static_assert(sizeof(HashDbRawHeader) == 24 && std::is_trivially_copyable_v<HashDbRawHeader>);
+
+	static constexpr u32 HashDbMagic{ 0x4244484E }; // 'NHDB'
+	static constexpr u32 HashDbVersion{ 1 };
+
+	enum class HashDbTable : u32
+	{
+		CaseSensitive = 0,   // each string and its lowercase version, hashed with crc32
+		CaseInsensitive,     // each string, hashed with crc32Lowercase
+		CaseSensitiveFormats // like CaseSensitive plus the uppercase version, for CHashDatabase
+	};
+	static constexpr size HashDbTableCount{ 3 };
+
+	enum class HashDbCase : u32
+	{
+		Original = 0,
+		Lowercase,
+		Uppercase,
+	};
+	static constexpr u32 HashDbCaseShift{ 30 }; // the case is in the top bits of string offsets
+	static constexpr u32 HashDbOffsetMask{ (u32{ 1 } << HashDbCaseShift) - 1 };
+
+	// Same conversion as loading the text database
+	static std::string ToCase(std::string str, HashDbCase c)
+	{
+		if (c != HashDbCase::Original)
+		{
+			for (auto& ch : str)
+			{
+				ch = static_cast<char>(c == HashDbCase::Lowercase ? std::tolower(ch) :
+																	std::toupper(ch));
+			}
+		}
+		return str;
+	}
+
+	// Offsets of each section in the compiled database
+	struct HashDbLayout
+	{
+		u64 Hashes[HashDbTableCount];
+		u64 Offsets[HashDbTableCount];
+		u64 Strings;
+		u64 End;
+
+		HashDbLayout(const HashDbRawHeader& h)
+		{
+			u64 offset = sizeof(HashDbRawHeader);
+			for (size t = 0; t < HashDbTableCount; t++)
+			{
+				Hashes[t] = offset;
+				Offsets[t] = Hashes[t] + sizeof(u32) * h.Counts[t];
+				offset = Offsets[t] + sizeof(u32) * h.Counts[t];
+			}
+			Strings = offset;
+			End = Strings + h.StringsSize;
+		}
+	};
+
 	HashLookup::HashLookup(const std::filesystem::path& path, bool caseSensitive)
-		: mHashToStr{}, mCaseSensitive{ caseSensitive }
+		: mHashToStr{},
+		  mCaseSensitive{ caseSensitive },
+		  mCompiled{},
+		  mCompiledHashes{ nullptr },
+		  mCompiledOffsets{ nullptr },
+		  mCompiledCount{ 0 },
+		  mCompiledStrings{}
 	{
 		Load(path);
 	}
 
+	HashLookup::HashLookup(const std::filesystem::path& path, bool caseSensitive, ThreadPool& pool)
+		: mHashToStr{},
+		  mCaseSensitive{ caseSensitive },
+		  mCompiled{},
+		  mCompiledHashes{ nullptr },
+		  mCompiledOffsets{ nullptr },
+		  mCompiledCount{ 0 },
+		  mCompiledStrings{}
+	{
+		Load(path, pool);
+	}
+
+	HashLookup::~HashLookup() = default;
+
 	inline static constexpr size HashStrLength{ HashLookup::HashPrefix.size() + 8 +
 												HashLookup::HashSuffix.size() };
 
 	std::string HashLookup::TryGetString(u32 hash) const
 	{
-		auto it = mHashToStr.find(hash);
-		if (it == mHashToStr.end())
+		std::optional<std::string> found = Find(hash);
+		if (!found)
 		{
 			std::array<char, 8 + 1> hashStr{};
 			const auto [p, ec] =
@@ -46,14 +373,45 @@ namespace noire
 		}
 		else
 		{
-			return it->second;
+			return std::move(*found);
 		}
 	}
 
 	std::optional<std::string> HashLookup::GetString(u32 hash) const
 	{
-		auto it = mHashToStr.find(hash);
-		return it == mHashToStr.end() ? std::nullopt : std::make_optional(it->second);
+		return Find(hash);
+	}
+
+	std::optional<std::string> HashLookup::Find(u32 hash) const
+	{
+		if (!mCompiled)
+		{
+			auto it = mHashToStr.find(hash);
+			return it == mHashToStr.end() ? std::nullopt : std::make_optional(it->second);
+		}
+
+		// the search goes right while the hashes are smaller, so after the last node it is at
+		// the node where it last went left, which has the first hash not smaller than 'hash'
+		size k = 1;
+		while (k <= mCompiledCount)
+		{
+			k = 2 * k + (mCompiledHashes[k - 1] < hash);
+		}
+		while (k & 1)
+		{
+			k >>= 1;
+		}
+		k >>= 1;
+
+		const u32 offset = k == 0 ? 0 : mCompiledOffsets[k - 1] & HashDbOffsetMask;
+		if (k == 0 || mCompiledHashes[k - 1] != hash || offset >= mCompiledStrings.size())
+		{
+			return std::nullopt;
+		}
+
+		const std::string_view str = mCompiledStrings.substr(offset);
+		return ToCase(std::string{ str.substr(0, str.find('\0')) },
+					  static_cast<HashDbCase>(mCompiledOffsets[k - 1] >> HashDbCaseShift));
 	}
 
 	u32 HashLookup::GetHash(std::string_view str) const
@@ -78,8 +436,8 @@ namespace noire
 
 	void HashLookup::Load(const std::filesystem::path& dbPath)
 	{
-		auto fp = std::filesystem::absolute(dbPath);
-		if (!std::filesystem::is_regular_file(fp))
+		std::error_code ec;
+		if (!std::filesystem::is_regular_file(dbPath, ec) || LoadCompiled(dbPath))
 		{
 			return;
 		}
@@ -111,17 +469,326 @@ namespace noire
 		}
 	}
 
+	// Loads the same strings as the single-threaded Load. Each task parses a chunk of lines and
+	// sorts their hashes into shards, then each shard is filled from the chunks in order so the
+	// first string with each hash is kept, and the shards are merged into the lookup table.
+	void HashLookup::Load(const std::filesystem::path& dbPath, ThreadPool& pool)
+	{
+		std::error_code ec;
+		if (!std::filesystem::is_regular_file(dbPath, ec) || LoadCompiled(dbPath))
+		{
+			return;
+		}
+
+		constexpr size ShardCount{ 64 };
+		constexpr size MinChunkSize{ 64 * 1024 };
+
+		MappedFileStream file{ dbPath };
+		const gsl::span<const byte> bytes = file.TryGetContiguous(0, file.Size());
+		const std::string_view text{ reinterpret_cast<const char*>(bytes.data()),
+									 gsl::narrow<size>(file.Size()) };
+
+		// chunks end after a '\n', so no line is split between them
+		const size chunkCount =
+			std::max<size>(1, std::min(pool.ThreadCount() * 4, text.size() / MinChunkSize));
+		std::vector<std::string_view> chunks{};
+		for (size i = 1, begin = 0; i <= chunkCount && begin < text.size(); i++)
+		{
+			size end = i == chunkCount ?
+						   std::string_view::npos :
+						   text.find('\n', std::max(begin, text.size() * i / chunkCount));
+			end = end == std::string_view::npos ? text.size() : end + 1;
+			chunks.emplace_back(text.substr(begin, end - begin));
+			begin = end;
+		}
+
+		struct PendingString
+		{
+			u32 Hash;
+			HashDbCase Case;
+			std::string_view Line;
+		};
+		using ChunkShards = std::array<std::vector<PendingString>, ShardCount>;
+		std::vector<ChunkShards> pending(chunks.size());
+		for (size c = 0; c < chunks.size(); c++)
+		{
+			pool.Submit([this, &chunks, &pending, c]() {
+				const std::string_view chunk = chunks[c];
+				ChunkShards& shards = pending[c];
+				const auto add = [&shards](u32 hash, HashDbCase strCase, std::string_view line) {
+					shards[hash % ShardCount].push_back({ hash, strCase, line });
+				};
+
+				// same lines as std::getline
+				for (size pos = 0; pos < chunk.size();)
+				{
+					const size newLine = chunk.find('\n', pos);
+					const std::string_view line = chunk.substr(pos, newLine - pos);
+					pos = newLine == std::string_view::npos ? chunk.size() : newLine + 1;
+
+					if (mCaseSensitive)
+					{
+						add(crc32(line), HashDbCase::Original, line);
+						add(crc32(ToCase(std::string{ line }, HashDbCase::Lowercase)),
+							HashDbCase::Lowercase,
+							line);
+					}
+					else
+					{
+						add(crc32Lowercase(line), HashDbCase::Original, line);
+					}
+				}
+			});
+		}
+		pool.Wait();
+
+		std::array<std::unordered_map<u32, std::string>, ShardCount> shards{};
+		for (size s = 0; s < ShardCount; s++)
+		{
+			pool.Submit([&pending, &shards, s]() {
+				for (const ChunkShards& chunk : pending)
+				{
+					for (const PendingString& p : chunk[s])
+					{
+						auto [it, added] = shards[s].try_emplace(p.Hash);
+						if (added)
+						{
+							it->second = ToCase(std::string{ p.Line }, p.Case);
+						}
+					}
+				}
+			});
+		}
+		pool.Wait();
+
+		// the shards have different hashes, merging only moves their nodes
+		size count = 0;
+		for (const auto& shard : shards)
+		{
+			count += shard.size();
+		}
+		mHashToStr.reserve(count);
+		for (auto& shard : shards)
+		{
+			mHashToStr.merge(shard);
+		}
+	}
+
+	// Returns false if the file is not a compiled database. A compiled database that is not valid
+	// is loaded as empty.
+	bool HashLookup::LoadCompiled(const std::filesystem::path& dbPath)
+	{
+		std::error_code ec;
+		if (std::filesystem::file_size(dbPath, ec) < sizeof(HashDbRawHeader))
+		{
+			return false;
+		}
+
+		auto m = std::make_unique<MappedFileStream>(dbPath);
+		const gsl::span<const byte> data = m->TryGetContiguous(0, m->Size());
+		const HashDbRawHeader h = LoadUnaligned<HashDbRawHeader>(data.data());
+		if (h.Magic != HashDbMagic)
+		{
+			return false;
+		}
+
+		const HashDbLayout layout{ h };
+		if (h.Version != HashDbVersion || layout.End != m->Size() ||
+			(h.StringsSize != 0 && data[gsl::narrow<ptrdiff>(layout.End - 1)] != byte{ 0 }))
+		{
+			return true;
+		}
+
+		// the mapping starts at a page boundary and the sections at multiples of 4 bytes
+		const size table = static_cast<size>(mCaseSensitive ? HashDbTable::CaseSensitive :
+															  HashDbTable::CaseInsensitive);
+		mCompiledHashes = reinterpret_cast<const u32*>(data.data() + layout.Hashes[table]);
+		mCompiledOffsets = reinterpret_cast<const u32*>(data.data() + layout.Offsets[table]);
+		mCompiledCount = h.Counts[table];
+		mCompiledStrings = { reinterpret_cast<const char*>(data.data() + layout.Strings),
+							 h.StringsSize };
+		mCompiled = std::move(m);
+		return true;
+	}
+
+	// Reorders the sorted values into Eytzinger order, node 'k' of the tree is at index 'k - 1'
+	template<class T>
+	static void ToEytzinger(const std::vector<T>& sorted, std::vector<T>& tree, size& next, size k)
+	{
+		if (k <= sorted.size())
+		{
+			ToEytzinger(sorted, tree, next, 2 * k);
+			tree[k - 1] = sorted[next++];
+			ToEytzinger(sorted, tree, next, 2 * k + 1);
+		}
+	}
+
+	void HashLookup::Compile(const std::filesystem::path& textPath,
+							 const std::filesystem::path& compiledPath)
+	{
+		std::vector<std::string> lines{};
+		{
+			std::ifstream f{ textPath, std::ios::in };
+			Expects(f.good());
+			for (std::string line; std::getline(f, line);)
+			{
+				lines.emplace_back(std::move(line));
+			}
+		}
+
+		std::string strings{};
+		std::vector<u32> lineOffsets{};
+		for (const std::string& line : lines)
+		{
+			lineOffsets.push_back(gsl::narrow<u32>(strings.size()));
+			strings += line;
+			strings += '\0';
+		}
+		Expects(strings.size() <= HashDbOffsetMask);
+
+		HashDbRawHeader h{ HashDbMagic, HashDbVersion, {}, 0 };
+		std::vector<u32> tableData[HashDbTableCount * 2]{};
+		for (size t = 0; t < HashDbTableCount; t++)
+		{
+			// same cases, in the same order, and hashes as loading the text database
+			const bool lowercaseHash = t == static_cast<size>(HashDbTable::CaseInsensitive);
+			std::vector<HashDbCase> cases{ HashDbCase::Original };
+			if (t == static_cast<size>(HashDbTable::CaseSensitiveFormats))
+			{
+				cases.push_back(HashDbCase::Uppercase);
+			}
+			if (!lowercaseHash)
+			{
+				cases.push_back(HashDbCase::Lowercase);
+			}
+
+			struct Candidate
+			{
+				u32 Hash;
+				u32 Offset; // with the case
+			};
+			std::vector<Candidate> candidates{};
+			candidates.reserve(lines.size() * cases.size());
+			for (size i = 0; i < lines.size(); i++)
+			{
+				for (HashDbCase c : cases)
+				{
+					const u32 hash = lowercaseHash ? crc32Lowercase(lines[i]) :
+													 crc32(ToCase(lines[i], c));
+					candidates.push_back(
+						{ hash, lineOffsets[i] | (static_cast<u32>(c) << HashDbCaseShift) });
+				}
+			}
+
+			// the first string with each hash is kept
+			const auto hashLess = [](const Candidate& a, const Candidate& b) {
+				return a.Hash < b.Hash;
+			};
+			const auto hashEqual = [](const Candidate& a, const Candidate& b) {
+				return a.Hash == b.Hash;
+			};
+			std::stable_sort(candidates.begin(), candidates.end(), hashLess);
+			candidates.erase(std::unique(candidates.begin(), candidates.end(), hashEqual),
+							 candidates.end());
+
+			std::vector<u32> hashes{}, offsets{};
+			hashes.reserve(candidates.size());
+			offsets.reserve(candidates.size());
+			for (const Candidate& c : candidates)
+			{
+				hashes.push_back(c.Hash);
+				offsets.push_back(c.Offset);
+			}
+
+			// the offsets are reordered the same way as the hashes, which are unique
+			std::vector<u32>& treeHashes = tableData[t * 2];
+			std::vector<u32>& treeOffsets = tableData[t * 2 + 1];
+			treeHashes.resize(hashes.size());
+			treeOffsets.resize(offsets.size());
+			size next = 0;
+			ToEytzinger(hashes, treeHashes, next, 1);
+			next = 0;
+			ToEytzinger(offsets, treeOffsets, next, 1);
+
+			h.Counts[t] = gsl::narrow<u32>(hashes.size());
+		}
+		h.StringsSize = gsl::narrow<u32>(strings.size());
+
+		const HashDbLayout layout{ h };
+		std::vector<byte> data(gsl::narrow<size>(layout.End));
+		std::memcpy(data.data(), &h, sizeof(h));
+		for (size t = 0; t < HashDbTableCount; t++)
+		{
+			std::memcpy(data.data() + layout.Hashes[t],
+						tableData[t * 2].data(),
+						sizeof(u32) * h.Counts[t]);
+			std::memcpy(data.data() + layout.Offsets[t],
+						tableData[t * 2 + 1].data(),
+						sizeof(u32) * h.Counts[t]);
+		}
+		std::memcpy(data.data() + layout.Strings, strings.data(), strings.size());
+
+		// written next to the database and renamed once complete, so processes that have the
+		// old one mapped keep working
+		std::filesystem::path tempPath = compiledPath;
+		tempPath += ".tmp";
+		std::filesystem::remove(tempPath);
+		{
+			FileStream output{ tempPath };
+			output.Write(data.data(), data.size());
+		}
+		std::filesystem::rename(tempPath, compiledPath);
+	}
+
+	std::filesystem::path HashLookup::CompiledPath(const std::filesystem::path& textPath)
+	{
+		std::filesystem::path p = textPath;
+		p.replace_extension(".bin");
+		return p;
+	}
+
+	// The compiled database is used unless the text one was modified after compiling it, e.g. by
+	// noire-hash-collider adding the names it found
+	static std::filesystem::path DefaultHashesPath()
+	{
+		const std::filesystem::path textPath{ "hashes.db" };
+		const std::filesystem::path compiledPath = HashLookup::CompiledPath(textPath);
+
+		std::error_code ec;
+		const auto compiledTime = std::filesystem::last_write_time(compiledPath, ec);
+		if (ec)
+		{
+			return textPath;
+		}
+
+		const auto textTime = std::filesystem::last_write_time(textPath, ec);
+		return ec || compiledTime >= textTime ? compiledPath : textPath;
+	}
+
+	static HashLookup LoadDefaultHashes(bool caseSensitive)
+	{
+		const std::filesystem::path path = DefaultHashesPath();
+		if (path == HashLookup::CompiledPath(path))
+		{
+			// nothing to parse
+			return HashLookup{ path, caseSensitive };
+		}
+
+		ThreadPool pool{};
+		return HashLookup{ path, caseSensitive, pool };
+	}
+
 	const HashLookup& HashLookup::Instance(bool caseSensitive)
 	{
 		// TODO: don't hardcode HashLookup path
 		if (caseSensitive)
 		{
-			static HashLookup inst{ "hashes.db", true };
+			static HashLookup inst = LoadDefaultHashes(true);
 			return inst;
 		}
 		else
 		{
-			static HashLookup inst{ "hashes.db", false };
+			static HashLookup inst = LoadDefaultHashes(false);
 			return inst;
 		}
 	}
@@ -146,6 +813,54 @@ TEST_SUITE("crc32")
 		CHECK_EQ(0x8B8838C2, crc32Lowercase("ABCDXYZ"));
 		CHECK_EQ(0xAD7F9CBD, crc32Lowercase("AaBbCcDdXxYyZz"));
 	}
+
+	TEST_CASE("compile time")
+	{
+		static_assert(crc32("abcdxyz") == 0x8B8838C2);
+		static_assert(crc32Lowercase("ABCDXYZ") == 0x8B8838C2);
+	}
+
+	TEST_CASE("runtime versions match the byte loop")
+	{
+		const auto reference = [](std::string_view str, u32 hash, bool lowercase) {
+			for (char ch : str)
+			{
+				u8 c = static_cast<u8>(ch);
+				if (lowercase && c >= 'A' && c <= 'Z')
+				{
+					c += 32;
+				}
+				hash = crc32Table[c ^ (hash & 0xFF)] ^ (hash >> 8);
+			}
+			return hash;
+		};
+
+		// every byte value, including the ones above 0x7F and the characters around 'A'-'Z'
+		std::string data;
+		for (size i = 0; i < 1024; i++)
+		{
+			data.push_back(static_cast<char>((i * 7 + i / 256) & 0xFF));
+		}
+
+		for (size offset = 0; offset < 16; offset++)
+		{
+			for (size length = 0; length + offset <= 300; length++)
+			{
+				const std::string_view str{ data.data() + offset, length };
+				const u32 seed = static_cast<u32>(0x12345678 * (length + 1));
+				CHECK_EQ(crc32PartialRuntime(str, seed), reference(str, seed, false));
+				CHECK_EQ(crc32LowercasePartialRuntime(str, seed), reference(str, seed, true));
+				CHECK_EQ(crc32Slicing8<false>(reinterpret_cast<const u8*>(str.data()),
+											  str.size(),
+											  seed),
+						 reference(str, seed, false));
+			}
+		}
+
+		const std::string_view all{ data };
+		CHECK_EQ(crc32(all), ~reference(all, ~u32{ 0 }, false));
+		CHECK_EQ(crc32Lowercase(all), ~reference(all, ~u32{ 0 }, true));
+	}
 }
 
 TEST_SUITE("HashLookup")
@@ -170,4 +885,94 @@ TEST_SUITE("HashLookup")
 		CHECK_EQ(0xB4CDC6D8, h.GetHash("?#B4CDC6D8#?"));
 		CHECK_EQ(0xFC1BD0B1, h.GetHash("?#FC1BD0B1#?"));
 	}
+
+	TEST_CASE("compiled database matches the text one")
+	{
+		const std::filesystem::path textPath{ "test_hashes.db" };
+		const std::filesystem::path compiledPath = HashLookup::CompiledPath(textPath);
+		CHECK_EQ(compiledPath, std::filesystem::path{ "test_hashes.bin" });
+
+		// '/plumless' and '/buckeroo' have the same hash, the first line is kept
+		std::vector<std::string> lines{ "out/Textures/Car.dds", "/plumless", "/buckeroo", "UPPER",
+										"final/pc/hat.trunk",  "UPPER" };
+		for (size i = 0; i < 200; i++)
+		{
+			lines.emplace_back("Dir/File_" + std::to_string(i) + ".dds");
+		}
+
+		{
+			std::ofstream f{ textPath, std::ios::out | std::ios::trunc };
+			for (const std::string& line : lines)
+			{
+				f << line << '\n';
+			}
+		}
+		HashLookup::Compile(textPath, compiledPath);
+
+		for (bool caseSensitive : { true, false })
+		{
+			const HashLookup text{ textPath, caseSensitive };
+			const HashLookup compiled{ compiledPath, caseSensitive };
+			CHECK(compiled.GetString(crc32("/buckeroo")) == std::string{ "/plumless" });
+			CHECK_FALSE(compiled.GetString(0x12345678).has_value());
+			CHECK_EQ(compiled.TryGetString(0x12345678), "?#12345678#?");
+
+			for (const std::string& line : lines)
+			{
+				std::string lower = line;
+				std::transform(lower.begin(), lower.end(), lower.begin(), [](char c) {
+					return static_cast<char>(std::tolower(c));
+				});
+
+				for (u32 hash : { crc32(line), crc32(lower), crc32Lowercase(line) })
+				{
+					CHECK(compiled.GetString(hash) == text.GetString(hash));
+				}
+			}
+		}
+
+		std::filesystem::remove(textPath);
+		std::filesystem::remove(compiledPath);
+	}
+
+	TEST_CASE("parallel loading matches the single-threaded one")
+	{
+		const std::filesystem::path textPath{ "test_hashes_parallel.db" };
+
+		// several chunks, with lines ending in '\r\n', empty lines and no '\n' at the end
+		std::vector<std::string> lines{ "/plumless", "/buckeroo", "", "Out/Textures/Car.dds\r" };
+		for (size i = 0; i < 20000; i++)
+		{
+			lines.emplace_back("Dir" + std::to_string(i % 7) + "/File_" + std::to_string(i) +
+							   (i % 3 == 0 ? ".DDS" : ".dds"));
+		}
+		lines.emplace_back("last/line");
+
+		{
+			std::ofstream f{ textPath, std::ios::out | std::ios::binary | std::ios::trunc };
+			for (size i = 0; i < lines.size(); i++)
+			{
+				f << lines[i] << (i + 1 < lines.size() ? "\n" : "");
+			}
+		}
+
+		ThreadPool pool{ 4 };
+		for (bool caseSensitive : { true, false })
+		{
+			const HashLookup single{ textPath, caseSensitive };
+			const HashLookup parallel{ textPath, caseSensitive, pool };
+			CHECK(parallel.GetString(crc32("/buckeroo")) == std::string{ "/plumless" });
+			CHECK(parallel.GetString(crc32("last/line")) == std::string{ "last/line" });
+
+			for (const std::string& line : lines)
+			{
+				for (u32 hash : { crc32(line), crc32Lowercase(line), crc32(line + "x") })
+				{
+					CHECK(parallel.GetString(hash) == single.GetString(hash));
+				}
+			}
+		}
+
+		std::filesystem::remove(textPath);
+	}
 }
@@ -1,9 +1,11 @@
 #pragma once
 #include "Common.h"
 #include <filesystem>
+#include <memory>
 #include <optional>
 #include <string>
 #include <string_view>
+#include <unordered_map>
 
 namespace noire
 {
@@ -47,11 +49,31 @@ namespace noire
 		0xB40BBE37, 0xC30C8EA1, 0x5A05DF1B, 0x2D02EF8D,
 	};
 
+	// Faster versions of crc32Partial and crc32LowercasePartial used at runtime, with the same
+	// results. They process 8 bytes at a time with slicing-by-8 tables and, when the CPU
+	// supports PCLMULQDQ, fold longer strings 64 bytes at a time.
+	u32 crc32PartialRuntime(std::string_view str, u32 hash);
+	u32 crc32LowercasePartialRuntime(std::string_view str, u32 hash);
+
+	// The constexpr functions below switch to the runtime versions when they are not evaluated at
+	// compile time, if the compiler can tell
+#if (defined(_MSC_VER) && _MSC_VER >= 1925) || (defined(__clang__) && __clang_major__ >= 9) || \
+	(defined(__GNUC__) && !defined(__clang__) && __GNUC__ >= 9)
+#define NOIRE_HAS_IS_CONSTANT_EVALUATED
+#endif
+
 	constexpr u32 crc32Partial(std::string_view str, u32 hash = -1)
 	{
+#ifdef NOIRE_HAS_IS_CONSTANT_EVALUATED
+		if (!__builtin_is_constant_evaluated())
+		{
+			return crc32PartialRuntime(str, hash);
+		}
+#endif
+
 		for (size i = 0; i < str.size(); ++i)
 		{
-			hash = crc32Table[str[i] ^ (hash & 0xFF)] ^ (hash >> 8);
+			hash = crc32Table[static_cast<u8>(str[i]) ^ (hash & 0xFF)] ^ (hash >> 8);
 		}
 
 		return hash;
@@ -61,6 +83,13 @@ namespace noire
 
 	constexpr u32 crc32LowercasePartial(std::string_view str, u32 hash = -1)
 	{
+#ifdef NOIRE_HAS_IS_CONSTANT_EVALUATED
+		if (!__builtin_is_constant_evaluated())
+		{
+			return crc32LowercasePartialRuntime(str, hash);
+		}
+#endif
+
 		for (size i = 0; i < str.size(); ++i)
 		{
 			char c = str[i];
@@ -69,7 +98,7 @@ namespace noire
 				c += 32;
 			}
 
-			hash = crc32Table[c ^ (hash & 0xFF)] ^ (hash >> 8);
+			hash = crc32Table[static_cast<u8>(c) ^ (hash & 0xFF)] ^ (hash >> 8);
 		}
 
 		return hash;
@@ -80,13 +109,27 @@ namespace noire
 		return ~crc32LowercasePartial(str, hash);
 	}
 
+	class MappedFileStream;
+	class ThreadPool;
+
 	class HashLookup
 	{
 	public:
 		static constexpr std::string_view HashPrefix{ "?#" };
 		static constexpr std::string_view HashSuffix{ "#?" };
 
+		// Loads a text hashes database, one string per line, or one built by Compile.
 		HashLookup(const std::filesystem::path& path, bool caseSensitive);
+		// Same as above, but a text database is split in chunks that are parsed and hashed on the
+		// threads of the pool.
+		HashLookup(const std::filesystem::path& path, bool caseSensitive, ThreadPool& pool);
+		~HashLookup();
+
+		HashLookup(const HashLookup&) = delete;
+		HashLookup(HashLookup&&) = delete;
+
+		HashLookup& operator=(const HashLookup&) = delete;
+		HashLookup& operator=(HashLookup&&) = delete;
 
 		/// Tries to translate the hash to a string. If no translation is found, the hash converted
 		/// to a hexadecimal string prefixed by 'HashPrefix' is returned.
@@ -100,10 +143,28 @@ namespace noire
 
 		static const HashLookup& Instance(bool caseSensitive = true);
 
+		/// Builds the compiled version of a text hashes database. It stores the sorted hashes of
+		/// both modes and the strings, so loading it only needs to map the file instead of reading
+		/// and hashing every line.
+		static void Compile(const std::filesystem::path& textPath,
+							const std::filesystem::path& compiledPath);
+		/// Path of the compiled version of a text hashes database, 'hashes.db' -> 'hashes.bin'
+		static std::filesystem::path CompiledPath(const std::filesystem::path& textPath);
+
 	private:
 		void Load(const std::filesystem::path& path);
+		void Load(const std::filesystem::path& path, ThreadPool& pool);
+		bool LoadCompiled(const std::filesystem::path& path);
+		std::optional<std::string> Find(u32 hash) const;
 
 		std::unordered_map<u32, std::string> mHashToStr;
 		bool mCaseSensitive;
+
+		// of a compiled database
+		std::unique_ptr<MappedFileStream> mCompiled;
+		const u32* mCompiledHashes;  // in Eytzinger order
+		const u32* mCompiledOffsets; // offset of the string of each hash
+		u32 mCompiledCount;
+		std::string_view mCompiledStrings;
 	};
 }
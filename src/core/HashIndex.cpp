@@ -0,0 +1,247 @@
+#include "HashIndex.h"
+#include <doctest/doctest.h>
+#include <utility>
+
+namespace noire
+{
+	static constexpr size MinCapacity{ 16 };
+
+	// keep the table at most half full, probe sequences stay short
+	static size CapacityFor(size count)
+	{
+		size capacity = MinCapacity;
+		while (capacity < count * 2)
+		{
+			capacity *= 2;
+		}
+		return capacity;
+	}
+
+	HashIndex::HashIndex() : mSlots{}, mCount{ 0 }, mShift{ 32 } {}
+
+	void HashIndex::Clear()
+	{
+		mSlots.clear();
+		mCount = 0;
+		mShift = 32;
+	}
+
+	void HashIndex::Reserve(size count)
+	{
+		if (const size capacity = CapacityFor(count); capacity > mSlots.size())
+		{
+			Rehash(capacity);
+		}
+	}
+
+	bool HashIndex::Insert(u32 key, u32 value)
+	{
+		Expects(value != NotFound);
+
+		if ((mCount + 1) * 2 > mSlots.size())
+		{
+			Rehash(CapacityFor(mCount + 1));
+		}
+
+		const size mask = mSlots.size() - 1;
+		for (size i = SlotIndex(key);; i = (i + 1) & mask)
+		{
+			Slot& s = mSlots[i];
+			if (s.Value == NotFound)
+			{
+				s = { key, value };
+				mCount++;
+				return true;
+			}
+			else if (s.Key == key)
+			{
+				return false;
+			}
+		}
+	}
+
+	void HashIndex::InsertDuplicate(u32 key, u32 value)
+	{
+		Expects(value != NotFound);
+
+		if ((mCount + 1) * 2 > mSlots.size())
+		{
+			Rehash(CapacityFor(mCount + 1));
+		}
+
+		Place(key, value);
+	}
+
+	u32 HashIndex::Find(u32 key) const
+	{
+		if (mSlots.empty())
+		{
+			return NotFound;
+		}
+
+		const size mask = mSlots.size() - 1;
+		for (size i = SlotIndex(key);; i = (i + 1) & mask)
+		{
+			const Slot& s = mSlots[i];
+			if (s.Value == NotFound || s.Key == key)
+			{
+				return s.Value;
+			}
+		}
+	}
+
+	bool HashIndex::Remove(u32 key, u32 value)
+	{
+		if (mSlots.empty())
+		{
+			return false;
+		}
+
+		const size mask = mSlots.size() - 1;
+		size i = SlotIndex(key);
+		for (;; i = (i + 1) & mask)
+		{
+			const Slot& s = mSlots[i];
+			if (s.Value == NotFound)
+			{
+				return false;
+			}
+			else if (s.Key == key && s.Value == value)
+			{
+				break;
+			}
+		}
+
+		// shift back the following slots of the probe sequence into the hole, so lookups don't
+		// stop early and no tombstones are needed
+		for (size j = (i + 1) & mask; mSlots[j].Value != NotFound; j = (j + 1) & mask)
+		{
+			const size home = SlotIndex(mSlots[j].Key);
+			// move the slot only if its home is not between the hole and its current position
+			const bool canMove = (i <= j) ? (home <= i || home > j) : (home <= i && home > j);
+			if (canMove)
+			{
+				mSlots[i] = mSlots[j];
+				i = j;
+			}
+		}
+
+		mSlots[i] = { 0, NotFound };
+		mCount--;
+		return true;
+	}
+
+	size HashIndex::SlotIndex(u32 key) const
+	{
+		// fibonacci hashing, mixes the bits in case the keys are not uniformly distributed
+		return static_cast<size>(static_cast<u32>(key * 0x9E3779B9u) >> mShift);
+	}
+
+	void HashIndex::Place(u32 key, u32 value)
+	{
+		const size mask = mSlots.size() - 1;
+		for (size i = SlotIndex(key);; i = (i + 1) & mask)
+		{
+			if (mSlots[i].Value == NotFound)
+			{
+				mSlots[i] = { key, value };
+				mCount++;
+				return;
+			}
+		}
+	}
+
+	void HashIndex::Rehash(size capacity)
+	{
+		std::vector<Slot> oldSlots = std::exchange(mSlots, std::vector<Slot>(capacity));
+		for (Slot& s : mSlots)
+		{
+			s = { 0, NotFound };
+		}
+
+		mShift = 32;
+		for (size c = capacity; c > 1; c >>= 1)
+		{
+			mShift--;
+		}
+
+		mCount = 0;
+		for (const Slot& s : oldSlots)
+		{
+			if (s.Value != NotFound)
+			{
+				Place(s.Key, s.Value);
+			}
+		}
+	}
+}
+
+TEST_SUITE("HashIndex")
+{
+	using namespace noire;
+
+	TEST_CASE("Empty")
+	{
+		HashIndex i{};
+		CHECK_EQ(i.Count(), 0);
+		CHECK_EQ(i.Find(0), HashIndex::NotFound);
+		CHECK_EQ(i.Find(0x8B8838C2), HashIndex::NotFound);
+	}
+
+	TEST_CASE("Insert and find")
+	{
+		HashIndex i{};
+		for (u32 k = 0; k < 10000; k++)
+		{
+			CHECK(i.Insert(k * 0x01000193, k));
+		}
+		CHECK_EQ(i.Count(), 10000);
+
+		for (u32 k = 0; k < 10000; k++)
+		{
+			CHECK_EQ(i.Find(k * 0x01000193), k);
+		}
+		CHECK_EQ(i.Find(u32{ 10001 } * 0x01000193), HashIndex::NotFound);
+	}
+
+	TEST_CASE("Duplicated keys keep the first value")
+	{
+		HashIndex i{};
+		i.Reserve(4);
+		CHECK(i.Insert(0xB4CDC6D8, 1));
+		CHECK_FALSE(i.Insert(0xB4CDC6D8, 2));
+		CHECK_EQ(i.Count(), 1);
+		CHECK_EQ(i.Find(0xB4CDC6D8), 1);
+
+		i.Clear();
+		CHECK_EQ(i.Find(0xB4CDC6D8), HashIndex::NotFound);
+	}
+
+	TEST_CASE("Duplicated keys and removal")
+	{
+		HashIndex i{};
+		for (u32 v = 0; v < 100; v++)
+		{
+			// 10 values per key
+			i.InsertDuplicate(v % 10, v);
+		}
+		CHECK_EQ(i.Count(), 100);
+
+		CHECK_EQ(i.FindIf(3, [](u32 v) { return v >= 50; }), 53);
+		CHECK_EQ(i.FindIf(3, [](u32 v) { return v == 4; }), HashIndex::NotFound);
+
+		for (u32 v = 0; v < 100; v += 2)
+		{
+			CHECK(i.Remove(v % 10, v));
+		}
+		CHECK_FALSE(i.Remove(2, 2));
+		CHECK_FALSE(i.Remove(3, 4));
+		CHECK_EQ(i.Count(), 50);
+
+		for (u32 v = 0; v < 100; v++)
+		{
+			const u32 found = i.FindIf(v % 10, [v](u32 value) { return value == v; });
+			CHECK_EQ(found, (v % 2) == 0 ? HashIndex::NotFound : v);
+		}
+	}
+}
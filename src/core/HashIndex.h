@@ -0,0 +1,74 @@
+#pragma once
+#include "Common.h"
+#include <vector>
+
+namespace noire
+{
+	// Flat open-addressing hash table that maps 32-bit hashes to indices, used to find archive
+	// entries by their hash without scanning the entries. Uses linear probing over a single array,
+	// so lookups usually touch a single cache line.
+	class HashIndex
+	{
+	public:
+		static constexpr u32 NotFound{ ~u32{ 0 } };
+
+		HashIndex();
+
+		void Clear();
+		// Reserves space for 'count' keys, so inserting them doesn't need to rehash
+		void Reserve(size count);
+		// Adds the key if it is not in the index yet, otherwise the existing value is kept.
+		// Returns whether the key was added.
+		bool Insert(u32 key, u32 value);
+		// Adds the key even if it is already in the index. Values of keys added several times are
+		// told apart with FindIf.
+		void InsertDuplicate(u32 key, u32 value);
+		// Returns the value of the key or NotFound
+		u32 Find(u32 key) const;
+		// Returns the first value of the key for which 'matches(value)' is true or NotFound
+		template<class Predicate>
+		u32 FindIf(u32 key, Predicate matches) const;
+		// Removes the key with the given value, returns whether it was in the index
+		bool Remove(u32 key, u32 value);
+
+		size Count() const { return mCount; }
+
+	private:
+		struct Slot
+		{
+			u32 Key;
+			u32 Value; // NotFound if the slot is empty
+		};
+
+		size SlotIndex(u32 key) const;
+		void Place(u32 key, u32 value);
+		void Rehash(size capacity);
+
+		std::vector<Slot> mSlots; // size is always 0 or a power of two
+		size mCount;
+		u32 mShift; // 32 - log2(mSlots.size())
+	};
+
+	template<class Predicate>
+	u32 HashIndex::FindIf(u32 key, Predicate matches) const
+	{
+		if (mSlots.empty())
+		{
+			return NotFound;
+		}
+
+		const size mask = mSlots.size() - 1;
+		for (size i = SlotIndex(key);; i = (i + 1) & mask)
+		{
+			const Slot& s = mSlots[i];
+			if (s.Value == NotFound)
+			{
+				return NotFound;
+			}
+			else if (s.Key == key && matches(s.Value))
+			{
+				return s.Value;
+			}
+		}
+	}
+}
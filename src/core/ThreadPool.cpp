@@ -0,0 +1,201 @@
+#include "ThreadPool.h"
+#include <algorithm>
+#include <doctest/doctest.h>
+
+namespace noire
+{
+	// pool and queue owned by the current thread, only set inside the worker threads
+	static thread_local const ThreadPool* tCurrentPool{ nullptr };
+	static thread_local size tCurrentQueue{ 0 };
+
+	ThreadPool::ThreadPool(size threadCount)
+		: mQueues{},
+		  mThreads{},
+		  mNextQueue{ 0 },
+		  mStateMutex{},
+		  mTaskAvailable{},
+		  mAllTasksDone{},
+		  mQueuedTasks{ 0 },
+		  mPendingTasks{ 0 },
+		  mStopping{ false }
+	{
+		if (threadCount == 0)
+		{
+			threadCount = std::max<size>(std::thread::hardware_concurrency(), 1);
+		}
+
+		mQueues.reserve(threadCount);
+		for (size i = 0; i < threadCount; i++)
+		{
+			mQueues.emplace_back(std::make_unique<WorkerQueue>());
+		}
+
+		mThreads.reserve(threadCount);
+		for (size i = 0; i < threadCount; i++)
+		{
+			mThreads.emplace_back(&ThreadPool::WorkerMain, this, i);
+		}
+	}
+
+	ThreadPool::~ThreadPool()
+	{
+		Wait();
+
+		{
+			std::lock_guard<std::mutex> lock{ mStateMutex };
+			mStopping = true;
+		}
+		mTaskAvailable.notify_all();
+
+		for (std::thread& t : mThreads)
+		{
+			t.join();
+		}
+	}
+
+	void ThreadPool::Submit(Task task)
+	{
+		Expects(task != nullptr);
+
+		const size queueIndex = tCurrentPool == this ?
+									tCurrentQueue :
+									mNextQueue.fetch_add(1, std::memory_order_relaxed) %
+										mQueues.size();
+
+		{
+			std::lock_guard<std::mutex> lock{ mStateMutex };
+			mQueuedTasks++;
+			mPendingTasks++;
+		}
+
+		{
+			WorkerQueue& q = *mQueues[queueIndex];
+			std::lock_guard<std::mutex> lock{ q.Mutex };
+			q.Tasks.push_back(std::move(task));
+		}
+
+		mTaskAvailable.notify_one();
+	}
+
+	void ThreadPool::Wait()
+	{
+		Expects(tCurrentPool != this);
+
+		std::unique_lock<std::mutex> lock{ mStateMutex };
+		mAllTasksDone.wait(lock, [this]() { return mPendingTasks == 0; });
+	}
+
+	void ThreadPool::WorkerMain(size index)
+	{
+		tCurrentPool = this;
+		tCurrentQueue = index;
+
+		Task task{};
+		while (true)
+		{
+			{
+				std::unique_lock<std::mutex> lock{ mStateMutex };
+				mTaskAvailable.wait(lock, [this]() { return mStopping || mQueuedTasks != 0; });
+				if (mQueuedTasks == 0) // stopping and nothing left to do
+				{
+					return;
+				}
+
+				// claim one of the queued tasks, it will be found in some queue below
+				mQueuedTasks--;
+			}
+
+			while (!TryPop(index, task) && !TrySteal(index, task))
+			{
+				// the claimed task is being pushed by Submit, try again
+				std::this_thread::yield();
+			}
+
+			task();
+			task = nullptr;
+
+			bool allDone;
+			{
+				std::lock_guard<std::mutex> lock{ mStateMutex };
+				allDone = --mPendingTasks == 0;
+			}
+
+			if (allDone)
+			{
+				mAllTasksDone.notify_all();
+			}
+		}
+	}
+
+	bool ThreadPool::TryPop(size index, Task& task)
+	{
+		// own queue is used as a stack, the most recent tasks are more likely to be hot in cache
+		WorkerQueue& q = *mQueues[index];
+		std::lock_guard<std::mutex> lock{ q.Mutex };
+		if (q.Tasks.empty())
+		{
+			return false;
+		}
+
+		task = std::move(q.Tasks.back());
+		q.Tasks.pop_back();
+		return true;
+	}
+
+	bool ThreadPool::TrySteal(size index, Task& task)
+	{
+		// steal the oldest task from the other queues
+		for (size i = 1; i < mQueues.size(); i++)
+		{
+			WorkerQueue& q = *mQueues[(index + i) % mQueues.size()];
+			std::lock_guard<std::mutex> lock{ q.Mutex };
+			if (!q.Tasks.empty())
+			{
+				task = std::move(q.Tasks.front());
+				q.Tasks.pop_front();
+				return true;
+			}
+		}
+
+		return false;
+	}
+}
+
+TEST_SUITE("ThreadPool")
+{
+	using namespace noire;
+
+	TEST_CASE("Runs all tasks")
+	{
+		ThreadPool pool{ 4 };
+		CHECK_EQ(pool.ThreadCount(), 4);
+
+		std::atomic<size> counter{ 0 };
+		for (size i = 0; i < 1000; i++)
+		{
+			pool.Submit([&counter]() { counter++; });
+		}
+		pool.Wait();
+
+		CHECK_EQ(counter.load(), 1000);
+	}
+
+	TEST_CASE("Tasks submitting tasks")
+	{
+		ThreadPool pool{ 3 };
+
+		std::atomic<size> counter{ 0 };
+		for (size i = 0; i < 10; i++)
+		{
+			pool.Submit([&pool, &counter]() {
+				for (size j = 0; j < 10; j++)
+				{
+					pool.Submit([&counter]() { counter++; });
+				}
+			});
+		}
+		pool.Wait();
+
+		CHECK_EQ(counter.load(), 100);
+	}
+}
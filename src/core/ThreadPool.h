@@ -0,0 +1,62 @@
+#pragma once
+#include "Common.h"
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace noire
+{
+	// Fixed-size pool of threads. Each worker has its own task queue, tasks submitted from a worker
+	// go to its own queue and idle workers steal from the queues of the other workers.
+	class ThreadPool
+	{
+	public:
+		using Task = std::function<void()>;
+
+		// A threadCount of 0 uses the number of hardware threads.
+		ThreadPool(size threadCount = 0);
+		// Waits for all pending tasks before stopping the threads.
+		~ThreadPool();
+
+		ThreadPool(const ThreadPool&) = delete;
+		ThreadPool(ThreadPool&&) = delete;
+
+		ThreadPool& operator=(const ThreadPool&) = delete;
+		ThreadPool& operator=(ThreadPool&&) = delete;
+
+		// Tasks must not throw.
+		void Submit(Task task);
+		// Blocks until all the submitted tasks have finished, including tasks submitted by other
+		// tasks meanwhile. Must not be called from a task.
+		void Wait();
+
+		size ThreadCount() const { return mThreads.size(); }
+
+	private:
+		struct WorkerQueue
+		{
+			std::mutex Mutex;
+			std::deque<Task> Tasks;
+		};
+
+		void WorkerMain(size index);
+		bool TryPop(size index, Task& task);
+		bool TrySteal(size index, Task& task);
+
+		std::vector<std::unique_ptr<WorkerQueue>> mQueues;
+		std::vector<std::thread> mThreads;
+		std::atomic<size> mNextQueue;
+
+		std::mutex mStateMutex;
+		std::condition_variable mTaskAvailable;
+		std::condition_variable mAllTasksDone;
+		size mQueuedTasks;  // tasks in the queues, not started yet
+		size mPendingTasks; // tasks not finished yet
+		bool mStopping;
+	};
+}
@@ -1,8 +1,11 @@
 #include "VFS.h"
 #include "Common.h"
+#include "Hash.h"
 #include "files/File.h"
 #include "streams/Stream.h"
 #include "streams/TempStream.h"
+#include <algorithm>
+#include <cstring>
 #include <doctest/doctest.h>
 #include <functional>
 #include <iostream>
@@ -10,23 +13,34 @@
 
 namespace noire
 {
-	VirtualFileSystem::VirtualFileSystem() : mEntries{}, mRoot{ GetDirectory(PathView::Root, true) }
+	VirtualFileSystem::VirtualFileSystem()
+		: mEntries{},
+		  mFreeEntries{},
+		  mChildren{},
+		  mEntryIndex{},
+		  mFiles{},
+		  mNames{},
+		  mNameIds{},
+		  mNameChunks{},
+		  mNameChunkUsed{ 0 },
+		  mNameChunkFree{ 0 }
 	{
+		const EntryIndex root = GetDirectory(PathView::Root, true);
+		Ensures(root == RootEntry);
 	}
 
 	std::shared_ptr<File> VirtualFileSystem::Open(PathView path, OpenCallback cb)
 	{
 		Expects(path.IsFile() && path.IsAbsolute());
 
-		if (Entry* e = FindEntry(path); e)
+		if (const EntryIndex e = FindEntry(path); e != InvalidEntry)
 		{
-			Ensures(e->Type() == EntryType::File);
+			Ensures(mEntries[e].Type == EntryType::File);
 
-			FileEntry* fe = static_cast<FileEntry*>(e);
-			std::shared_ptr<File>& f = fe->File();
+			std::shared_ptr<File>& f = mFiles[e];
 			if (f == nullptr)
 			{
-				f = cb(path, fe->Info());
+				f = cb(path, mEntries[e].Info);
 			}
 
 			return f;
@@ -39,7 +53,7 @@ namespace noire
 	VirtualFileSystem::Create(Device& parent, PathView path, size fileTypeId, CreateCallback cb)
 	{
 		Expects(path.IsFile() && path.IsAbsolute());
-		Expects(FindEntry(path) == nullptr);
+		Expects(FindEntry(path) == InvalidEntry);
 
 		FileEntryInfo info = cb(path);
 		RegisterExistingFile(path, std::move(info));
@@ -51,24 +65,28 @@ namespace noire
 	{
 		Expects(path.IsAbsolute());
 
-		return FindEntry(path) != nullptr;
+		return FindEntry(path) != InvalidEntry;
 	}
 
 	bool VirtualFileSystem::Delete(PathView filePath)
 	{
 		Expects(filePath.IsFile() && filePath.IsAbsolute());
 
-		const size hash = std::hash<PathView>{}(filePath);
-
-		auto it = mEntries.find(hash);
-		if (it != mEntries.end())
+		const EntryIndex e = FindEntry(filePath);
+		if (e != InvalidEntry)
 		{
-			DirectoryEntry* parent = GetDirectory(filePath.Parent(), false);
-			Ensures(parent != nullptr);
+			Entry& entry = mEntries[e];
+			Ensures(entry.Type == EntryType::File);
+
+			std::vector<EntryIndex>& siblings = mChildren[mEntries[entry.Parent].Children];
+			siblings.erase(std::find(siblings.begin(), siblings.end(), e));
 
-			parent->RemoveChild(it->second.get());
+			const bool removed = mEntryIndex.Remove(HashPath(filePath), e);
+			Ensures(removed);
 
-			mEntries.erase(it);
+			entry.Type = EntryType::None;
+			mFiles.erase(e);
+			mFreeEntries.push_back(e);
 			return true;
 		}
 		else
@@ -81,11 +99,11 @@ namespace noire
 	{
 		Expects(path.IsFile() && path.IsAbsolute());
 
-		Entry* e = FindEntry(path);
-		Expects(e != nullptr);
-		Ensures(e->Type() == EntryType::File);
+		const EntryIndex e = FindEntry(path);
+		Expects(e != InvalidEntry);
+		Ensures(mEntries[e].Type == EntryType::File);
 
-		return static_cast<FileEntry*>(e)->Info();
+		return mEntries[e].Info;
 	}
 
 	void VirtualFileSystem::RegisterExistingFile(PathView path, FileEntryInfo info)
@@ -93,15 +111,13 @@ namespace noire
 		Expects(path.IsFile() && path.IsAbsolute());
 
 		// TODO: provide override option?
-		Expects(FindEntry(path) == nullptr); // path is not registered yet
+		Expects(FindEntry(path) == InvalidEntry); // path is not registered yet
 
-		DirectoryEntry* parent = GetDirectory(path.Parent(), true);
-		Ensures(parent != nullptr);
-		auto entry = std::make_unique<FileEntry>(path, parent, std::move(info));
-		if (auto p = mEntries.emplace(std::hash<PathView>{}(path), std::move(entry)); p.second)
-		{
-			Ensures(p.first->second->Type() == EntryType::File);
-		}
+		const EntryIndex parent = GetDirectory(path.Parent(), true);
+		Ensures(parent != InvalidEntry);
+
+		const EntryIndex e = NewEntry(path, EntryType::File, parent);
+		mEntries[e].Info = std::move(info);
 	}
 
 	void VirtualFileSystem::Visit(VisitCallback visitDirectory,
@@ -109,123 +125,171 @@ namespace noire
 								  PathView dirPath,
 								  bool recursive)
 	{
-		DirectoryEntry* dir = GetDirectory(dirPath, false);
-		if (dir)
+		const EntryIndex dir = GetDirectory(dirPath, false);
+		if (dir != InvalidEntry)
 		{
-			VisitDirectory(dir, Path{ dirPath }, visitDirectory, visitFile, recursive);
+			std::string path{ dirPath.String() };
+			VisitDirectory(dir, path, visitDirectory, visitFile, recursive);
 		}
 	}
 
-	void VirtualFileSystem::VisitDirectory(DirectoryEntry* dir,
-										   Path dirPath,
+	void VirtualFileSystem::VisitDirectory(EntryIndex dir,
+										   std::string& dirPath,
 										   const VisitCallback& visitDirectory,
 										   const VisitCallback& visitFile,
-										   bool recursive)
+										   bool recursive) const
 	{
-		for (Entry* e : dir->Children())
+		const size dirPathLength = dirPath.size();
+		for (const EntryIndex child : mChildren[mEntries[dir].Children])
 		{
-			switch (e->Type())
+			const Entry& e = mEntries[child];
+			dirPath.append(mNames[e.Name]);
+
+			switch (e.Type)
 			{
-			case EntryType::File: visitFile(dirPath / e->Name()); break;
+			case EntryType::File: visitFile(PathView{ dirPath }); break;
 			case EntryType::Directory:
 			{
-				Path p = dirPath / e->Name() + Path::DirectorySeparator;
-				visitDirectory(p);
+				dirPath.push_back(Path::DirectorySeparator);
+				visitDirectory(PathView{ dirPath });
 				if (recursive)
 				{
-					VisitDirectory(static_cast<DirectoryEntry*>(e),
-								   std::move(p),
-								   visitDirectory,
-								   visitFile,
-								   recursive);
+					VisitDirectory(child, dirPath, visitDirectory, visitFile, recursive);
 				}
 				// TODO: another callback after visiting directory contents may be needed
 				break;
 			}
 			default: Ensures(false); break;
 			}
+
+			dirPath.resize(dirPathLength);
 		}
 	}
 
-	VirtualFileSystem::Entry* VirtualFileSystem::FindEntry(PathView path) const
+	VirtualFileSystem::EntryIndex VirtualFileSystem::FindEntry(PathView path) const
 	{
 		Expects(path.IsAbsolute());
 
-		const size hash = std::hash<PathView>{}(path);
+		return mEntryIndex.FindIf(HashPath(path), [this, path](EntryIndex e) {
+			return EntryHasPath(e, path);
+		});
+	}
 
-		auto it = mEntries.find(hash);
-		if (it != mEntries.end())
+	bool VirtualFileSystem::EntryHasPath(EntryIndex e, PathView path) const
+	{
+		const bool isDirectory = mEntries[e].Type == EntryType::Directory;
+		if (isDirectory != path.IsDirectory())
 		{
-			Ensures(it->second != nullptr);
-			return it->second.get();
+			return false;
 		}
-		else
+
+		// compare the names from the entry up to the root with the path from its end
+		std::string_view rest = path.String();
+		if (isDirectory)
+		{
+			rest.remove_suffix(1);
+		}
+
+		for (; e != RootEntry; e = mEntries[e].Parent)
 		{
-			return nullptr;
+			const std::string_view name = mNames[mEntries[e].Name];
+			if (rest.size() <= name.size() ||
+				rest[rest.size() - name.size() - 1] != Path::DirectorySeparator ||
+				rest.substr(rest.size() - name.size()) != name)
+			{
+				return false;
+			}
+
+			rest.remove_suffix(name.size() + 1);
 		}
+
+		return rest.empty();
 	}
 
-	VirtualFileSystem::DirectoryEntry* VirtualFileSystem::GetDirectory(PathView path, bool create)
+	VirtualFileSystem::EntryIndex VirtualFileSystem::GetDirectory(PathView path, bool create)
 	{
 		Expects(path.IsDirectory() && path.IsAbsolute());
 
-		Entry* e = FindEntry(path);
-		if (e)
+		const EntryIndex e = FindEntry(path);
+		if (e != InvalidEntry)
 		{
-			Ensures(e->Type() == EntryType::Directory);
-			return static_cast<DirectoryEntry*>(e);
+			Ensures(mEntries[e].Type == EntryType::Directory);
+			return e;
 		}
 		else if (create)
 		{
-			DirectoryEntry* parent = path.IsRoot() ? nullptr : GetDirectory(path.Parent(), true);
-			auto newEntry = std::make_unique<DirectoryEntry>(path, parent);
-			if (auto p = mEntries.emplace(std::hash<PathView>{}(path), std::move(newEntry));
-				p.second)
-			{
-				Ensures(p.first->second->Type() == EntryType::Directory);
-				return static_cast<DirectoryEntry*>(p.first->second.get());
-			}
+			const EntryIndex parent =
+				path.IsRoot() ? InvalidEntry : GetDirectory(path.Parent(), true);
+			return NewEntry(path, EntryType::Directory, parent);
 		}
 
-		return nullptr;
+		return InvalidEntry;
 	}
 
-	VirtualFileSystem::Entry::Entry(PathView path, EntryType type, DirectoryEntry* parent)
-		: mName{ path.Name() }, mType{ type }, mParent{ parent }
+	VirtualFileSystem::EntryIndex
+	VirtualFileSystem::NewEntry(PathView path, EntryType type, EntryIndex parent)
 	{
-		if (parent)
+		Expects(type != EntryType::None);
+		Expects(parent != InvalidEntry || path.IsRoot());
+
+		Entry entry{ InternName(path.Name()), parent, type, 0, FileEntryInfo{} };
+		if (type == EntryType::Directory)
 		{
-			parent->AddChild(this);
+			entry.Children = gsl::narrow<u32>(mChildren.size());
+			mChildren.emplace_back();
 		}
-	}
 
-	VirtualFileSystem::DirectoryEntry::DirectoryEntry(PathView path, DirectoryEntry* parent)
-		: Entry(path, EntryType::Directory, parent)
-	{
-		Expects(path.IsDirectory() && path.IsAbsolute());
-	}
+		EntryIndex e;
+		if (!mFreeEntries.empty())
+		{
+			e = mFreeEntries.back();
+			mFreeEntries.pop_back();
+			mEntries[e] = entry;
+		}
+		else
+		{
+			e = gsl::narrow<EntryIndex>(mEntries.size());
+			Expects(e != InvalidEntry);
+			mEntries.push_back(entry);
+		}
 
-	void VirtualFileSystem::DirectoryEntry::AddChild(Entry* e)
-	{
-		Expects(e != nullptr && e->Parent() == this);
+		if (parent != InvalidEntry)
+		{
+			mChildren[mEntries[parent].Children].push_back(e);
+		}
 
-		mChildren.push_back(e);
+		mEntryIndex.InsertDuplicate(HashPath(path), e);
+		return e;
 	}
 
-	void VirtualFileSystem::DirectoryEntry::RemoveChild(Entry* e)
+	u32 VirtualFileSystem::HashPath(PathView path) { return crc32(path.String()); }
+
+	VirtualFileSystem::NameId VirtualFileSystem::InternName(std::string_view name)
 	{
-		Expects(e != nullptr && e->Parent() == this);
+		if (auto it = mNameIds.find(name); it != mNameIds.end())
+		{
+			return it->second;
+		}
 
-		mChildren.erase(std::find(mChildren.begin(), mChildren.end(), e));
-	}
+		if (mNameChunks.empty() || name.size() > mNameChunkFree)
+		{
+			// names longer than a chunk get a chunk of their own
+			const size chunkSize = std::max(NameChunkSize, name.size());
+			mNameChunks.emplace_back(std::make_unique<char[]>(chunkSize));
+			mNameChunkUsed = 0;
+			mNameChunkFree = chunkSize;
+		}
 
-	VirtualFileSystem::FileEntry::FileEntry(PathView path,
-											DirectoryEntry* parent,
-											FileEntryInfo info)
-		: Entry(path, EntryType::File, parent), mInfo{ std::move(info) }, mFile{ nullptr }
-	{
-		Expects(path.IsFile() && path.IsAbsolute());
-		Expects(parent != nullptr);
+		char* const str = mNameChunks.back().get() + mNameChunkUsed;
+		std::memcpy(str, name.data(), name.size());
+		mNameChunkUsed += name.size();
+		mNameChunkFree -= name.size();
+
+		const NameId id = gsl::narrow<NameId>(mNames.size());
+		const std::string_view stored{ str, name.size() };
+		mNames.push_back(stored);
+		mNameIds.emplace(stored, id);
+		return id;
 	}
 }
 
@@ -273,4 +337,83 @@ TEST_SUITE("VFS")
 
 		CHECK_FALSE(vfs.Delete("/test5"));
 	}
-}
\ No newline at end of file
+
+	TEST_CASE("Entries and names are reused")
+	{
+		VirtualFileSystem vfs{};
+
+		for (size i = 0; i < 100; i++)
+		{
+			const std::string dir = "/dir" + std::to_string(i % 10) + "/";
+			if (i < 10)
+			{
+				vfs.RegisterExistingFile(dir + "a", i * 2);
+			}
+			vfs.RegisterExistingFile(dir + "sub/file" + std::to_string(i), i * 2 + 1);
+		}
+
+		// root, 10 dirs with 2 files each (a + sub/) and 100 files in the subdirectories
+		CHECK_EQ(vfs.EntryCount(), 1 + 10 * 3 + 100);
+		// "", dir0-9, a, sub, file0-99
+		CHECK_EQ(vfs.NameCount(), 1 + 10 + 2 + 100);
+		CHECK_EQ(vfs.GetFileInfo("/dir3/sub/file13"), 27);
+
+		size fileCount = 0, dirCount = 0;
+		vfs.Visit(
+			[&dirCount](PathView p) {
+				dirCount++;
+				CHECK(p.IsDirectory());
+			},
+			[&fileCount](PathView p) {
+				fileCount++;
+				CHECK(p.IsFile());
+			},
+			PathView::Root);
+		CHECK_EQ(dirCount, 20);
+		CHECK_EQ(fileCount, 110);
+
+		CHECK(vfs.Delete("/dir3/sub/file13"));
+		CHECK_EQ(vfs.EntryCount(), 1 + 10 * 3 + 99);
+		vfs.RegisterExistingFile("/dir3/sub/new", 1234);
+		CHECK_EQ(vfs.EntryCount(), 1 + 10 * 3 + 100);
+		CHECK_EQ(vfs.GetFileInfo("/dir3/sub/new"), 1234);
+
+		std::vector<std::string> visited;
+		vfs.Visit([](PathView) {},
+				  [&visited](PathView p) { visited.emplace_back(p.String()); },
+				  "/dir3/sub/",
+				  false);
+		REQUIRE_EQ(visited.size(), 10);
+		CHECK_EQ(visited.front(), "/dir3/sub/file3");
+		CHECK_EQ(visited.back(), "/dir3/sub/new");
+
+		// moving keeps the interned names valid
+		VirtualFileSystem moved{ std::move(vfs) };
+		CHECK(moved.Exists("/dir9/sub/file99"));
+		CHECK_EQ(moved.GetFileInfo("/dir9/a"), 18);
+	}
+
+	TEST_CASE("Paths with the same hash")
+	{
+		// crc32("/plumless") == crc32("/buckeroo")
+		VirtualFileSystem vfs{};
+		vfs.RegisterExistingFile("/plumless", 1);
+		CHECK_FALSE(vfs.Exists("/buckeroo"));
+		CHECK_FALSE(vfs.Exists("/plumless/"));
+
+		vfs.RegisterExistingFile("/buckeroo", 2);
+		vfs.RegisterExistingFile("/plumless/buckeroo", 3);
+		vfs.RegisterExistingFile("/buckeroo/plumless", 4);
+		CHECK_EQ(vfs.GetFileInfo("/plumless"), 1);
+		CHECK_EQ(vfs.GetFileInfo("/buckeroo"), 2);
+		CHECK_EQ(vfs.GetFileInfo("/plumless/buckeroo"), 3);
+		CHECK_EQ(vfs.GetFileInfo("/buckeroo/plumless"), 4);
+		CHECK(vfs.Exists("/plumless/"));
+		CHECK(vfs.Exists("/buckeroo/"));
+
+		CHECK(vfs.Delete("/plumless"));
+		CHECK_FALSE(vfs.Exists("/plumless"));
+		CHECK_EQ(vfs.GetFileInfo("/buckeroo"), 2);
+		CHECK_FALSE(vfs.Delete("/plumless"));
+	}
+}
@@ -1,8 +1,12 @@
 #pragma once
 #include "Common.h"
+#include "HashIndex.h"
 #include "Path.h"
+#include <functional>
 #include <memory>
 #include <string>
+#include <string_view>
+#include <unordered_map>
 #include <vector>
 
 namespace noire
@@ -16,56 +20,26 @@ namespace noire
 		using FileEntryInfo = size;
 
 	private:
-		enum class EntryType
+		enum class EntryType : u8
 		{
-			None = 0,
+			None = 0, // deleted entry, see mFreeEntries
 			Directory,
 			File,
 		};
 
-		class DirectoryEntry;
+		using EntryIndex = u32;
+		using NameId = u32;
+		static constexpr EntryIndex InvalidEntry{ HashIndex::NotFound };
 
-		class Entry
+		// Entries are stored in a single array and refer to each other by index, names are
+		// interned so each distinct name is stored once.
+		struct Entry
 		{
-		public:
-			Entry(PathView path, EntryType type, DirectoryEntry* parent);
-			virtual ~Entry() = default;
-
-			const std::string& Name() const { return mName; }
-			EntryType Type() const { return mType; }
-			DirectoryEntry* Parent() const { return mParent; }
-
-		private:
-			std::string mName;
-			EntryType mType;
-			DirectoryEntry* mParent;
-		};
-
-		class DirectoryEntry final : public Entry
-		{
-		public:
-			DirectoryEntry(PathView path, DirectoryEntry* parent);
-
-			void AddChild(Entry* e);
-			void RemoveChild(Entry* e);
-
-			const std::vector<Entry*>& Children() const { return mChildren; }
-
-		private:
-			std::vector<Entry*> mChildren;
-		};
-
-		class FileEntry final : public Entry
-		{
-		public:
-			FileEntry(PathView path, DirectoryEntry* parent, FileEntryInfo info);
-
-			FileEntryInfo Info() const { return mInfo; }
-			std::shared_ptr<File>& File() { return mFile; };
-
-		private:
-			FileEntryInfo mInfo;
-			std::shared_ptr<noire::File> mFile;
+			NameId Name;
+			EntryIndex Parent;
+			EntryType Type;
+			u32 Children;       // directories: index in mChildren
+			FileEntryInfo Info; // files only
 		};
 
 	public:
@@ -100,16 +74,44 @@ namespace noire
 				   PathView dirPath,
 				   bool recursive = true);
 
+		size EntryCount() const { return mEntries.size() - mFreeEntries.size(); }
+		size NameCount() const { return mNames.size(); }
+
 	private:
-		void VisitDirectory(DirectoryEntry* dir,
-							Path dirPath,
+		// 'dirPath' is the path of 'dir', it is extended with the names of the entries while
+		// visiting them, so no path needs to be allocated per entry
+		void VisitDirectory(EntryIndex dir,
+							std::string& dirPath,
 							const VisitCallback& visitDirectory,
 							const VisitCallback& visitFile,
-							bool recursive);
-		Entry* FindEntry(PathView path) const;
-		DirectoryEntry* GetDirectory(PathView path, bool create);
-
-		std::unordered_map<std::size_t, std::unique_ptr<Entry>> mEntries;
-		DirectoryEntry* mRoot;
+							bool recursive) const;
+		EntryIndex FindEntry(PathView path) const;
+		bool EntryHasPath(EntryIndex e, PathView path) const;
+		EntryIndex GetDirectory(PathView path, bool create);
+		EntryIndex NewEntry(PathView path, EntryType type, EntryIndex parent);
+		NameId InternName(std::string_view name);
+
+		std::vector<Entry> mEntries;
+		// deleted entries, reused before adding new ones
+		std::vector<EntryIndex> mFreeEntries;
+		// children of each directory, in the order they were added
+		std::vector<std::vector<EntryIndex>> mChildren;
+		// path hash -> entry, the path of the entry is compared as well since different paths
+		// may have the same hash
+		HashIndex mEntryIndex;
+		// files opened so far
+		std::unordered_map<EntryIndex, std::shared_ptr<File>> mFiles;
+
+		// NameId -> name, the names are stored in mNameChunks
+		std::vector<std::string_view> mNames;
+		std::unordered_map<std::string_view, NameId> mNameIds;
+		std::vector<std::unique_ptr<char[]>> mNameChunks;
+		size mNameChunkUsed; // bytes used in the last chunk
+		size mNameChunkFree; // bytes not used yet in the last chunk
+
+		static constexpr size NameChunkSize{ 0x10000 };
+		static constexpr EntryIndex RootEntry{ 0 };
+
+		static u32 HashPath(PathView path);
 	};
 }
\ No newline at end of file
@@ -26,5 +26,8 @@ namespace noire
 						   bool recursive = true) = 0;
 		virtual ReadOnlyStream OpenStream(PathView path) = 0;
 		virtual void Commit() {}
+		// Called when a file opened from this device is modified. Devices that cache information
+		// about their files, such as their sizes, invalidate it here.
+		virtual void OnFileChanged(File&) {}
 	};
 }
\ No newline at end of file
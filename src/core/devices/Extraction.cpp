@@ -0,0 +1,285 @@
+#include "Extraction.h"
+#include "LocalDevice.h"
+#include "ThreadPool.h"
+#include "streams/FileStream.h"
+#include "streams/Stream.h"
+#include "tests/TestUtil.h"
+#include <algorithm>
+#include <condition_variable>
+#include <doctest/doctest.h>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <system_error>
+
+namespace noire
+{
+	namespace fs = std::filesystem;
+
+	// Limits how many bytes the extraction tasks can have buffered at the same time.
+	class ExtractBudget
+	{
+	public:
+		ExtractBudget(u64 maxBytes) : mMaxBytes{ maxBytes }, mUsedBytes{ 0 }, mMutex{}, mReleased{}
+		{
+		}
+
+		// Blocks until 'count' bytes are available, 'count' must not exceed the maximum.
+		void Acquire(u64 count)
+		{
+			Expects(count <= mMaxBytes);
+
+			std::unique_lock<std::mutex> lock{ mMutex };
+			mReleased.wait(lock, [this, count]() { return count <= (mMaxBytes - mUsedBytes); });
+			mUsedBytes += count;
+		}
+
+		void Release(u64 count)
+		{
+			{
+				std::lock_guard<std::mutex> lock{ mMutex };
+				mUsedBytes -= count;
+			}
+			mReleased.notify_all();
+		}
+
+	private:
+		const u64 mMaxBytes;
+		u64 mUsedBytes;
+		std::mutex mMutex;
+		std::condition_variable mReleased;
+	};
+
+	// Bigger files are copied in chunks of this size, so a single file doesn't hold most of the
+	// budget for a long time.
+	static constexpr u64 MaxChunkSize{ 16 * 1024 * 1024 };
+
+	// Returns the number of bytes extracted, or nothing if the file was not extracted completely
+	static std::optional<u64> ExtractFile(Device& device,
+										  PathView path,
+										  const fs::path& destination,
+										  ExtractBudget& budget,
+										  u64 maxChunkSize)
+	{
+		// remove root '/' from path before concatenating. Paths come from the archives, the ones
+		// with '..' or a root that would write outside of the destination are not extracted.
+		const fs::path outputPath = (destination / path.String().substr(1)).lexically_normal();
+		const fs::path relativePath = outputPath.lexically_relative(destination.lexically_normal());
+		if (relativePath.empty() || *relativePath.begin() == ".." || relativePath == ".")
+		{
+			return std::nullopt;
+		}
+
+		ReadOnlyStream input = device.OpenStream(path);
+		const u64 inputSize = input.Size();
+
+		std::error_code ec;
+		fs::create_directories(outputPath.parent_path(), ec);
+		// FileStream doesn't truncate existing files
+		fs::remove(outputPath, ec);
+
+		FileStream output{ outputPath };
+		if (inputSize == 0)
+		{
+			return inputSize;
+		}
+
+		// mapped input, write straight from it without copying to a buffer
+		if (gsl::span<const byte> contiguous = input.TryGetContiguous(0, inputSize);
+			!contiguous.empty())
+		{
+			if (output.WriteAt(contiguous.data(), inputSize, 0) != inputSize)
+			{
+				return std::nullopt;
+			}
+
+			return inputSize;
+		}
+
+		const u64 bufferSize = std::min(inputSize, maxChunkSize);
+		budget.Acquire(bufferSize);
+		auto releaseBudget = gsl::finally([&budget, bufferSize]() { budget.Release(bufferSize); });
+
+		std::unique_ptr<byte[]> buffer = std::make_unique<byte[]>(gsl::narrow<size>(bufferSize));
+		for (u64 offset = 0; offset < inputSize;)
+		{
+			const u64 count = std::min(bufferSize, inputSize - offset);
+			if (input.ReadAt(buffer.get(), count, offset) != count ||
+				output.WriteAt(buffer.get(), count, offset) != count)
+			{
+				return std::nullopt;
+			}
+
+			offset += count;
+		}
+
+		return inputSize;
+	}
+
+	ExtractResult ExtractFiles(Device& device,
+							   gsl::span<const Path> paths,
+							   const fs::path& destination,
+							   const ExtractOptions& options)
+	{
+		Expects(options.MaxInFlightBytes != 0);
+
+		const u64 maxChunkSize = std::min(MaxChunkSize, options.MaxInFlightBytes);
+		ExtractBudget budget{ options.MaxInFlightBytes };
+
+		ExtractResult result{};
+		std::mutex resultMutex{};
+
+		{
+			ThreadPool pool{ options.ThreadCount };
+			for (const Path& p : paths)
+			{
+				Expects(p.IsFile() && p.IsAbsolute());
+
+				pool.Submit([&, path = PathView{ p }]() {
+					// tasks must not throw, a file that cannot be read or written is a failure
+					std::optional<u64> extractedBytes{};
+					try
+					{
+						extractedBytes =
+							ExtractFile(device, path, destination, budget, maxChunkSize);
+					}
+					catch (const std::exception&)
+					{
+						extractedBytes.reset();
+					}
+
+					std::lock_guard<std::mutex> lock{ resultMutex };
+					if (extractedBytes)
+					{
+						result.ExtractedFiles++;
+						result.ExtractedBytes += *extractedBytes;
+					}
+					else
+					{
+						result.FailedFiles.emplace_back(path);
+					}
+				});
+			}
+			pool.Wait();
+		}
+
+		return result;
+	}
+}
+
+TEST_SUITE("Extraction")
+{
+	using namespace noire;
+	using namespace noire::test;
+
+	TEST_CASE("Extract files from LocalDevice")
+	{
+		namespace fs = std::filesystem;
+
+		const TempDirectory temp{ "noire_extraction_test" };
+		const fs::path& root = temp.Path;
+		const fs::path source = root / "source";
+		const fs::path destination = root / "destination";
+		fs::create_directories(source / "folder");
+
+		std::vector<Path> paths{};
+		for (size i = 0; i < 32; i++)
+		{
+			const std::string name = (i % 2 ? "folder/file" : "file") + std::to_string(i);
+			{
+				// some files are bigger than the budget to check chunked copies
+				FileStream f{ source / name };
+				const std::string contents(i * 7, static_cast<char>('a' + (i % 26)));
+				f.Write(contents.data(), contents.size());
+			}
+			paths.emplace_back("/" + name);
+		}
+
+		LocalDevice device{ source };
+		ExtractOptions options{};
+		options.ThreadCount = 4;
+		options.MaxInFlightBytes = 64;
+		const ExtractResult result = ExtractFiles(device, paths, destination, options);
+
+		CHECK_EQ(result.ExtractedFiles, paths.size());
+		CHECK(result.FailedFiles.empty());
+
+		u64 expectedBytes = 0;
+		for (size i = 0; i < paths.size(); i++)
+		{
+			const fs::path p = destination / paths[i].String().substr(1);
+			REQUIRE(fs::is_regular_file(p));
+			CHECK_EQ(fs::file_size(p), i * 7);
+
+			FileStream f{ p };
+			std::string contents(gsl::narrow<size>(f.Size()), '\0');
+			f.Read(contents.data(), contents.size());
+			CHECK_EQ(contents, std::string(i * 7, static_cast<char>('a' + (i % 26))));
+
+			expectedBytes += i * 7;
+		}
+		CHECK_EQ(result.ExtractedBytes, expectedBytes);
+	}
+
+	TEST_CASE("Files that cannot be written are reported as failed")
+	{
+		namespace fs = std::filesystem;
+
+		const TempDirectory temp{ "noire_extraction_fail_test" };
+		const fs::path& root = temp.Path;
+		const fs::path source = root / "source";
+		const fs::path destination = root / "destination";
+		fs::create_directories(source);
+
+		std::vector<Path> paths{};
+		for (const char* name : { "good", "blocked" })
+		{
+			FileStream f{ source / name };
+			f.Write(name, std::char_traits<char>::length(name));
+			paths.emplace_back(std::string{ "/" } + name);
+		}
+
+		// a non-empty directory where the file should be written, opening it throws
+		fs::create_directories(destination / "blocked" / "inside");
+
+		LocalDevice device{ source };
+		ExtractOptions options{};
+		options.ThreadCount = 2;
+		const ExtractResult result = ExtractFiles(device, paths, destination, options);
+
+		CHECK_EQ(result.ExtractedFiles, 1);
+		REQUIRE_EQ(result.FailedFiles.size(), 1);
+		CHECK_EQ(result.FailedFiles[0], Path{ "/blocked" });
+		CHECK(fs::is_regular_file(destination / "good"));
+	}
+
+	TEST_CASE("Files outside of the destination are not extracted")
+	{
+		namespace fs = std::filesystem;
+
+		const TempDirectory temp{ "noire_extraction_outside_test" };
+		const fs::path& root = temp.Path;
+		const fs::path source = root / "source";
+		const fs::path destination = root / "destination";
+		fs::create_directories(source / "folder");
+
+		for (const fs::path& p : { source / "folder" / "good", root / "outside" })
+		{
+			FileStream f{ p };
+			f.Write("contents", 8);
+		}
+
+		const std::vector<Path> paths{ Path{ "/folder/good" },
+									   Path{ "/../outside" },
+									   Path{ "/folder/../../outside" } };
+		LocalDevice device{ source };
+		const ExtractResult result = ExtractFiles(device, paths, destination);
+
+		CHECK_EQ(result.ExtractedFiles, 1);
+		REQUIRE_EQ(result.FailedFiles.size(), 2);
+		CHECK(fs::is_regular_file(destination / "folder" / "good"));
+		CHECK_EQ(fs::file_size(root / "outside"), 8);
+	}
+}
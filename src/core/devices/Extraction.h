@@ -0,0 +1,38 @@
+#pragma once
+#include "Common.h"
+#include "Path.h"
+#include <filesystem>
+#include <vector>
+
+namespace noire
+{
+	class Device;
+
+	struct ExtractOptions
+	{
+		// Number of threads used to extract the files, 0 uses the number of hardware threads.
+		size ThreadCount{ 0 };
+		// Maximum number of bytes read into memory and not written yet at any time. Files bigger
+		// than this are copied in chunks.
+		u64 MaxInFlightBytes{ 256 * 1024 * 1024 };
+	};
+
+	struct ExtractResult
+	{
+		size ExtractedFiles{ 0 };
+		u64 ExtractedBytes{ 0 };
+		// Files that could not be read or written completely, or were outside of the destination
+		std::vector<Path> FailedFiles{};
+	};
+
+	// Copies the files at 'paths' from the device to the 'destination' directory, keeping their
+	// paths relative to the device root. Files are extracted in parallel, so Device::OpenStream
+	// must be safe to call from several threads (LocalDevice, WAD and Container are) and the device
+	// must not be modified until this returns. Existing files in the destination are overwritten.
+	// Paths that would be written outside of the destination, such as the ones with '..', are
+	// reported as failed.
+	ExtractResult ExtractFiles(Device& device,
+							   gsl::span<const Path> paths,
+							   const std::filesystem::path& destination,
+							   const ExtractOptions& options = {});
+}
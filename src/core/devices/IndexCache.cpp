@@ -0,0 +1,496 @@
+#include "IndexCache.h"
+#include "Hash.h"
+#include "LocalDevice.h"
+#include "files/Container.h"
+#include "files/File.h"
+#include "files/WAD.h"
+#include "streams/FileStream.h"
+#include "tests/TestUtil.h"
+#include <algorithm>
+#include <cstring>
+#include <doctest/doctest.h>
+#include <fstream>
+#include <string>
+#include <system_error>
+#include <type_traits>
+
+namespace noire
+{
+	namespace fs = std::filesystem;
+
+	// The cache file has a header, followed by the type ids, the archive records, the entry
+	// records of all the archives and the path strings. Records are referred to by index and
+	// strings by offset, so the file is used directly from the mapping.
+	struct IndexRawHeader
+	{
+		u32 Magic;
+		u32 Version;
+		u32 TypeCount;
+		u32 ArchiveCount;
+		u32 EntryCount;
+		u32 StringsSize;
+	};
+	static_assert(sizeof(IndexRawHeader) == 24 && std::is_trivially_copyable_v<IndexRawHeader>);
+
+	struct IndexRawArchive
+	{
+		u64 Size;
+		i64 ModifiedTime;
+		u32 HeaderChecksum;
+		u32 FileType; // index in the type ids
+		u32 PathOffset;
+		u32 PathLength;
+		u32 FirstEntry;
+		u32 EntryCount;
+		u32 HasEntries;
+		u32 Padding;
+	};
+	static_assert(sizeof(IndexRawArchive) == 48 && std::is_trivially_copyable_v<IndexRawArchive>);
+
+	struct IndexRawEntry
+	{
+		u32 NameHash;
+		u32 Fields[4];
+		u32 FileType; // index in the type ids
+		u32 PathOffset;
+		u32 PathLength;
+	};
+	static_assert(sizeof(IndexRawEntry) == 32 && std::is_trivially_copyable_v<IndexRawEntry>);
+
+	static constexpr u32 NoType{ static_cast<u32>(-1) };
+
+	// Offsets of each section in the cache file
+	struct IndexLayout
+	{
+		u64 Types;
+		u64 Archives;
+		u64 Entries;
+		u64 Strings;
+		u64 End;
+
+		IndexLayout(const IndexRawHeader& h)
+			: Types{ sizeof(IndexRawHeader) },
+			  Archives{ Types + sizeof(u64) * h.TypeCount },
+			  Entries{ Archives + sizeof(IndexRawArchive) * h.ArchiveCount },
+			  Strings{ Entries + sizeof(IndexRawEntry) * h.EntryCount },
+			  End{ Strings + h.StringsSize }
+		{
+		}
+	};
+
+	IndexKey IndexKey::Of(const fs::path& filePath)
+	{
+		IndexKey k{};
+		k.Size = fs::file_size(filePath);
+		k.ModifiedTime =
+			gsl::narrow_cast<i64>(fs::last_write_time(filePath).time_since_epoch().count());
+
+		// same bytes read to detect the type of the file. Opened read-only, FileStream would need
+		// write access, which read-only installs or the game holding the file don't allow.
+		std::ifstream s{ filePath, std::ios::binary };
+		Expects(s.is_open());
+		std::array<char, File::Signature::WindowSize * 2> window{};
+		const u64 prefixSize = std::min<u64>(k.Size, File::Signature::WindowSize);
+		const u64 suffixSize = std::min<u64>(k.Size - prefixSize, File::Signature::WindowSize);
+		s.read(window.data(), gsl::narrow<std::streamsize>(prefixSize));
+		s.seekg(gsl::narrow<std::streamoff>(k.Size - suffixSize));
+		s.read(window.data() + prefixSize, gsl::narrow<std::streamsize>(suffixSize));
+		Expects(!s.fail());
+
+		const std::string_view bytes{ window.data(), gsl::narrow<size>(prefixSize + suffixSize) };
+		k.HeaderChecksum = crc32(bytes);
+		return k;
+	}
+
+	IndexCache::IndexCache(fs::path cachePath)
+		: mPath{ std::move(cachePath) },
+		  mMapped{ std::nullopt },
+		  mData{},
+		  mMappedArchives{},
+		  mStoredArchives{}
+	{
+		Map();
+	}
+
+	std::optional<IndexCache::Archive> IndexCache::Find(std::string_view filePath,
+														const IndexKey& key) const
+	{
+		if (auto it = mStoredArchives.find(std::string{ filePath }); it != mStoredArchives.end())
+		{
+			if (!it->second || it->second->Key != key)
+			{
+				return std::nullopt;
+			}
+
+			return it->second->Data;
+		}
+
+		const auto it = mMappedArchives.find(filePath);
+		if (it == mMappedArchives.end())
+		{
+			return std::nullopt;
+		}
+
+		const IndexRawHeader h = LoadUnaligned<IndexRawHeader>(mData.data());
+		const IndexLayout layout{ h };
+		const IndexRawArchive a = LoadUnaligned<IndexRawArchive>(
+			mData.data() + layout.Archives + sizeof(IndexRawArchive) * it->second);
+		if (IndexKey{ a.Size, a.ModifiedTime, a.HeaderChecksum } != key)
+		{
+			return std::nullopt;
+		}
+
+		// types that are not registered anymore are detected again
+		const auto typeId = [this, &h, &layout](u32 index) {
+			if (index >= h.TypeCount)
+			{
+				return File::InvalidTypeId;
+			}
+
+			const u64 id = LoadUnaligned<u64>(mData.data() + layout.Types + sizeof(u64) * index);
+			const size fileTypeId = gsl::narrow_cast<size>(id);
+			return File::IsTypeRegistered(fileTypeId) ? fileTypeId : File::InvalidTypeId;
+		};
+		const auto string = [this, &layout](u32 offset, u32 length) {
+			return std::string_view{ reinterpret_cast<const char*>(mData.data()) +
+										 layout.Strings + offset,
+									 length };
+		};
+
+		Archive r{ typeId(a.FileType), a.HasEntries != 0, {} };
+		r.Entries.reserve(a.EntryCount);
+		const byte* entries = mData.data() + layout.Entries + sizeof(IndexRawEntry) * a.FirstEntry;
+		for (size i = 0; i < a.EntryCount; ++i)
+		{
+			const IndexRawEntry e =
+				LoadUnaligned<IndexRawEntry>(entries + sizeof(IndexRawEntry) * i);
+			r.Entries.push_back(IndexEntry{ e.NameHash,
+											{ e.Fields[0], e.Fields[1], e.Fields[2], e.Fields[3] },
+											typeId(e.FileType),
+											string(e.PathOffset, e.PathLength) });
+		}
+
+		return r;
+	}
+
+	void IndexCache::Store(std::string_view filePath, const IndexKey& key, const Archive& archive)
+	{
+		// the paths are copied once the archive is in the map, so their views are not invalidated
+		// by moving the archive
+		std::optional<StoredArchive>& s = mStoredArchives[std::string{ filePath }];
+		s.emplace(StoredArchive{ key, archive, {} });
+		s->Paths.reserve(archive.Entries.size());
+		for (IndexEntry& e : s->Data.Entries)
+		{
+			e.Path = s->Paths.emplace_back(e.Path);
+		}
+	}
+
+	void IndexCache::Remove(std::string_view filePath)
+	{
+		mStoredArchives.insert_or_assign(std::string{ filePath }, std::nullopt);
+	}
+
+	void IndexCache::Save()
+	{
+		// all the archives with their path, the mapped ones replaced by the stored ones
+		std::vector<std::pair<std::string, Archive>> archives{};
+		std::vector<IndexKey> keys{};
+		for (const auto& [path, index] : mMappedArchives)
+		{
+			if (mStoredArchives.find(std::string{ path }) == mStoredArchives.end())
+			{
+				const IndexRawHeader h = LoadUnaligned<IndexRawHeader>(mData.data());
+				const IndexRawArchive a = LoadUnaligned<IndexRawArchive>(
+					mData.data() + IndexLayout{ h }.Archives + sizeof(IndexRawArchive) * index);
+				const IndexKey key{ a.Size, a.ModifiedTime, a.HeaderChecksum };
+				archives.emplace_back(std::string{ path }, *Find(path, key));
+				keys.emplace_back(key);
+			}
+		}
+		for (const auto& [path, stored] : mStoredArchives)
+		{
+			if (stored)
+			{
+				archives.emplace_back(path, stored->Data);
+				keys.emplace_back(stored->Key);
+			}
+		}
+
+		std::vector<u64> types{};
+		const auto typeIndex = [&types](size fileTypeId) {
+			if (fileTypeId == File::InvalidTypeId)
+			{
+				return NoType;
+			}
+
+			auto it = std::find(types.begin(), types.end(), u64{ fileTypeId });
+			if (it == types.end())
+			{
+				it = types.insert(types.end(), u64{ fileTypeId });
+			}
+			return gsl::narrow<u32>(std::distance(types.begin(), it));
+		};
+
+		std::string strings{};
+		const auto addString = [&strings](std::string_view str) {
+			const u32 offset = gsl::narrow<u32>(strings.size());
+			strings += str;
+			return offset;
+		};
+
+		std::vector<IndexRawArchive> rawArchives{};
+		std::vector<IndexRawEntry> rawEntries{};
+		for (size i = 0; i < archives.size(); ++i)
+		{
+			const auto& [path, a] = archives[i];
+			IndexRawArchive r{};
+			r.Size = keys[i].Size;
+			r.ModifiedTime = keys[i].ModifiedTime;
+			r.HeaderChecksum = keys[i].HeaderChecksum;
+			r.FileType = typeIndex(a.FileType);
+			r.PathLength = gsl::narrow<u32>(path.size());
+			r.PathOffset = addString(path);
+			r.FirstEntry = gsl::narrow<u32>(rawEntries.size());
+			r.EntryCount = gsl::narrow<u32>(a.Entries.size());
+			r.HasEntries = a.HasEntries ? 1 : 0;
+			rawArchives.emplace_back(r);
+
+			for (const IndexEntry& e : a.Entries)
+			{
+				IndexRawEntry re{};
+				re.NameHash = e.NameHash;
+				std::copy(e.Fields.begin(), e.Fields.end(), std::begin(re.Fields));
+				re.FileType = typeIndex(e.FileType);
+				re.PathLength = gsl::narrow<u32>(e.Path.size());
+				re.PathOffset = addString(e.Path);
+				rawEntries.emplace_back(re);
+			}
+		}
+
+		const IndexRawHeader h{ HeaderMagic,
+								Version,
+								gsl::narrow<u32>(types.size()),
+								gsl::narrow<u32>(rawArchives.size()),
+								gsl::narrow<u32>(rawEntries.size()),
+								gsl::narrow<u32>(strings.size()) };
+		const IndexLayout layout{ h };
+		std::vector<byte> data(gsl::narrow<size>(layout.End));
+		std::memcpy(data.data(), &h, sizeof(h));
+		std::memcpy(data.data() + layout.Types, types.data(), sizeof(u64) * types.size());
+		std::memcpy(data.data() + layout.Archives,
+					rawArchives.data(),
+					sizeof(IndexRawArchive) * rawArchives.size());
+		std::memcpy(data.data() + layout.Entries,
+					rawEntries.data(),
+					sizeof(IndexRawEntry) * rawEntries.size());
+		std::memcpy(data.data() + layout.Strings, strings.data(), strings.size());
+
+		// written next to the cache and renamed once complete, the mapping is released first
+		// since the data is replaced
+		fs::path tempPath = mPath;
+		tempPath += ".tmp";
+		fs::remove(tempPath);
+		{
+			FileStream output{ tempPath };
+			output.Write(data.data(), data.size());
+		}
+
+		mMappedArchives.clear();
+		mStoredArchives.clear();
+		mData = {};
+		mMapped.reset();
+		fs::rename(tempPath, mPath);
+
+		Map();
+	}
+
+	size IndexCache::ArchiveCount() const
+	{
+		size count = 0;
+		for (const auto& [path, index] : mMappedArchives)
+		{
+			(void)index;
+			if (mStoredArchives.find(std::string{ path }) == mStoredArchives.end())
+			{
+				count++;
+			}
+		}
+		for (const auto& [path, stored] : mStoredArchives)
+		{
+			(void)path;
+			if (stored)
+			{
+				count++;
+			}
+		}
+		return count;
+	}
+
+	void IndexCache::Map()
+	{
+		std::error_code ec;
+		if (!fs::is_regular_file(mPath, ec) || fs::file_size(mPath, ec) < sizeof(IndexRawHeader))
+		{
+			return;
+		}
+
+		MappedFileStream& m = mMapped.emplace(mPath);
+		const gsl::span<const byte> data = m.TryGetContiguous(0, m.Size());
+		const IndexRawHeader h = LoadUnaligned<IndexRawHeader>(data.data());
+		const IndexLayout layout{ h };
+		if (h.Magic != HeaderMagic || h.Version != Version || layout.End != m.Size())
+		{
+			// not valid, replaced on next Save()
+			mMapped.reset();
+			return;
+		}
+
+		mData = data;
+		mMappedArchives.reserve(h.ArchiveCount);
+		for (u32 i = 0; i < h.ArchiveCount; ++i)
+		{
+			const IndexRawArchive a = LoadUnaligned<IndexRawArchive>(
+				mData.data() + layout.Archives + sizeof(IndexRawArchive) * i);
+
+			// records pointing outside of their sections make the whole cache invalid
+			const auto outside = [&h](u64 offset, u64 count, u64 sectionSize) {
+				return offset > sectionSize || count > sectionSize - offset;
+			};
+			bool valid = !outside(a.PathOffset, a.PathLength, h.StringsSize) &&
+						 !outside(a.FirstEntry, a.EntryCount, h.EntryCount);
+			for (u32 j = 0; valid && j < a.EntryCount; ++j)
+			{
+				const IndexRawEntry e = LoadUnaligned<IndexRawEntry>(
+					mData.data() + layout.Entries + sizeof(IndexRawEntry) * (a.FirstEntry + j));
+				valid = !outside(e.PathOffset, e.PathLength, h.StringsSize);
+			}
+
+			if (!valid)
+			{
+				mMappedArchives.clear();
+				mData = {};
+				mMapped.reset();
+				return;
+			}
+
+			const std::string_view path{ reinterpret_cast<const char*>(mData.data()) +
+											 layout.Strings + a.PathOffset,
+										 a.PathLength };
+			mMappedArchives.emplace(path, i);
+		}
+	}
+}
+
+TEST_SUITE("IndexCache")
+{
+	using namespace noire;
+	using namespace noire::test;
+	namespace fs = std::filesystem;
+
+	TEST_CASE("Reopening uses the cached entries")
+	{
+		const TempDirectory temp{ "noire_index_cache_test" };
+		const fs::path root = temp.Path / "root";
+		const fs::path cachePath = temp.Path / "cache.idx";
+		fs::create_directories(root);
+
+		{
+			LocalDevice d{ root };
+			auto w = std::static_pointer_cast<WAD>(d.Create("/test.wad.pc", WAD::Type.Id));
+			WriteAll(*w->Create("/a.bin", File::Type.Id), "first file");
+			WriteAll(*w->Create("/dir/b.bin", File::Type.Id), "second file");
+			auto c = std::static_pointer_cast<Container>(
+				d.Create("/test.big.pc", Container::Type.Id));
+			WriteAll(*c->Create("/c.bin", File::Type.Id), "third file");
+			d.Commit();
+		}
+
+		{
+			LocalDevice d{ root };
+			d.EnableIndexCache(cachePath);
+			std::shared_ptr<File> w = d.Open("/test.wad.pc");
+			std::shared_ptr<File> c = d.Open("/test.big.pc");
+			CHECK_FALSE(w->IsLoaded());
+			w->Load();
+			c->Load();
+			d.SaveIndexCache();
+			CHECK_EQ(d.GetIndexCache()->ArchiveCount(), 2);
+		}
+
+		{
+			LocalDevice d{ root };
+			d.EnableIndexCache(cachePath);
+			auto w = std::dynamic_pointer_cast<WAD>(d.Open("/test.wad.pc"));
+			auto c = std::dynamic_pointer_cast<Container>(d.Open("/test.big.pc"));
+			REQUIRE(w != nullptr);
+			REQUIRE(c != nullptr);
+
+			// loaded from the cache, including the types of the entries
+			CHECK(w->IsLoaded());
+			CHECK(c->IsLoaded());
+			CHECK_EQ(w->GetEntries().size(), 2);
+			CHECK_EQ(w->GetEntry("/dir/b.bin").FileType, File::Type.Id);
+			CHECK_EQ(c->GetEntry(crc32("c.bin")).FileType, File::Type.Id);
+
+			CHECK_EQ(ReadAll(w->OpenStream("/dir/b.bin")), "second file");
+
+			// modified files are parsed again
+			WriteAll(*w->Open("/a.bin"), "first file, modified");
+			d.Commit();
+		}
+
+		{
+			LocalDevice d{ root };
+			d.EnableIndexCache(cachePath);
+			std::shared_ptr<File> w = d.Open("/test.wad.pc");
+			std::shared_ptr<File> c = d.Open("/test.big.pc");
+			CHECK_FALSE(w->IsLoaded());
+			CHECK(c->IsLoaded());
+			w->Load();
+			d.SaveIndexCache();
+		}
+
+		{
+			LocalDevice d{ root };
+			d.EnableIndexCache(cachePath);
+			d.EnableInPlaceCommit(true);
+			auto w = std::static_pointer_cast<WAD>(d.Open("/test.wad.pc"));
+			CHECK(w->IsLoaded());
+
+			// also when saved in place
+			WriteAll(*w->Open("/a.bin"), "FIRST FILE");
+			d.Commit();
+			CHECK_EQ(d.GetIndexCache()->ArchiveCount(), 1);
+		}
+
+		{
+			LocalDevice d{ root };
+			d.EnableIndexCache(cachePath);
+			std::shared_ptr<File> w = d.Open("/test.wad.pc");
+			CHECK_FALSE(w->IsLoaded());
+		}
+	}
+
+	TEST_CASE("Invalid cache files are ignored")
+	{
+		const TempDirectory temp{ "noire_index_cache_invalid_test" };
+		const fs::path cachePath = temp.Path / "cache.idx";
+		{
+			FileStream s{ cachePath };
+			const std::string garbage(100, 'x');
+			s.Write(garbage.data(), garbage.size());
+		}
+
+		IndexCache cache{ cachePath };
+		CHECK_EQ(cache.ArchiveCount(), 0);
+		cache.Store("a", IndexKey{ 1, 2, 3 }, IndexCache::Archive{ File::Type.Id, false, {} });
+		cache.Save();
+
+		IndexCache reopened{ cachePath };
+		CHECK_EQ(reopened.ArchiveCount(), 1);
+		CHECK(reopened.Find("a", IndexKey{ 1, 2, 3 }).has_value());
+		CHECK_FALSE(reopened.Find("a", IndexKey{ 1, 2, 4 }).has_value());
+		CHECK_FALSE(reopened.Find("b", IndexKey{ 1, 2, 3 }).has_value());
+	}
+}
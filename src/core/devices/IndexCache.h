@@ -0,0 +1,98 @@
+#pragma once
+#include "Common.h"
+#include "streams/MappedFileStream.h"
+#include <array>
+#include <filesystem>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+namespace noire
+{
+	// Entry of an archive as stored in an IndexCache. Each archive type decides what the fields
+	// mean, e.g. WAD stores the offset and size of the entry in the first two.
+	struct IndexEntry final
+	{
+		u32 NameHash;
+		std::array<u32, 4> Fields;
+		size FileType;         // InvalidTypeId if not detected yet
+		std::string_view Path; // without the root '/', may be empty if the type doesn't need it
+	};
+
+	// Identifies the contents of a file, the cached data of the file is only used while it
+	// matches
+	struct IndexKey final
+	{
+		u64 Size;
+		i64 ModifiedTime;
+		u32 HeaderChecksum; // of the first and last bytes of the file
+
+		bool operator==(const IndexKey& other) const
+		{
+			return Size == other.Size && ModifiedTime == other.ModifiedTime &&
+				   HeaderChecksum == other.HeaderChecksum;
+		}
+		bool operator!=(const IndexKey& other) const { return !(*this == other); }
+
+		static IndexKey Of(const std::filesystem::path& filePath);
+	};
+
+	// Types and entry tables of the files of a device, stored on disk so the files don't need to
+	// be detected and parsed again next time. The file is mapped into memory and the cached data
+	// is read from it as needed, it is only written when calling Save().
+	class IndexCache
+	{
+	public:
+		struct Archive final
+		{
+			size FileType;
+			bool HasEntries; // false if only the type of the file is known
+			std::vector<IndexEntry> Entries;
+		};
+
+		// Opens the cache stored at 'cachePath', it starts empty if the file doesn't exist or
+		// isn't valid.
+		IndexCache(std::filesystem::path cachePath);
+
+		IndexCache(const IndexCache&) = delete;
+		IndexCache(IndexCache&&) = delete;
+
+		IndexCache& operator=(const IndexCache&) = delete;
+		IndexCache& operator=(IndexCache&&) = delete;
+
+		// Returns the cached data of the file if its key still matches. The entry paths are valid
+		// until the file is stored again or Save() is called.
+		std::optional<Archive> Find(std::string_view filePath, const IndexKey& key) const;
+		// Replaces the cached data of the file, the entry paths are copied.
+		void Store(std::string_view filePath, const IndexKey& key, const Archive& archive);
+		void Remove(std::string_view filePath);
+		// Writes all the cached data to the cache file, replacing it.
+		void Save();
+
+		size ArchiveCount() const;
+		const std::filesystem::path& Path() const { return mPath; }
+
+	private:
+		struct StoredArchive
+		{
+			IndexKey Key;
+			Archive Data;
+			std::vector<std::string> Paths; // storage of the entry paths
+		};
+
+		void Map();
+
+		std::filesystem::path mPath;
+		std::optional<MappedFileStream> mMapped;
+		gsl::span<const byte> mData;
+		std::unordered_map<std::string_view, u32> mMappedArchives; // path -> record index
+		// archives stored since the file was mapped, nullopt if removed
+		std::unordered_map<std::string, std::optional<StoredArchive>> mStoredArchives;
+
+	public:
+		static constexpr u32 HeaderMagic{ 0x5844494E }; // NIDX
+		static constexpr u32 Version{ 1 };
+	};
+}
@@ -1,22 +1,33 @@
 #include "LocalDevice.h"
+#include "IndexCache.h"
 #include "files/File.h"
 #include "files/WAD.h"
 #include "streams/FileStream.h"
+#include "streams/MappedFileStream.h"
 #include <algorithm>
 #include <doctest/doctest.h>
+#include <exception>
 #include <functional>
 #include <iostream>
 #include <string>
+#include <system_error>
 
 namespace noire
 {
 	namespace fs = std::filesystem;
 
-	LocalDevice::LocalDevice(const fs::path& rootPath) : mRootPath{ fs::absolute(rootPath) }
+	LocalDevice::LocalDevice(const fs::path& rootPath)
+		: mRootPath{ fs::absolute(rootPath) },
+		  mCachedFiles{},
+		  mFileMappingEnabled{ false },
+		  mInPlaceCommitEnabled{ false },
+		  mIndexCache{ nullptr }
 	{
 		Expects(fs::is_directory(mRootPath));
 	}
 
+	LocalDevice::~LocalDevice() = default;
+
 	bool LocalDevice::Exists(PathView path) const
 	{
 		Expects(path.IsAbsolute());
@@ -39,8 +50,12 @@ namespace noire
 			}
 			else
 			{
-				FileStream f{ FullPath(path) };
-				file = File::New(*this, path, false, File::FindTypeOfStream(f));
+				file = mIndexCache ? OpenFromIndex(path) : nullptr;
+				if (!file)
+				{
+					ReadOnlyStream s = OpenStream(path);
+					file = File::New(*this, path, false, File::FindTypeOfStream(s));
+				}
 				mCachedFiles.try_emplace(h, file);
 			}
 
@@ -102,20 +117,119 @@ namespace noire
 	{
 		Expects(path.IsFile() && path.IsAbsolute());
 
-		return ReadOnlyStream{ std::make_unique<FileStream>(FullPath(path)) };
+		fs::path fullPath = FullPath(path);
+		std::error_code ec;
+		if (mFileMappingEnabled && fs::file_size(fullPath, ec) <= MappedFileStream::MaxMappedSize &&
+			!ec)
+		{
+			return ReadOnlyStream{ std::make_unique<MappedFileStream>(std::move(fullPath)) };
+		}
+
+		return ReadOnlyStream{ std::make_unique<FileStream>(std::move(fullPath)) };
 	}
 
 	void LocalDevice::Commit()
 	{
+		std::exception_ptr error{};
 		for (auto& e : mCachedFiles)
 		{
 			if (auto f = e.second; f->HasChanged())
 			{
-				f->Save();
-				FileStream fs{ FullPath(f->Path()) };
-				f->Raw().CopyTo(fs);
+				const fs::path fullPath = FullPath(f->Path());
+				bool savedInPlace = false;
+				if (mInPlaceCommitEnabled && fs::is_regular_file(fullPath))
+				{
+					FileStream target{ fullPath };
+					savedInPlace = f->SaveInPlace(target);
+				}
+
+				if (!savedInPlace)
+				{
+					// the file is read while saving, so write to a temporary file next to it and
+					// replace the original once the new one is complete
+					fs::path tempPath = fullPath;
+					tempPath += ".tmp";
+					fs::remove(tempPath);
+					try
+					{
+						FileStream output{ tempPath };
+						f->SaveTo(output);
+					}
+					catch (...)
+					{
+						// the original is left as it is, the other files are still committed
+						std::error_code ec;
+						fs::remove(tempPath, ec);
+						if (!error)
+						{
+							error = std::current_exception();
+						}
+						continue;
+					}
+
+					// releases the streams of the original file before replacing it
+					f->OnSaved();
+					fs::rename(tempPath, fullPath);
+				}
+
+				if (mIndexCache)
+				{
+					mIndexCache->Remove(f->Path().String().substr(1));
+				}
 			}
 		}
+
+		if (error)
+		{
+			std::rethrow_exception(error);
+		}
+	}
+
+	void LocalDevice::EnableIndexCache(const fs::path& cachePath)
+	{
+		mIndexCache = std::make_unique<IndexCache>(cachePath);
+	}
+
+	void LocalDevice::SaveIndexCache()
+	{
+		Expects(mIndexCache != nullptr);
+
+		std::vector<IndexEntry> entries{};
+		for (auto& e : mCachedFiles)
+		{
+			std::shared_ptr<File> f = e.second;
+			const fs::path fullPath = FullPath(f->Path());
+			if (f->HasChanged() || !fs::is_regular_file(fullPath))
+			{
+				continue;
+			}
+
+			entries.clear();
+			const bool hasEntries = f->GetIndexEntries(entries);
+			mIndexCache->Store(f->Path().String().substr(1),
+							   IndexKey::Of(fullPath),
+							   IndexCache::Archive{ f->TypeId(), hasEntries, entries });
+		}
+
+		mIndexCache->Save();
+	}
+
+	// Returns nullptr if the file is not in the index cache or it changed since
+	std::shared_ptr<File> LocalDevice::OpenFromIndex(PathView path)
+	{
+		const std::optional<IndexCache::Archive> a =
+			mIndexCache->Find(path.String().substr(1), IndexKey::Of(FullPath(path)));
+		if (!a || a->FileType == File::InvalidTypeId)
+		{
+			return nullptr;
+		}
+
+		std::shared_ptr<File> file = File::New(*this, path, false, a->FileType);
+		if (a->HasEntries)
+		{
+			file->LoadFromIndex(a->Entries);
+		}
+		return file;
 	}
 
 	fs::path LocalDevice::FullPath(PathView path) const
@@ -175,8 +289,6 @@ TEST_SUITE("LocalDevice")
 		const std::string str{ "hello world" };
 		r->Raw().Write(str.data(), str.size());
 
-		r->Save();
-
 		d.Commit();
 	}
 }
@@ -8,10 +8,13 @@
 
 namespace noire
 {
+	class IndexCache;
+
 	class LocalDevice : public Device
 	{
 	public:
 		LocalDevice(const std::filesystem::path& rootPath);
+		~LocalDevice() override;
 
 		bool Exists(PathView path) const override;
 		std::shared_ptr<File> Open(PathView path) override;
@@ -22,14 +25,40 @@ namespace noire
 				   PathView path,
 				   bool recursive) override;
 		ReadOnlyStream OpenStream(PathView path) override;
+		/// Saves the files that changed. If saving a file throws, its temporary file is removed
+		/// and the original left as it is, the other files are still saved and the first
+		/// exception is rethrown at the end.
 		void Commit() override;
 
 		inline const std::filesystem::path& RootPath() const { return mRootPath; }
 
+		/// Whether OpenStream maps the files into memory instead of reading them through system
+		/// calls. Disabled by default.
+		bool IsFileMappingEnabled() const { return mFileMappingEnabled; }
+		void EnableFileMapping(bool enable) { mFileMappingEnabled = enable; }
+
+		/// Whether Commit writes only the changes to the existing files when the file type
+		/// supports it (see File::SaveInPlace), instead of writing a new file and replacing the
+		/// original. Disabled by default.
+		bool IsInPlaceCommitEnabled() const { return mInPlaceCommitEnabled; }
+		void EnableInPlaceCommit(bool enable) { mInPlaceCommitEnabled = enable; }
+
+		/// Uses the IndexCache stored at 'cachePath': Open gets the types of the files from it and
+		/// loads the archives from their cached entry tables if they didn't change. Disabled by
+		/// default.
+		void EnableIndexCache(const std::filesystem::path& cachePath);
+		IndexCache* GetIndexCache() const { return mIndexCache.get(); }
+		/// Stores the files opened so far in the index cache and writes it to disk.
+		void SaveIndexCache();
+
 	private:
 		std::filesystem::path FullPath(PathView path) const;
+		std::shared_ptr<File> OpenFromIndex(PathView path);
 
 		std::filesystem::path mRootPath;
 		std::unordered_map<size, std::shared_ptr<File>> mCachedFiles;
+		bool mFileMappingEnabled;
+		bool mInPlaceCommitEnabled;
+		std::unique_ptr<IndexCache> mIndexCache;
 	};
 }
\ No newline at end of file
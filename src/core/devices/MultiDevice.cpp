@@ -1,5 +1,5 @@
 #include "MultiDevice.h"
-#include <algorithm>
+#include <doctest/doctest.h>
 #include <string_view>
 
 namespace noire
@@ -83,42 +83,86 @@ namespace noire
 
 	void MultiDevice::Mount(PathView path, std::shared_ptr<Device> device)
 	{
-		Expects(std::find_if(mMounts.begin(), mMounts.end(), [path](const MountPoint& m) {
-					return m.Path == path;
-				}) == mMounts.end());
+		Expects(path.IsDirectory() && path.IsAbsolute());
 
-		mMounts.emplace_back(path, device);
+		if (mMountNodes.empty())
+		{
+			mMountNodes.emplace_back();
+		}
 
-		// sort the mounts, longest paths first
-		std::sort(mMounts.begin(), mMounts.end(), [](auto& a, auto& b) {
-			return a.Path.String().size() > b.Path.String().size();
-		});
-	}
+		size node = 0;
+		std::string_view rest = path.String().substr(1);
+		while (!rest.empty())
+		{
+			const size nameLength = rest.find(Path::DirectorySeparator);
+			const std::string_view name = rest.substr(0, nameLength);
+			rest.remove_prefix(nameLength + 1);
 
-	static bool StartsWith(std::string_view str, std::string_view prefix)
-	{
-		return str.compare(0, prefix.size(), prefix) == 0;
+			auto& children = mMountNodes[node].Children;
+			if (auto it = children.find(name); it != children.end())
+			{
+				node = it->second;
+			}
+			else
+			{
+				const size child = mMountNodes.size();
+				children.emplace(std::string{ name }, child);
+				mMountNodes.emplace_back();
+				node = child;
+			}
+		}
+
+		Expects(mMountNodes[node].Mount == NoMount); // path is not mounted yet
+
+		mMountNodes[node].Mount = mMounts.size();
+		mMounts.emplace_back(path, device);
 	}
 
 	Device*
 	MultiDevice::GetDevice(PathView path, PathView* outRelPath, PathView* outDeviceMountPath) const
 	{
-		for (const MountPoint& m : mMounts)
+		// follow the directories of the path, keeping the deepest mount found
+		size mount = NoMount;
+		if (!mMountNodes.empty() && !path.IsEmpty() && path.IsAbsolute())
 		{
-			if (StartsWith(path.String(), m.Path.String()))
+			size node = 0;
+			mount = mMountNodes[node].Mount;
+
+			std::string_view rest = path.String().substr(1);
+			for (size nameLength = rest.find(Path::DirectorySeparator);
+				 nameLength != std::string_view::npos;
+				 nameLength = rest.find(Path::DirectorySeparator))
 			{
-				if (outRelPath)
+				const auto& children = mMountNodes[node].Children;
+				auto it = children.find(rest.substr(0, nameLength));
+				if (it == children.end())
 				{
-					*outRelPath = path.String().substr(m.Path.String().size() - 1);
+					break;
 				}
 
-				if (outDeviceMountPath)
+				node = it->second;
+				if (mMountNodes[node].Mount != NoMount)
 				{
-					*outDeviceMountPath = m.Path;
+					mount = mMountNodes[node].Mount;
 				}
+				rest.remove_prefix(nameLength + 1);
+			}
+		}
+
+		if (mount != NoMount)
+		{
+			const MountPoint& m = mMounts[mount];
+			if (outRelPath)
+			{
+				*outRelPath = path.String().substr(m.Path.String().size() - 1);
+			}
 
-				return m.Device.get();
+			if (outDeviceMountPath)
+			{
+				*outDeviceMountPath = m.Path;
 			}
+
+			return m.Device.get();
 		}
 
 		if (outRelPath)
@@ -134,3 +178,45 @@ namespace noire
 		return nullptr;
 	}
 }
+
+TEST_SUITE("MultiDevice")
+{
+	using namespace noire;
+
+	TEST_CASE("Paths resolve to the deepest mount")
+	{
+		auto root = std::make_shared<MultiDevice>();
+		auto a = std::make_shared<MultiDevice>();
+		auto ab = std::make_shared<MultiDevice>();
+		auto c = std::make_shared<MultiDevice>();
+
+		MultiDevice d{};
+		CHECK_EQ(d.GetDevice("/a/file"), nullptr);
+
+		d.Mount("/a/b/", ab);
+		d.Mount("/", root);
+		d.Mount("/a/", a);
+		d.Mount("/a/b/c/d/", c);
+
+		PathView relPath, mountPath;
+		CHECK_EQ(d.GetDevice("/file", &relPath, &mountPath), root.get());
+		CHECK_EQ(relPath, PathView{ "/file" });
+		CHECK_EQ(mountPath, PathView{ "/" });
+
+		CHECK_EQ(d.GetDevice("/a/b", &relPath, &mountPath), a.get());
+		CHECK_EQ(relPath, PathView{ "/b" });
+		CHECK_EQ(mountPath, PathView{ "/a/" });
+
+		CHECK_EQ(d.GetDevice("/a/b/", &relPath, &mountPath), ab.get());
+		CHECK_EQ(relPath, PathView{ "/" });
+		CHECK_EQ(mountPath, PathView{ "/a/b/" });
+
+		CHECK_EQ(d.GetDevice("/a/b/c/file", &relPath), ab.get());
+		CHECK_EQ(relPath, PathView{ "/c/file" });
+
+		CHECK_EQ(d.GetDevice("/a/b/c/d/e/file", &relPath), c.get());
+		CHECK_EQ(relPath, PathView{ "/e/file" });
+
+		CHECK_EQ(d.GetDevice("/ab/file"), root.get());
+	}
+}
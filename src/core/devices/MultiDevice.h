@@ -1,7 +1,10 @@
 #pragma once
 #include "Device.h"
 #include "Path.h"
+#include <functional>
+#include <map>
 #include <memory>
+#include <string>
 #include <vector>
 
 namespace noire
@@ -11,8 +14,8 @@ namespace noire
 	public:
 		struct MountPoint
 		{
-			Path Path;
-			std::shared_ptr<Device> Device;
+			noire::Path Path;
+			std::shared_ptr<noire::Device> Device;
 
 			inline MountPoint(PathView path, std::shared_ptr<noire::Device> device)
 				: Path{ path }, Device{ device }
@@ -34,11 +37,23 @@ namespace noire
 		void Mount(PathView path, std::shared_ptr<Device> device);
 		/// Gets the device that contains the specified path or null if none exists.
 		/// 'outRelPath': returns the 'path' relative to the device mount path.
+		/// The mount with the longest path is used, found in O(path depth) with a trie of the
+		/// mount paths.
 		Device* GetDevice(PathView path,
 						  PathView* outRelPath = nullptr,
 						  PathView* outDeviceMountPath = nullptr) const;
 
 	private:
+		static constexpr size NoMount{ ~size{ 0 } };
+
+		// Node of the mount paths trie, one per directory in the mount paths
+		struct MountNode
+		{
+			std::map<std::string, size, std::less<>> Children; // name -> index in mMountNodes
+			size Mount{ NoMount };                             // index in mMounts
+		};
+
 		std::vector<MountPoint> mMounts;
+		std::vector<MountNode> mMountNodes; // the first one is the root directory
 	};
 }
\ No newline at end of file
@@ -1,19 +1,56 @@
 #include "Container.h"
 #include "Hash.h"
+#include "ThreadPool.h"
+#include "devices/IndexCache.h"
 #include "devices/LocalDevice.h"
 #include "streams/FileStream.h"
+#include "streams/MemoryStream.h"
+#include "streams/SgesStream.h"
 #include "streams/Stream.h"
+#include "tests/TestUtil.h"
+#include <algorithm>
+#include <array>
+#include <cinttypes>
+#include <cstdio>
+#include <cstring>
 #include <doctest/doctest.h>
+#include <exception>
+#include <filesystem>
 #include <iostream>
+#include <limits>
+#include <mutex>
+#include <optional>
 #include <string_view>
+#include <type_traits>
+#include <vector>
 
 namespace noire
 {
-	Container::Container(Device& parent, PathView path, bool created) : File(parent, path, created)
+	// Entry as stored in the file
+	struct ContainerRawEntry
+	{
+		u32 NameHash;
+		u32 Unk1;
+		u32 Unk2;
+		u32 Unk3;
+		u32 Unk4;
+	};
+	static_assert(sizeof(ContainerRawEntry) == 20 &&
+				  std::is_trivially_copyable_v<ContainerRawEntry>);
+
+	Container::Container(Device& parent, PathView path, bool created)
+		: File(parent, path, created),
+		  mEntries{},
+		  mEntryIndex{},
+		  mVFS{},
+		  mHasChanged{ created },
+		  mEntriesChanged{ false },
+		  mLayoutDirty{ true },
+		  mNewSize{ 0 },
+		  mSgesDecompressionEnabled{ false }
 	{
 	}
 
-	// Device implementation (TODO)
 	bool Container::Exists(PathView path) const
 	{
 		Expects(path.IsAbsolute());
@@ -25,23 +62,49 @@ namespace noire
 	{
 		Expects(path.IsFile() && path.IsAbsolute());
 
-		return mVFS.Open(path, [this](PathView, size pathHash) { return GetEntry(pathHash).File; });
+		return mVFS.Open(path, [this](PathView, size pathHash) {
+			return EntryFile(mEntries[GetEntryIndex(pathHash)]);
+		});
 	}
 
 	std::shared_ptr<File> Container::Create(PathView path, size fileTypeId)
 	{
-		// TODO: Container::Create
 		Expects(path.IsFile() && path.IsAbsolute());
-		Expects(false && "Not implemented");
-		(void)fileTypeId;
-		return nullptr;
+
+		const u32 newIndex = gsl::narrow<u32>(mEntries.size());
+		ContainerEntry& newEntry = mEntries.emplace_back();
+		newEntry.FileType = fileTypeId;
+		newEntry.File =
+			mVFS.Create(*this, path, fileTypeId, [this, &newEntry, newIndex](PathView path) {
+				// only the hash of the name is stored, without the first '/'. Names of unknown
+				// hashes ('?#XXXXXXXX#?') map back to the same hash
+				newEntry.NameHash = HashLookup::Instance().GetHash(path.String().substr(1));
+				Expects(mEntryIndex.Find(newEntry.NameHash) == HashIndex::NotFound);
+				mEntryIndex.Insert(newEntry.NameHash, newIndex);
+				return newEntry.NameHash;
+			});
+		InvalidateLayout();
+		mHasChanged = true;
+
+		return newEntry.File;
 	}
 
 	bool Container::Delete(PathView path)
 	{
-		// TODO: Container::Delete
 		Expects(path.IsFile() && path.IsAbsolute());
-		Expects(false && "Not implemented");
+
+		if (mVFS.Exists(path))
+		{
+			const size index = GetEntryIndex(path);
+			mEntries.erase(mEntries.begin() + index);
+			// the indices of the following entries changed
+			RebuildEntryIndex();
+			mVFS.Delete(path);
+			InvalidateLayout();
+			mHasChanged = true;
+			return true;
+		}
+
 		return false;
 	}
 
@@ -53,13 +116,12 @@ namespace noire
 		mVFS.Visit(visitDirectory, visitFile, path, recursive);
 	}
 
-	ReadOnlyStream Container::OpenStream(PathView path)
+	ReadOnlyStream Container::OpenStream(PathView path) { return EntryStream(GetEntry(path)); }
+
+	void Container::OnFileChanged(File&)
 	{
-		const ContainerEntry& e = GetEntry(path);
-		const bool newEntry = e.Offset() == 0 && e.Size() == 0;
-		return newEntry ?
-				   ReadOnlyStream{ std::make_unique<EmptyStream>() } :
-				   ReadOnlyStream{ std::make_unique<SubStream>(Raw(), e.Offset(), e.Size()) };
+		InvalidateLayout();
+		mEntriesChanged = true;
 	}
 
 	// File implementation
@@ -71,73 +133,341 @@ namespace noire
 			return;
 		}
 
-		s.Seek(0, StreamSeekOrigin::Begin);
-
 		const u64 streamSize = s.Size();
-		const i64 pos = streamSize - 4;
-
-		s.Seek(pos, StreamSeekOrigin::Begin);
+		Expects(streamSize >= sizeof(u32));
 
-		const u32 entriesOffset = s.Read<u32>();
-		const i64 entriesPos = streamSize - entriesOffset;
+		const u32 entriesOffset = s.ReadAt<u32>(streamSize - sizeof(u32));
+		Expects(entriesOffset <= streamSize);
+		const u64 entriesPos = streamSize - entriesOffset;
 
-		s.Seek(entriesPos, StreamSeekOrigin::Begin);
-		const u32 magic = s.Read<u32>();
+		const u32 magic = s.ReadAt<u32>(entriesPos);
 		Expects(magic == EntriesHeaderMagic);
 
-		const u32 entryCount = s.Read<u32>();
+		const u32 entryCount = s.ReadAt<u32>(entriesPos + sizeof(u32));
 		mEntries.reserve(entryCount);
+		mEntryIndex.Reserve(entryCount);
+
+		// read entries
+		std::vector<byte> buffer{};
+		const u64 entriesSize = sizeof(ContainerRawEntry) * entryCount;
+		const gsl::span<const byte> entries =
+			s.ReadContiguous(entriesPos + sizeof(u32) * 2, entriesSize, buffer);
+		Expects(gsl::narrow<u64>(entries.size()) == entriesSize);
+
 		for (size i = 0; i < entryCount; ++i)
 		{
-			const u32 nameHash = s.Read<u32>();
-			const u32 unk1 = s.Read<u32>();
-			const u32 unk2 = s.Read<u32>();
-			const u32 unk3 = s.Read<u32>();
-			const u32 unk4 = s.Read<u32>();
+			const ContainerRawEntry r =
+				LoadUnaligned<ContainerRawEntry>(entries.data() + i * sizeof(ContainerRawEntry));
+			const u32 nameHash = r.NameHash;
 
-			ContainerEntry& e = mEntries.emplace_back(nameHash, unk1, unk2, unk3, unk4);
+			mEntryIndex.Insert(nameHash, gsl::narrow<u32>(mEntries.size()));
+			mEntries.emplace_back(nameHash, r.Unk1, r.Unk2, r.Unk3, r.Unk4);
 
-			const noire::Path filePath = Path::Root / HashLookup::Instance().TryGetString(nameHash);
-			mVFS.RegisterExistingFile(filePath, nameHash);
-
-			SubStream entryStream{ Raw(), e.Offset(), e.Size() };
-			e.File = File::New(*this, filePath, false, File::FindTypeOfStream(entryStream));
+			// the type and File of the entry are created once needed, see EntryFile
+			mVFS.RegisterExistingFile(Path::Root / HashLookup::Instance().TryGetString(nameHash),
+									  nameHash);
 		}
 	}
 
-	void Container::Save()
+	bool Container::LoadFromIndexImpl(gsl::span<const IndexEntry> entries)
 	{
-		// TODO: Container::Save
-		Expects(false && "Not implemented");
+		mEntries.reserve(entries.size());
+		mEntryIndex.Reserve(entries.size());
+		for (const IndexEntry& i : entries)
+		{
+			mEntryIndex.Insert(i.NameHash, gsl::narrow<u32>(mEntries.size()));
+			ContainerEntry& e = mEntries.emplace_back(
+				i.NameHash, i.Fields[0], i.Fields[1], i.Fields[2], i.Fields[3]);
+			e.FileType = i.FileType;
+
+			// names are not stored, the hash lookup may know more of them than when cached
+			mVFS.RegisterExistingFile(Path::Root / HashLookup::Instance().TryGetString(e.NameHash),
+									  e.NameHash);
+		}
+
+		return true;
 	}
 
+	// An entry is written from its File if it changed, otherwise its original data is copied
+	static bool UsesEntryFile(const ContainerEntry& e) { return e.File && e.File->HasChanged(); }
+
 	static u64 SizeAligned(u64 s)
 	{
-		constexpr u64 Alignment{ 0x1000 };
+		const u64 r = s % Container::PayloadAlignment;
+		return r ? (s + (Container::PayloadAlignment - r)) : s;
+	}
 
-		u64 r = s % Alignment;
-		u64 a = r ? (s + (Alignment - r)) : s;
-		return a;
+	// Magic, entry count, entries and the distance from the table to the end of the file
+	static u64 EntryTableSize(size entryCount)
+	{
+		return sizeof(u32) * 2 + sizeof(ContainerRawEntry) * entryCount + sizeof(u32);
 	}
 
-	u64 Container::Size()
+	// Entry as written by SaveTo, with the offset and size computed by FixUpOffsets
+	static ContainerRawEntry NewRawEntry(const ContainerEntry& e)
+	{
+		constexpr u32 SizeMask{ 0x7FFFFFFF };
+
+		Expects((e.NewOffset & 0xF) == 0);
+		const u32 offset = gsl::narrow<u32>(e.NewOffset >> 4);
+		ContainerRawEntry r{ e.NameHash, offset, e.Unk2, e.Unk3, e.Unk4 };
+		if (e.NewSize == e.Size())
+		{
+			return r;
+		}
+
+		if (e.Unk4 != 0)
+		{
+			// 'sges' chunks store the whole size in Unk4, Unk2/Unk3 are cleared in case it is 0
+			// since the size is read from them then
+			r.Unk4 = gsl::narrow<u32>(e.NewSize);
+			if (e.NewSize == 0)
+			{
+				r.Unk2 &= ~SizeMask;
+				r.Unk3 &= ~SizeMask;
+			}
+		}
+		else
+		{
+			// 'trM#' chunks split the size between Unk2 and Unk3, what each part means is not
+			// known yet so they are not resized. New entries only use Unk2.
+			Expects((e.Unk3 & SizeMask) == 0 && "Resizing 'trM#' entries is not supported");
+			Expects(e.NewSize <= SizeMask);
+			r.Unk2 = (e.Unk2 & ~SizeMask) | static_cast<u32>(e.NewSize);
+		}
+		return r;
+	}
+
+	// Writes the data of a single entry at its offset in the output. Only positional writes are
+	// issued, so several entries can be written to the same output at the same time.
+	class EntryOutputStream final : public Stream
+	{
+	public:
+		EntryOutputStream(Stream& output, u64 offset)
+			: mOutput{ output }, mOffset{ offset }, mSize{ 0 }, mPosition{ 0 }
+		{
+		}
+
+		// write only
+		u64 Read(void*, u64) override { return 0; }
+		u64 ReadAt(void*, u64, u64) override { return 0; }
+
+		u64 Write(const void* buffer, u64 count) override
+		{
+			const u64 written = WriteAt(buffer, count, mPosition);
+			mPosition += written;
+			return written;
+		}
+
+		u64 WriteAt(const void* buffer, u64 count, u64 offset) override
+		{
+			const u64 written = mOutput.WriteAt(buffer, count, mOffset + offset);
+			mSize = std::max(mSize, offset + written);
+			return written;
+		}
+
+		u64 Seek(i64 offset, StreamSeekOrigin origin) override
+		{
+			switch (origin)
+			{
+			case StreamSeekOrigin::Begin: break;
+			case StreamSeekOrigin::Current: offset += mPosition; break;
+			case StreamSeekOrigin::End: offset += mSize; break;
+			default: Expects(false);
+			}
+
+			mPosition = gsl::narrow<u64>(offset);
+			return mPosition;
+		}
+
+		u64 Tell() override { return mPosition; }
+
+		u64 Size() override { return mSize; }
+
+	private:
+		Stream& mOutput;
+		u64 mOffset;
+		u64 mSize;
+		u64 mPosition;
+	};
+
+	// Writes the data of the entry followed by the padding up to the next entry
+	static void WriteEntry(Stream& raw, const ContainerEntry& e, Stream& output, u64 baseOffset)
+	{
+		static constexpr std::array<byte, Container::PayloadAlignment> Padding{};
+
+		EntryOutputStream entryOutput{ output, baseOffset + e.NewOffset };
+		if (UsesEntryFile(e))
+		{
+			e.File->SaveTo(entryOutput);
+		}
+		else if (e.NewSize != 0)
+		{
+			SubStream{ raw, e.Offset(), e.NewSize }.CopyTo(entryOutput);
+		}
+		Ensures(entryOutput.Size() == e.NewSize);
+
+		if (const u64 padding = SizeAligned(e.NewSize) - e.NewSize; padding != 0)
+		{
+			entryOutput.WriteAt(Padding.data(), padding, e.NewSize);
+		}
+	}
+
+	void Container::SaveTo(Stream& output)
 	{
-		size total = 0;
-		total += sizeof(u32);                       // entries offset
-		total += sizeof(u32);                       // magic
-		total += sizeof(u32);                       // entry count
-		total += sizeof(u32) * 5 * mEntries.size(); // entries
+		if (!HasChanged())
+		{
+			File::SaveTo(output);
+			return;
+		}
+
+		if (mLayoutDirty)
+		{
+			FixUpOffsets();
+		}
+
+		// offsets are relative to the beginning of the container, which may not be the beginning
+		// of the output if this container is inside another file
+		const u64 baseOffset = output.Tell();
+		Stream& s = Raw();
+		s.Size(); // opens the input stream before it is read from several threads
+
+		// entries that cannot be saved are refused before anything is written. The File of an
+		// 'sges' entry has the decompressed data, the entry would be written decompressed while
+		// the game expects it compressed, so it is refused until the data can be compressed again.
 		for (const ContainerEntry& e : mEntries)
 		{
-			u64 s = e.Size();
-			if (!(e.Unk1 & 0xF)) // TODO: how to determine if the entry is aligned? can't calculate
-								 // the correct size otherwise
+			if (mSgesDecompressionEnabled && UsesEntryFile(e) && e.Unk4 != 0 && e.Size() != 0)
+			{
+				SubStream data{ s, e.Offset(), e.Size() };
+				Expects(!SgesStream::IsValid(data) && "Modified 'sges' entries cannot be saved");
+			}
+
+			NewRawEntry(e);
+		}
+
+		// FileStream writes are positional system calls, other streams are written from this
+		// thread only
+		if (mEntries.size() > 1 && dynamic_cast<FileStream*>(&output))
+		{
+			std::mutex errorMutex{};
+			std::exception_ptr error{};
+			{
+				ThreadPool pool{};
+				for (const ContainerEntry& e : mEntries)
+				{
+					pool.Submit([&, entry = &e]() {
+						try
+						{
+							WriteEntry(s, *entry, output, baseOffset);
+						}
+						catch (...)
+						{
+							std::lock_guard<std::mutex> lock{ errorMutex };
+							if (!error)
+							{
+								error = std::current_exception();
+							}
+						}
+					});
+				}
+				pool.Wait();
+			}
+
+			if (error)
 			{
-				s = SizeAligned(s);
+				std::rethrow_exception(error);
 			}
-			total += gsl::narrow<u32>(s); // entry data
 		}
-		return total;
+		else
+		{
+			for (const ContainerEntry& e : mEntries)
+			{
+				WriteEntry(s, e, output, baseOffset);
+			}
+		}
+
+		// entry table
+		const u32 entryCount = gsl::narrow<u32>(mEntries.size());
+		const u32 tableSize = gsl::narrow<u32>(EntryTableSize(entryCount));
+		std::vector<byte> table(tableSize);
+		std::memcpy(table.data(), &EntriesHeaderMagic, sizeof(u32));
+		std::memcpy(table.data() + sizeof(u32), &entryCount, sizeof(u32));
+		for (size i = 0; i < entryCount; ++i)
+		{
+			const ContainerRawEntry r = NewRawEntry(mEntries[i]);
+			std::memcpy(
+				table.data() + sizeof(u32) * 2 + i * sizeof(ContainerRawEntry), &r, sizeof(r));
+		}
+		std::memcpy(table.data() + tableSize - sizeof(u32), &tableSize, sizeof(u32));
+
+		output.Seek(gsl::narrow<i64>(baseOffset + mNewSize - tableSize), StreamSeekOrigin::Begin);
+		output.Write(table.data(), table.size());
+		Ensures(output.Tell() - baseOffset == mNewSize);
+	}
+
+	void Container::OnSaved()
+	{
+		// the new offsets computed by SaveTo only exist if the container was rewritten,
+		// otherwise the data was copied as-is
+		const bool changed = HasChanged();
+		for (ContainerEntry& e : mEntries)
+		{
+			if (e.File)
+			{
+				e.File->OnSaved();
+			}
+
+			if (changed)
+			{
+				const ContainerRawEntry r = NewRawEntry(e);
+				e.Unk1 = r.Unk1;
+				e.Unk2 = r.Unk2;
+				e.Unk3 = r.Unk3;
+				e.Unk4 = r.Unk4;
+			}
+			e.NewOffset = 0;
+			e.NewSize = 0;
+		}
+
+		mHasChanged = false;
+		mEntriesChanged = false;
+		mLayoutDirty = true;
+		File::OnSaved();
+	}
+
+	u64 Container::Size()
+	{
+		// unchanged containers are copied as they are
+		if (!HasChanged())
+		{
+			return Raw().Size();
+		}
+
+		if (mLayoutDirty)
+		{
+			FixUpOffsets();
+		}
+		return mNewSize;
+	}
+
+	bool Container::HasChanged() const { return mHasChanged || mEntriesChanged; }
+
+	bool Container::GetIndexEntries(std::vector<IndexEntry>& entries)
+	{
+		if (!IsLoaded() || HasChanged())
+		{
+			return false;
+		}
+
+		DetectFileTypes();
+		entries.reserve(entries.size() + mEntries.size());
+		for (const ContainerEntry& e : mEntries)
+		{
+			entries.push_back(
+				IndexEntry{ e.NameHash, { e.Unk1, e.Unk2, e.Unk3, e.Unk4 }, e.FileType, {} });
+		}
+		return true;
 	}
 
 	size Container::GetEntryIndex(PathView path) const
@@ -148,16 +478,13 @@ namespace noire
 
 	size Container::GetEntryIndex(size nameHash) const
 	{
-		// TODO: don't use linear search here
-		for (size i = 0; i < mEntries.size(); ++i)
+		if (nameHash > std::numeric_limits<u32>::max())
 		{
-			if (mEntries[i].NameHash == nameHash)
-			{
-				return i;
-			}
+			return static_cast<size>(-1);
 		}
 
-		return static_cast<size>(-1);
+		const u32 index = mEntryIndex.Find(static_cast<u32>(nameHash));
+		return index != HashIndex::NotFound ? index : static_cast<size>(-1);
 	}
 
 	const ContainerEntry& Container::GetEntry(PathView path) const
@@ -174,6 +501,114 @@ namespace noire
 		return mEntries[index];
 	}
 
+	size Container::GetEntryFileType(PathView path)
+	{
+		return EntryFileType(mEntries[GetEntryIndex(path)]);
+	}
+
+	void Container::DetectFileTypes()
+	{
+		// read the entries in file order, the entry table is not sorted by offset
+		std::vector<ContainerEntry*> entries{};
+		entries.reserve(mEntries.size());
+		for (ContainerEntry& e : mEntries)
+		{
+			if (e.FileType == File::InvalidTypeId)
+			{
+				entries.emplace_back(&e);
+			}
+		}
+
+		std::sort(entries.begin(), entries.end(), [](ContainerEntry* a, ContainerEntry* b) {
+			return a->Offset() < b->Offset();
+		});
+
+		for (ContainerEntry* e : entries)
+		{
+			EntryFileType(*e);
+		}
+	}
+
+	size Container::EntryFileType(ContainerEntry& e)
+	{
+		if (e.FileType == File::InvalidTypeId)
+		{
+			ReadOnlyStream entryStream = EntryStream(e);
+			e.FileType = File::FindTypeOfStream(entryStream);
+		}
+
+		return e.FileType;
+	}
+
+	// With 'sges' decompression enabled, 'sges' entries are decompressed as they are read. The
+	// other entries and the ones whose 'sges' header doesn't decode are read as they are.
+	ReadOnlyStream Container::EntryStream(const ContainerEntry& e)
+	{
+		const bool newEntry = e.Offset() == 0 && e.Size() == 0;
+		if (newEntry)
+		{
+			return ReadOnlyStream{ std::make_unique<EmptyStream>() };
+		}
+
+		auto raw = std::make_unique<SubStream>(Raw(), e.Offset(), e.Size());
+		if (mSgesDecompressionEnabled && e.Unk4 != 0 && SgesStream::IsValid(*raw))
+		{
+			return ReadOnlyStream{ std::make_unique<SgesStream>(ReadOnlyStream{ std::move(raw) }) };
+		}
+		return ReadOnlyStream{ std::move(raw) };
+	}
+
+	std::shared_ptr<File> Container::EntryFile(ContainerEntry& e)
+	{
+		if (!e.File)
+		{
+			const noire::Path filePath =
+				Path::Root / HashLookup::Instance().TryGetString(e.NameHash);
+			e.File = File::New(*this, filePath, false, EntryFileType(e));
+		}
+
+		return e.File;
+	}
+
+	void Container::RebuildEntryIndex()
+	{
+		mEntryIndex.Clear();
+		mEntryIndex.Reserve(mEntries.size());
+		for (size i = 0; i < mEntries.size(); ++i)
+		{
+			mEntryIndex.Insert(mEntries[i].NameHash, gsl::narrow<u32>(i));
+		}
+	}
+
+	// Must be called before the change is recorded in mHasChanged/mEntriesChanged
+	void Container::InvalidateLayout()
+	{
+		// if the layout wasn't computed since the last change, the parent was already notified
+		// and it didn't get the new size yet either
+		const bool notifyParent = !HasChanged() || !mLayoutDirty;
+		mLayoutDirty = true;
+		if (notifyParent)
+		{
+			MarkChanged();
+		}
+	}
+
+	// Entries are laid out in table order, the original Offset/Size are kept to copy the
+	// unchanged entries from their current location
+	void Container::FixUpOffsets()
+	{
+		u64 currOffset = 0;
+		for (ContainerEntry& e : mEntries)
+		{
+			e.NewOffset = currOffset;
+			e.NewSize = UsesEntryFile(e) ? e.File->Size() : e.Size();
+			currOffset += SizeAligned(e.NewSize);
+		}
+
+		mNewSize = currOffset + EntryTableSize(mEntries.size());
+		mLayoutDirty = false;
+	}
+
 	static bool Validator(Stream& input)
 	{
 		const u64 size = input.Size();
@@ -205,6 +640,34 @@ namespace noire
 		return magic == Container::EntriesHeaderMagic;
 	}
 
+	static File::SignatureMatch SignatureMatcher(const File::Signature& signature)
+	{
+		const u64 size = signature.StreamSize;
+		if (size < 12) // min required bytes
+		{
+			return File::SignatureMatch::No;
+		}
+
+		const std::optional<u32> entriesOffset = signature.U32At(size - 4);
+		if (!entriesOffset)
+		{
+			return File::SignatureMatch::Maybe;
+		}
+
+		// same checks as Validator, but the entries header is usually outside the suffix window
+		// so most streams that pass them still need the full validator
+		const i64 entriesPos = gsl::narrow<i64>(size) - *entriesOffset;
+		if (entriesPos < 0 || entriesPos + 4 >= gsl::narrow<i64>(size))
+		{
+			return File::SignatureMatch::No;
+		}
+
+		const std::optional<u32> magic = signature.U32At(gsl::narrow<u64>(entriesPos));
+		return !magic ? File::SignatureMatch::Maybe :
+						(*magic == Container::EntriesHeaderMagic ? File::SignatureMatch::Yes :
+																   File::SignatureMatch::No);
+	}
+
 	static std::shared_ptr<File> Creator(Device& parent, PathView path, bool created)
 	{
 		return std::make_shared<Container>(parent, path, created);
@@ -213,7 +676,8 @@ namespace noire
 	const File::TypeDefinition Container::Type{ std::hash<std::string_view>{}("Container"),
 												2,
 												&Validator,
-												&Creator };
+												&Creator,
+												&SignatureMatcher };
 }
 
 // ifndef because line 'Container& c = *cont;' gets compiler error 'illegal indirection' when
@@ -222,6 +686,7 @@ namespace noire
 TEST_SUITE("Container")
 {
 	using namespace noire;
+	using namespace noire::test;
 
 	TEST_CASE("Load" * doctest::skip(true))
 	{
@@ -240,8 +705,8 @@ TEST_SUITE("Container")
 					std::snprintf(
 						buffer.data(),
 						buffer.size(),
-						"\tHash:%08X Unk1:%08X Unk2:%08X Unk3:%08X Unk4:%08X Offset:%016I64X "
-						"Size:%016I64X\t",
+						"\tHash:%08X Unk1:%08X Unk2:%08X Unk3:%08X Unk4:%08X Offset:%016" PRIX64
+						" Size:%016" PRIX64 "\t",
 						e.NameHash,
 						e.Unk1,
 						e.Unk2,
@@ -257,13 +722,215 @@ TEST_SUITE("Container")
 		std::cout << "input:  " << d.OpenStream("/vehicles.big.pc").Size() << std::endl;
 		std::cout << "size(): " << c.Size() << std::endl;
 
-		// CHECK_EQ(input->Size(), c.Size()); // NOTE: Container::Size() doesn't work properly yet
-
 		// std::shared_ptr<Stream> output = std::make_shared<FileStream>(
 		//	"E:\\Rockstar Games\\L.A. Noire Complete Edition\\test\\vehicles_copy.big.pc");
 
-		// c.Save(*output);
+		// c.SaveTo(*output);
 		// CHECK_EQ(c.Size(), output->Size());
 	}
+
+	// Entries only store the hash of their name, so they are found through the hash once reopened
+	static Path EntryPath(std::string_view name)
+	{
+		return Path::Root / HashLookup::Instance().TryGetString(crc32(name));
+	}
+
+	// Writes a container with the given entries and data, the offsets are filled in. With
+	// 'sgesSize' the size of the data is stored in Unk4.
+	using RawEntryData = std::pair<ContainerRawEntry, std::string>;
+
+	static void WriteContainer(const std::filesystem::path& path,
+							   const std::vector<RawEntryData>& entries,
+							   bool sgesSize)
+	{
+		FileStream f{ path };
+		Stream& s = f;
+		std::vector<ContainerRawEntry> table{};
+		for (const auto& [entry, data] : entries)
+		{
+			ContainerRawEntry& r = table.emplace_back(entry);
+			r.Unk1 = gsl::narrow<u32>(s.Tell() >> 4);
+			r.Unk4 = sgesSize ? gsl::narrow<u32>(data.size()) : r.Unk4;
+
+			const std::string padding(
+				gsl::narrow<size>(Container::PayloadAlignment -
+								  data.size() % Container::PayloadAlignment),
+				'\0');
+			s.Write(data.data(), data.size());
+			s.Write(padding.data(), padding.size());
+		}
+
+		s.Write(Container::EntriesHeaderMagic);
+		s.Write(gsl::narrow<u32>(table.size()));
+		s.Write(table.data(), table.size() * sizeof(ContainerRawEntry));
+		s.Write(gsl::narrow<u32>(sizeof(u32) * 3 + table.size() * sizeof(ContainerRawEntry)));
+	}
+
+	TEST_CASE("Save, modify and save again")
+	{
+		namespace fs = std::filesystem;
+
+		const TempDirectory temp{ "noire_container_save_test" };
+		const fs::path& root = temp.Path;
+
+		// bigger than the alignment, so it takes two slots
+		const std::string big(Container::PayloadAlignment + 100, 'x');
+		const u64 expectedSize = Container::PayloadAlignment * 3 + 12 + 20 * 3;
+
+		{
+			LocalDevice d{ root };
+			auto c =
+				std::static_pointer_cast<Container>(d.Create("/test.big.pc", Container::Type.Id));
+			WriteAll(*c->Create(EntryPath("a.bin"), File::Type.Id), big);
+			WriteAll(*c->Create(EntryPath("b.bin"), File::Type.Id), "second file");
+			c->Create(EntryPath("empty.bin"), File::Type.Id);
+			CHECK_EQ(c->Size(), expectedSize);
+			d.Commit();
+		}
+
+		CHECK_EQ(fs::file_size(root / "test.big.pc"), expectedSize);
+
+		{
+			LocalDevice d{ root };
+			auto c = std::dynamic_pointer_cast<Container>(d.Open("/test.big.pc"));
+			REQUIRE(c != nullptr);
+			c->Load();
+			CHECK_EQ(c->GetEntry(crc32("a.bin")).Offset(), 0);
+			CHECK_EQ(c->GetEntry(crc32("b.bin")).Offset(), Container::PayloadAlignment * 2);
+			CHECK_EQ(c->GetEntry(crc32("empty.bin")).Size(), 0);
+			CHECK_EQ(c->GetEntry(crc32("b.bin")).Unk4, 0);
+			CHECK_EQ(ReadAll(c->OpenStream(EntryPath("a.bin"))), big);
+			CHECK_EQ(ReadAll(c->OpenStream(EntryPath("b.bin"))), "second file");
+
+			WriteAll(*c->Open(EntryPath("b.bin")), "second file, now longer");
+			CHECK(c->Delete(EntryPath("a.bin")));
+			WriteAll(*c->Create(EntryPath("c.bin"), File::Type.Id), "third file");
+			d.Commit();
+
+			// the container keeps working after saving, now reading from the new file
+			CHECK_FALSE(c->HasChanged());
+			CHECK_EQ(c->GetEntry(crc32("b.bin")).Offset(), 0);
+			CHECK_EQ(ReadAll(c->OpenStream(EntryPath("b.bin"))), "second file, now longer");
+		}
+
+		{
+			LocalDevice d{ root };
+			auto c = std::dynamic_pointer_cast<Container>(d.Open("/test.big.pc"));
+			REQUIRE(c != nullptr);
+			c->Load();
+			CHECK_FALSE(c->Exists(EntryPath("a.bin")));
+			CHECK_EQ(ReadAll(c->OpenStream(EntryPath("b.bin"))), "second file, now longer");
+			CHECK_EQ(ReadAll(c->OpenStream(EntryPath("c.bin"))), "third file");
+			CHECK_EQ(c->GetEntry(crc32("c.bin")).Offset(), Container::PayloadAlignment);
+		}
+	}
+
+	TEST_CASE("Entries whose size is split are not resized")
+	{
+		namespace fs = std::filesystem;
+
+		const TempDirectory temp{ "noire_container_split_size_test" };
+		const fs::path& root = temp.Path;
+
+		// single 'trM#' entry with its size split in Unk2 and Unk3
+		WriteContainer(root / "test.big.pc",
+					   { { ContainerRawEntry{ crc32("a.bin"), 0, 5, 3, 0 }, "trM#data" } },
+					   false);
+
+		{
+			LocalDevice d{ root };
+			auto c = std::dynamic_pointer_cast<Container>(d.Open("/test.big.pc"));
+			REQUIRE(c != nullptr);
+			c->Load();
+			CHECK_EQ(ReadAll(c->OpenStream(EntryPath("a.bin"))), "trM#data");
+
+			// same size, saved with the same split
+			WriteAll(*c->Open(EntryPath("a.bin")), "trM#DATA");
+			d.Commit();
+			CHECK_EQ(c->GetEntry(crc32("a.bin")).Unk2, 5);
+			CHECK_EQ(c->GetEntry(crc32("a.bin")).Unk3, 3);
+
+			WriteAll(*c->Open(EntryPath("a.bin")), "trM#DATA, now longer");
+			CHECK_THROWS(d.Commit());
+		}
+
+		LocalDevice d{ root };
+		auto c = std::dynamic_pointer_cast<Container>(d.Open("/test.big.pc"));
+		REQUIRE(c != nullptr);
+		c->Load();
+		CHECK_EQ(ReadAll(c->OpenStream(EntryPath("a.bin"))), "trM#DATA");
+	}
+
+	TEST_CASE("Entries with 'sges' data are decompressed when enabled")
+	{
+		namespace fs = std::filesystem;
+
+		const TempDirectory temp{ "noire_container_sges_test" };
+		const fs::path& root = temp.Path;
+
+		// single block stored without compression: header, block and data
+		const std::string data = "decompressed data";
+		const u32 blockOffset = 16 + 8;
+		MemoryStream sges{};
+		Stream& s = sges;
+		s.Write(SgesStream::HeaderMagic);
+		s.Write(u16{ 0 });
+		s.Write(u16{ 1 });
+		s.Write(gsl::narrow<u32>(data.size()));
+		s.Write(gsl::narrow<u32>(blockOffset + data.size()));
+		s.Write(gsl::narrow<u16>(data.size()));
+		s.Write(gsl::narrow<u16>(data.size()));
+		s.Write(blockOffset);
+		s.Write(data.data(), data.size());
+
+		// same header with the block past the end of the data, read as it is
+		std::string invalid = ReadAll(s);
+		invalid[16 + 4] = '\x7F';
+
+		const std::string valid = ReadAll(s);
+		WriteContainer(root / "test.big.pc",
+					   { { ContainerRawEntry{ crc32("a.bin"), 0, 0, 0, 0 }, valid },
+						 { ContainerRawEntry{ crc32("b.bin"), 0, 0, 0, 0 }, invalid } },
+					   true);
+
+		{
+			// read as they are stored by default
+			LocalDevice d{ root };
+			auto c = std::dynamic_pointer_cast<Container>(d.Open("/test.big.pc"));
+			REQUIRE(c != nullptr);
+			c->Load();
+			CHECK_FALSE(c->IsSgesDecompressionEnabled());
+			CHECK_EQ(ReadAll(c->OpenStream(EntryPath("a.bin"))), ReadAll(s));
+		}
+
+		{
+			LocalDevice d{ root };
+			auto c = std::dynamic_pointer_cast<Container>(d.Open("/test.big.pc"));
+			REQUIRE(c != nullptr);
+			c->Load();
+			c->EnableSgesDecompression(true);
+			CHECK_EQ(c->GetEntry(crc32("a.bin")).Size(), s.Size());
+			CHECK_EQ(ReadAll(c->OpenStream(EntryPath("a.bin"))), data);
+			CHECK_EQ(ReadAll(c->Open(EntryPath("a.bin"))->Raw()), data);
+			CHECK_EQ(ReadAll(c->OpenStream(EntryPath("b.bin"))), invalid);
+
+			// modified 'sges' entries are not compressed again, saving them is refused without
+			// leaving the temporary file or skipping the other files
+			auto other =
+				std::static_pointer_cast<Container>(d.Create("/other.big.pc", Container::Type.Id));
+			WriteAll(*other->Create(EntryPath("a.bin"), File::Type.Id), "other file");
+			WriteAll(*c->Open(EntryPath("a.bin")), "DECOMPRESSED");
+			CHECK_THROWS(d.Commit());
+			CHECK_FALSE(fs::exists(root / "test.big.pc.tmp"));
+			CHECK(fs::is_regular_file(root / "other.big.pc"));
+		}
+
+		LocalDevice d{ root };
+		auto c = std::dynamic_pointer_cast<Container>(d.Open("/test.big.pc"));
+		REQUIRE(c != nullptr);
+		c->Load();
+		c->EnableSgesDecompression(true);
+		CHECK_EQ(ReadAll(c->OpenStream(EntryPath("a.bin"))), data);
+	}
 }
 #endif
@@ -1,6 +1,7 @@
 #pragma once
 #include "Common.h"
 #include "File.h"
+#include "HashIndex.h"
 #include "VFS.h"
 #include "devices/Device.h"
 #include <memory>
@@ -16,10 +17,21 @@ namespace noire
 		u32 Unk2;
 		u32 Unk3;
 		u32 Unk4; // 'sges' chunk size
-		std::shared_ptr<File> File;
+		std::shared_ptr<noire::File> File; // nullptr until the entry is opened
+		size FileType;                     // InvalidTypeId until the type is detected
+		u64 NewOffset;
+		u64 NewSize;
 
 		inline ContainerEntry()
-			: NameHash{ 0 }, Unk1{ 0 }, Unk2{ 0 }, Unk3{ 0 }, Unk4{ 0 }, File{ nullptr }
+			: NameHash{ 0 },
+			  Unk1{ 0 },
+			  Unk2{ 0 },
+			  Unk3{ 0 },
+			  Unk4{ 0 },
+			  File{ nullptr },
+			  FileType{ noire::File::InvalidTypeId },
+			  NewOffset{ 0 },
+			  NewSize{ 0 }
 		{
 		}
 
@@ -29,7 +41,10 @@ namespace noire
 			  Unk2{ unk2 },
 			  Unk3{ unk3 },
 			  Unk4{ unk4 },
-			  File{ nullptr }
+			  File{ nullptr },
+			  FileType{ noire::File::InvalidTypeId },
+			  NewOffset{ 0 },
+			  NewSize{ 0 }
 		{
 		}
 
@@ -56,26 +71,65 @@ namespace noire
 				   DeviceVisitCallback visitFile,
 				   PathView path,
 				   bool recursive) override;
+		// Entries are read as they are stored, unless 'sges' decompression is enabled
 		ReadOnlyStream OpenStream(PathView path) override;
+		void OnFileChanged(File& file) override;
 
 	protected:
 		void LoadImpl() override;
+		bool LoadFromIndexImpl(gsl::span<const IndexEntry> entries) override;
 
 	public:
-		void Save() override;
+		// Entry data is written in table order, each entry starting at a multiple of
+		// PayloadAlignment. The whole layout is known before writing, so when the output is a
+		// FileStream the entries are written at the same time from several threads. Modified
+		// 'sges' entries cannot be saved yet, they are not compressed again, and neither can
+		// 'trM#' entries whose size changed, the meaning of their size fields is not known.
+		void SaveTo(Stream& output) override;
+		void OnSaved() override;
 		u64 Size() override;
+		bool HasChanged() const override;
+		// Stores the entries and their types, detecting the types not known yet. Nothing is
+		// stored if the Container has changes that are not saved.
+		bool GetIndexEntries(std::vector<IndexEntry>& entries) override;
 
 		size GetEntryIndex(PathView path) const;
 		size GetEntryIndex(size nameHash) const;
 		const ContainerEntry& GetEntry(PathView path) const;
 		const ContainerEntry& GetEntry(size nameHash) const;
 
+		// Entries with 'sges' data are decompressed as they are read, see SgesStream. Disabled by
+		// default since the 'sges' layout has not been checked against the game files yet.
+		// Set it before opening the entries, the ones already opened keep their data.
+		bool IsSgesDecompressionEnabled() const { return mSgesDecompressionEnabled; }
+		void EnableSgesDecompression(bool enable) { mSgesDecompressionEnabled = enable; }
+
+		// Returns the type of the file, detecting it if it wasn't known yet.
+		size GetEntryFileType(PathView path);
+		// Detects the type of all the entries, reading their data in file order. Types are
+		// otherwise detected one at a time as entries are opened.
+		void DetectFileTypes();
+
 	private:
+		size EntryFileType(ContainerEntry& e);
+		ReadOnlyStream EntryStream(const ContainerEntry& e);
+		std::shared_ptr<File> EntryFile(ContainerEntry& e);
+		void RebuildEntryIndex();
+		void InvalidateLayout();
+		void FixUpOffsets();
+
 		std::vector<ContainerEntry> mEntries;
+		HashIndex mEntryIndex; // NameHash -> index in mEntries
 		VirtualFileSystem mVFS; // VFS entry info refers to NameHash of the WADEntry
+		bool mHasChanged;       // entries were added or removed
+		bool mEntriesChanged;   // an opened entry was modified
+		bool mLayoutDirty;      // the NewOffset/NewSize of the entries and mNewSize are outdated
+		u64 mNewSize;           // size of the container once saved
+		bool mSgesDecompressionEnabled;
 
 	public:
 		static constexpr u32 EntriesHeaderMagic{ 3 }; // WAD\01
+		static constexpr u64 PayloadAlignment{ 0x1000 };
 		static const TypeDefinition Type;
 	};
 }
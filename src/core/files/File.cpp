@@ -1,26 +1,34 @@
 #include "File.h"
+#include "Container.h"
+#include "WAD.h"
 #include "devices/Device.h"
 #include "streams/FileStream.h"
-#include "streams/TempStream.h"
+#include "streams/MemoryStream.h"
+#include "streams/OverlayStream.h"
 #include <algorithm>
+#include <array>
+#include <atomic>
+#include <doctest/doctest.h>
+#include <mutex>
 #include <optional>
 #include <unordered_map>
 #include <vector>
 
 namespace noire
 {
-	// Stream that uses a ReadOnlyStream until the user starts writing, then it switches to a
-	// TempStream.
+	// Stream that uses a ReadOnlyStream until the user starts writing, then it switches to an
+	// OverlayStream on top of it, so only the written ranges are copied. The input stream is opened
+	// on first use, which may happen from several threads reading with ReadAt at the same time.
 	class RawFileStream final : public Stream
 	{
 	public:
 		RawFileStream(File& file);
 
 		RawFileStream(const RawFileStream&) = delete;
-		RawFileStream(RawFileStream&&) = default;
+		RawFileStream(RawFileStream&&) = delete;
 
 		RawFileStream& operator=(const RawFileStream&) = delete;
-		RawFileStream& operator=(RawFileStream&&) = default;
+		RawFileStream& operator=(RawFileStream&&) = delete;
 
 		u64 Read(void* dstBuffer, u64 count) override;
 		u64 ReadAt(void* dstBuffer, u64 count, u64 offset) override;
@@ -34,7 +42,11 @@ namespace noire
 
 		u64 Size() override;
 
+		gsl::span<const byte> TryGetContiguous(u64 offset, u64 count) override;
+
 		bool IsUsingOutputStream() const;
+		// Drops the input and output streams, the input is opened again on next use
+		void Reset();
 
 	private:
 		void UseOutputStream();
@@ -42,11 +54,18 @@ namespace noire
 
 		File& mFile;
 		std::optional<ReadOnlyStream> mInput;
-		std::optional<TempStream> mOutput;
+		std::optional<OverlayStream> mOutput;
+		std::atomic<Stream*> mCurrent;
+		std::mutex mCurrentMutex;
 	};
 
 	File::File(Device& parent, PathView path, bool created)
-		: mParent{ parent }, mPath{ path }, mIsLoaded{ created }, mRawStream{}
+		: mParent{ parent },
+		  mPath{ path },
+		  mTypeId{ InvalidTypeId },
+		  mIsLoaded{ created },
+		  mRawStream{},
+		  mRawStreamOnce{}
 	{
 	}
 
@@ -59,15 +78,41 @@ namespace noire
 		}
 	}
 
+	bool File::LoadFromIndex(gsl::span<const IndexEntry> entries)
+	{
+		if (!mIsLoaded && LoadFromIndexImpl(entries))
+		{
+			mIsLoaded = true;
+		}
+
+		return mIsLoaded;
+	}
+
+	bool File::GetIndexEntries(std::vector<IndexEntry>&) { return false; }
+
 	void File::LoadImpl() {}
 
-	void File::Save() {}
+	bool File::LoadFromIndexImpl(gsl::span<const IndexEntry>) { return false; }
+
+	void File::SaveTo(Stream& output) { Raw().CopyTo(output); }
+
+	bool File::SaveInPlace(Stream&) { return false; }
+
+	void File::OnSaved()
+	{
+		if (mRawStream)
+		{
+			static_cast<RawFileStream*>(mRawStream.get())->Reset();
+		}
+	}
 
 	u64 File::Size() { return Raw().Size(); }
 
 	Stream& File::Raw()
 	{
-		return mRawStream ? *mRawStream : *(mRawStream = std::make_unique<RawFileStream>(*this));
+		std::call_once(mRawStreamOnce,
+					   [this]() { mRawStream = std::make_unique<RawFileStream>(*this); });
+		return *mRawStream;
 	}
 
 	bool File::HasChanged() const
@@ -76,6 +121,8 @@ namespace noire
 							false;
 	}
 
+	void File::MarkChanged() { mParent.OnFileChanged(*this); }
+
 	static auto& FileTypes() // key is TypeDefinition::Id
 	{
 		static std::unordered_map<size, const File::TypeDefinition*> i{};
@@ -123,8 +170,13 @@ namespace noire
 	File::TypeDefinition::TypeDefinition(size id,
 										 size priority,
 										 IsValidFunc isValidFunc,
-										 CreateFunc createFunc)
-		: Id{ id }, Priority{ priority }, IsValid{ isValidFunc }, Create{ createFunc }
+										 CreateFunc createFunc,
+										 MatchSignatureFunc matchSignatureFunc)
+		: Id{ id },
+		  Priority{ priority },
+		  IsValid{ isValidFunc },
+		  Create{ createFunc },
+		  MatchSignature{ matchSignatureFunc }
 	{
 		Expects(id != InvalidTypeId);
 		Expects(isValidFunc != nullptr);
@@ -135,11 +187,63 @@ namespace noire
 
 	File::TypeDefinition::~TypeDefinition() { UnregisterFileType(this); }
 
+	std::optional<u32> File::Signature::U32At(u64 offset) const
+	{
+		if (offset + sizeof(u32) <= gsl::narrow<u64>(Prefix.size()))
+		{
+			return LoadUnaligned<u32>(Prefix.data() + offset);
+		}
+
+		const u64 suffixOffset = StreamSize - gsl::narrow<u64>(Suffix.size());
+		if (offset >= suffixOffset && offset + sizeof(u32) <= StreamSize)
+		{
+			return LoadUnaligned<u32>(Suffix.data() + (offset - suffixOffset));
+		}
+
+		return std::nullopt;
+	}
+
+	using SignatureBuffer = std::array<byte, File::Signature::WindowSize * 2>;
+
+	static File::Signature ReadSignature(Stream& input, SignatureBuffer& buffer)
+	{
+		constexpr u64 WindowSize{ File::Signature::WindowSize };
+
+		File::Signature s{ input.Size(), {}, {} };
+		if (s.StreamSize <= buffer.size())
+		{
+			// small stream, both windows come from a single read
+			const u64 read = input.ReadAt(buffer.data(), s.StreamSize, 0);
+			s.Prefix = { buffer.data(), gsl::narrow<ptrdiff>(std::min(read, WindowSize)) };
+			if (read == s.StreamSize)
+			{
+				const u64 suffixSize = std::min(read, WindowSize);
+				s.Suffix = { buffer.data() + (read - suffixSize), gsl::narrow<ptrdiff>(suffixSize) };
+			}
+		}
+		else
+		{
+			const u64 prefixSize = input.ReadAt(buffer.data(), WindowSize, 0);
+			s.Prefix = { buffer.data(), gsl::narrow<ptrdiff>(prefixSize) };
+			byte* suffix = buffer.data() + WindowSize;
+			if (input.ReadAt(suffix, WindowSize, s.StreamSize - WindowSize) == WindowSize)
+			{
+				s.Suffix = { suffix, WindowSize };
+			}
+		}
+		return s;
+	}
+
 	size File::FindTypeOfStream(Stream& input)
 	{
+		SignatureBuffer buffer;
+		const Signature signature = ReadSignature(input, buffer);
 		for (const File::TypeDefinition* t : SortedFileTypes())
 		{
-			if (t->IsValid(input))
+			const SignatureMatch match =
+				t->MatchSignature ? t->MatchSignature(signature) : SignatureMatch::Maybe;
+			if (match == SignatureMatch::Yes ||
+				(match == SignatureMatch::Maybe && t->IsValid(input)))
 			{
 				return t->Id;
 			}
@@ -157,7 +261,14 @@ namespace noire
 		Expects(it != FileTypes().end());
 
 		const File::TypeDefinition& t = *it->second;
-		return t.Create(parent, path, created);
+		std::shared_ptr<File> f = t.Create(parent, path, created);
+		f->mTypeId = fileTypeId;
+		return f;
+	}
+
+	bool File::IsTypeRegistered(size fileTypeId)
+	{
+		return FileTypes().find(fileTypeId) != FileTypes().end();
 	}
 
 	const File::TypeDefinition File::Type{ std::hash<std::string_view>{}("File"),
@@ -165,10 +276,15 @@ namespace noire
 										   [](Stream&) { return true; },
 										   [](Device& parent, PathView path, bool created) {
 											   return std::make_shared<File>(parent, path, created);
-										   } };
+										   },
+										   [](const Signature&) { return SignatureMatch::Yes; } };
 
 	RawFileStream::RawFileStream(File& file)
-		: mFile{ file }, mInput{ std::nullopt }, mOutput{ std::nullopt }
+		: mFile{ file },
+		  mInput{ std::nullopt },
+		  mOutput{ std::nullopt },
+		  mCurrent{ nullptr },
+		  mCurrentMutex{}
 	{
 	}
 
@@ -182,49 +298,162 @@ namespace noire
 	u64 RawFileStream::Write(const void* buffer, u64 count)
 	{
 		UseOutputStream();
-		return Current().Write(buffer, count);
+		const u64 written = Current().Write(buffer, count);
+		mFile.MarkChanged();
+		return written;
 	}
 
 	u64 RawFileStream::WriteAt(const void* buffer, u64 count, u64 offset)
 	{
 		UseOutputStream();
-		return Current().WriteAt(buffer, count, offset);
+		const u64 written = Current().WriteAt(buffer, count, offset);
+		mFile.MarkChanged();
+		return written;
 	}
 
 	u64 RawFileStream::Seek(i64 offset, StreamSeekOrigin origin)
 	{
-		return Current().Seek(offset, origin);
+		Stream& s = Current();
+		const u64 size = s.Size();
+		const u64 position = s.Seek(offset, origin);
+		if (s.Size() != size)
+		{
+			// seeking past the end of the output stream grows it
+			mFile.MarkChanged();
+		}
+		return position;
 	}
 
 	u64 RawFileStream::Tell() { return Current().Tell(); }
 
 	u64 RawFileStream::Size() { return Current().Size(); }
 
+	gsl::span<const byte> RawFileStream::TryGetContiguous(u64 offset, u64 count)
+	{
+		return Current().TryGetContiguous(offset, count);
+	}
+
 	bool RawFileStream::IsUsingOutputStream() const { return mOutput.has_value(); }
 
+	void RawFileStream::Reset()
+	{
+		std::lock_guard<std::mutex> lock{ mCurrentMutex };
+		mCurrent.store(nullptr, std::memory_order_release);
+		mInput.reset();
+		mOutput.reset();
+	}
+
 	void RawFileStream::UseOutputStream()
 	{
 		if (!IsUsingOutputStream())
 		{
 			Stream& i = Current();
-			Stream& o = mOutput.emplace();
+			const u64 position = i.Tell();
+			const u64 inputSize = i.Size();
 
-			i.CopyTo(o);
-			o.Seek(gsl::narrow<i64>(i.Tell()), StreamSeekOrigin::Begin);
+			Stream& o = mOutput.emplace(std::move(*mInput));
+			o.Seek(gsl::narrow<i64>(position), StreamSeekOrigin::Begin);
 
-			Ensures(i.Size() == o.Size());
+			Ensures(inputSize == o.Size());
 
+			mCurrent.store(&*mOutput, std::memory_order_release);
 			mInput.reset();
 		}
 	}
 
 	Stream& RawFileStream::Current()
 	{
-		if (IsUsingOutputStream())
+		if (Stream* current = mCurrent.load(std::memory_order_acquire); current)
 		{
-			return *mOutput;
+			return *current;
 		}
 
-		return mInput.has_value() ? *mInput : *(mInput = mFile.Parent().OpenStream(mFile.Path()));
+		std::lock_guard<std::mutex> lock{ mCurrentMutex };
+		if (Stream* current = mCurrent.load(std::memory_order_relaxed); current)
+		{
+			return *current;
+		}
+
+		Stream& input = mInput.emplace(mFile.Parent().OpenStream(mFile.Path()));
+		mCurrent.store(&input, std::memory_order_release);
+		return input;
+	}
+}
+
+TEST_SUITE("File")
+{
+	using namespace noire;
+
+	TEST_CASE("Signature::U32At")
+	{
+		const u32 data[]{ 0, 1, 2, 3, 4, 5 };
+		const gsl::span<const byte> bytes = gsl::as_bytes(gsl::span<const u32>{ data });
+
+		const File::Signature s{ 400, bytes.subspan(0, 8), bytes.subspan(8, 16) };
+		CHECK_EQ(s.U32At(0), 0);
+		CHECK_EQ(s.U32At(4), 1);
+		CHECK_FALSE(s.U32At(6).has_value());
+		CHECK_FALSE(s.U32At(100).has_value());
+		CHECK_EQ(s.U32At(384), 2);
+		CHECK_EQ(s.U32At(396), 5);
+		CHECK_FALSE(s.U32At(398).has_value());
+	}
+
+	TEST_CASE("FindTypeOfStream")
+	{
+		SUBCASE("WAD")
+		{
+			MemoryStream m{};
+			Stream& s = m;
+			s.Write(WAD::HeaderMagic);
+			s.Write(u32{ 0 });
+			CHECK_EQ(File::FindTypeOfStream(s), WAD::Type.Id);
+		}
+
+		SUBCASE("Container, entries header inside the suffix window")
+		{
+			MemoryStream m{};
+			Stream& s = m;
+			s.Write(u32{ 0xAAAAAAAA });
+			s.Write(Container::EntriesHeaderMagic);
+			s.Write(u32{ 0 });
+			s.Write(u32{ 12 }); // entries offset, from the end of the stream
+			CHECK_EQ(File::FindTypeOfStream(s), Container::Type.Id);
+		}
+
+		SUBCASE("Container, entries header outside the windows")
+		{
+			MemoryStream m{};
+			Stream& s = m;
+			for (size i = 0; i < 100; i++)
+			{
+				s.Write(u32{ 0xAAAAAAAA });
+			}
+			s.Write(Container::EntriesHeaderMagic);
+			for (size i = 0; i < 100; i++)
+			{
+				s.Write(u32{ 0xBBBBBBBB });
+			}
+			s.Write(u32{ 101 * 4 + 4 });
+			CHECK_EQ(File::FindTypeOfStream(s), Container::Type.Id);
+		}
+
+		SUBCASE("Raw file")
+		{
+			MemoryStream m{};
+			Stream& s = m;
+			for (size i = 0; i < 100; i++)
+			{
+				s.Write(gsl::narrow_cast<u32>(i));
+			}
+			CHECK_EQ(File::FindTypeOfStream(s), File::Type.Id);
+		}
+
+		SUBCASE("Empty")
+		{
+			MemoryStream m{};
+			Stream& s = m;
+			CHECK_EQ(File::FindTypeOfStream(s), File::Type.Id);
+		}
 	}
 }
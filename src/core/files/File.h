@@ -2,12 +2,16 @@
 #include "Common.h"
 #include "Path.h"
 #include <memory>
+#include <mutex>
+#include <optional>
+#include <vector>
 
 namespace noire
 {
 	class Device;
 	class Stream;
 	class ReadOnlyStream;
+	struct IndexEntry;
 
 	// IDEA: remove RawFile and give File a RawStream property
 	class File
@@ -18,40 +22,91 @@ namespace noire
 		virtual ~File() = default;
 
 		void Load();
-		// default Save() writes the contents of the input stream to the output stream
-		virtual void Save();
-		// Returns how many bytes will be written when calling Save(). Default Size() gets the size
-		// of the input stream.
+		// Loads the file from the entries stored in an IndexCache instead of reading the raw
+		// stream. Returns whether the file is loaded.
+		bool LoadFromIndex(gsl::span<const IndexEntry> entries);
+		// Gets the entries to store in an IndexCache, the paths refer to the file and are valid
+		// until it is modified. Returns false if the type has nothing to store. Default
+		// GetIndexEntries() returns false.
+		virtual bool GetIndexEntries(std::vector<IndexEntry>& entries);
+		// Writes the file with its changes to 'output' in a single forward pass, the raw stream is
+		// only read. Default SaveTo() copies the raw stream.
+		virtual void SaveTo(Stream& output);
+		// Called by the parent once the data written by SaveTo() replaced the original data of the
+		// file. Default OnSaved() drops the raw stream, so it is opened again from the parent.
+		virtual void OnSaved();
+		// Writes only the changes to 'target', which holds the current data of the file. Returns
+		// false if the changes need a full SaveTo(), in that case 'target' is not modified. On
+		// success the file already refers to the new data and OnSaved() must not be called.
+		// Default SaveInPlace() always returns false.
+		virtual bool SaveInPlace(Stream& target);
+		// Returns how many bytes will be written when calling SaveTo(). Default Size() gets the
+		// size of the raw stream.
 		virtual u64 Size();
 
 		virtual bool HasChanged() const;
+		// Notifies the parent device that the file was modified
+		void MarkChanged();
 
 		bool IsLoaded() const { return mIsLoaded; }
+		// Id of the TypeDefinition used to create the file
+		size TypeId() const { return mTypeId; }
 		PathView Path() const { return mPath; }
 		Device& Parent() { return mParent; }
 		const Device& Parent() const { return mParent; }
 
+		// The raw stream is created on first call, it is safe to call from several threads.
 		Stream& Raw();
 
 	protected:
 		// default LoadImpl() does nothing
 		virtual void LoadImpl();
+		// default LoadFromIndexImpl() returns false, the file is loaded with LoadImpl() instead
+		virtual bool LoadFromIndexImpl(gsl::span<const IndexEntry> entries);
 
 	private:
 		Device& mParent;
 		noire::Path mPath;
+		size mTypeId;
 		bool mIsLoaded;
 		std::unique_ptr<Stream> mRawStream;
+		std::once_flag mRawStreamOnce;
 
 	public:
+		// First and last bytes of a stream, read once by FindTypeOfStream and shared by the
+		// signature checks of all the types.
+		struct Signature final
+		{
+			static constexpr size WindowSize{ 64 };
+
+			u64 StreamSize;
+			gsl::span<const byte> Prefix; // up to WindowSize bytes at the beginning of the stream
+			gsl::span<const byte> Suffix; // up to WindowSize bytes at the end of the stream
+
+			// Returns the u32 at 'offset' in the stream, or nullopt if it is outside the windows
+			std::optional<u32> U32At(u64 offset) const;
+		};
+
+		enum class SignatureMatch
+		{
+			No,
+			Yes,
+			Maybe, // the signature is not enough to know, the full validator needs to be called
+		};
+
 		struct TypeDefinition final
 		{
 			using IsValidFunc = bool (*)(Stream& input);
 			using CreateFunc = std::shared_ptr<File> (*)(Device& parent,
 														 PathView path,
 														 bool created);
+			using MatchSignatureFunc = SignatureMatch (*)(const Signature& signature);
 
-			TypeDefinition(size id, size priority, IsValidFunc isValidFunc, CreateFunc createFunc);
+			TypeDefinition(size id,
+						   size priority,
+						   IsValidFunc isValidFunc,
+						   CreateFunc createFunc,
+						   MatchSignatureFunc matchSignatureFunc = nullptr);
 			~TypeDefinition();
 
 			TypeDefinition(const TypeDefinition&) = delete;
@@ -72,12 +127,19 @@ namespace noire
 			// Creates a File instance. Assume IsValid was called before calling this and returned
 			// true.
 			CreateFunc Create;
+
+			// Checks whether the stream signature matches this type without reading the stream.
+			// IsValid is only called when it returns Maybe. If nullptr, IsValid is always called.
+			MatchSignatureFunc MatchSignature;
 		};
 
 		static constexpr size InvalidTypeId{ static_cast<size>(-1) };
 		static const TypeDefinition Type;
 
+		// Reads the signature of the stream once and checks it against each type, in priority
+		// order. The full validator of a type is only called if its signature is ambiguous.
 		static size FindTypeOfStream(Stream& input);
+		static bool IsTypeRegistered(size fileTypeId);
 		static std::shared_ptr<File>
 		New(Device& parent, PathView path, bool created, size fileTypeId);
 	};
@@ -1,19 +1,90 @@
 #include "WAD.h"
 #include "Hash.h"
+#include "devices/IndexCache.h"
 #include "devices/LocalDevice.h"
 #include "streams/FileStream.h"
 #include "streams/Stream.h"
+#include "streams/TempStream.h"
+#include "tests/TestUtil.h"
 #include <algorithm>
+#include <cstring>
 #include <doctest/doctest.h>
-#include <fstream>
 #include <functional>
 #include <iostream>
+#include <limits>
+#include <numeric>
+#include <optional>
 #include <string_view>
+#include <type_traits>
+#include <utility>
+#include <vector>
 
 namespace noire
 {
+	// Entry as stored in the file
+	struct WADRawEntry
+	{
+		u32 PathHash;
+		u32 Offset;
+		u32 Size;
+	};
+	static_assert(sizeof(WADRawEntry) == 12 && std::is_trivially_copyable_v<WADRawEntry>);
+
+	// Written at the end of the file by SaveInPlace, after a copy of the new entry table, and
+	// cleared once the entry table is written. The game ignores anything after the paths. Loading
+	// uses the copy while the footer is valid, which happens if saving was interrupted while the
+	// entry table was being written.
+	struct WADRawJournalFooter
+	{
+		u32 EntryCount;
+		u32 TableChecksum; // crc32 of the copy of the table
+		u32 Magic;
+	};
+	static_assert(sizeof(WADRawJournalFooter) == 12 &&
+				  std::is_trivially_copyable_v<WADRawJournalFooter>);
+
+	static constexpr u32 JournalMagic{ 0x4A444157 }; // WADJ
+
+	// Returns the copy of the entry table written by SaveInPlace, or an empty span if the stream
+	// doesn't end with a valid one
+	static gsl::span<const byte>
+	ReadJournalTable(Stream& s, u32 entryCount, std::vector<byte>& buffer)
+	{
+		const u64 tableSize = sizeof(WADRawEntry) * u64{ entryCount };
+		const u64 streamSize = s.Size();
+		if (streamSize < sizeof(u32) * 2 + tableSize * 2 + sizeof(WADRawJournalFooter))
+		{
+			return {};
+		}
+
+		const WADRawJournalFooter footer =
+			s.ReadAt<WADRawJournalFooter>(streamSize - sizeof(WADRawJournalFooter));
+		if (footer.Magic != JournalMagic || footer.EntryCount != entryCount)
+		{
+			return {};
+		}
+
+		const gsl::span<const byte> table = s.ReadContiguous(
+			streamSize - sizeof(WADRawJournalFooter) - tableSize, tableSize, buffer);
+		if (gsl::narrow<u64>(table.size()) != tableSize ||
+			crc32({ reinterpret_cast<const char*>(table.data()), gsl::narrow<size>(tableSize) }) !=
+				footer.TableChecksum)
+		{
+			return {};
+		}
+
+		return table;
+	}
+
 	WAD::WAD(Device& parent, PathView path, bool created)
-		: File(parent, path, created), mHasChanged{ created }
+		: File(parent, path, created),
+		  mEntries{},
+		  mEntryIndex{},
+		  mVFS{},
+		  mHasChanged{ created },
+		  mEntriesChanged{ false },
+		  mLayoutDirty{ true },
+		  mNewSize{ 0 }
 	{
 	}
 
@@ -29,21 +100,27 @@ namespace noire
 	{
 		Expects(path.IsFile() && path.IsAbsolute());
 
-		return mVFS.Open(path, [this](PathView, size pathHash) { return GetEntry(pathHash).File; });
+		return mVFS.Open(path, [this](PathView, size pathHash) {
+			return EntryFile(mEntries[GetEntryIndex(pathHash)]);
+		});
 	}
 
 	std::shared_ptr<File> WAD::Create(PathView path, size fileTypeId)
 	{
 		Expects(path.IsFile() && path.IsAbsolute());
 
+		const u32 newIndex = gsl::narrow<u32>(mEntries.size());
 		WADEntry& newEntry = mEntries.emplace_back();
 		newEntry.FileType = fileTypeId;
-		newEntry.File = mVFS.Create(*this, path, fileTypeId, [&newEntry](PathView path) {
-			// remove first '/', paths in WAD file don't contain it
-			newEntry.Path = path.String().substr(1);
-			newEntry.PathHash = crc32(newEntry.Path);
-			return newEntry.PathHash;
-		});
+		newEntry.File =
+			mVFS.Create(*this, path, fileTypeId, [this, &newEntry, newIndex](PathView path) {
+				// remove first '/', paths in WAD file don't contain it
+				newEntry.Path = path.String().substr(1);
+				newEntry.PathHash = crc32(newEntry.Path);
+				mEntryIndex.Insert(newEntry.PathHash, newIndex);
+				return newEntry.PathHash;
+			});
+		InvalidateLayout();
 		mHasChanged = true;
 
 		return newEntry.File;
@@ -57,8 +134,10 @@ namespace noire
 		{
 			const size index = GetEntryIndex(path);
 			mEntries.erase(mEntries.begin() + index);
+			// the indices of the following entries changed
+			RebuildEntryIndex();
 			mVFS.Delete(path);
-			FixUpOffsets();
+			InvalidateLayout();
 			mHasChanged = true;
 			return true;
 		}
@@ -82,6 +161,12 @@ namespace noire
 							ReadOnlyStream{ std::make_unique<SubStream>(Raw(), e.Offset, e.Size) };
 	}
 
+	void WAD::OnFileChanged(File&)
+	{
+		InvalidateLayout();
+		mEntriesChanged = true;
+	}
+
 	// File implementation
 	void WAD::LoadImpl()
 	{
@@ -91,148 +176,333 @@ namespace noire
 			return;
 		}
 
-		s.Seek(0, StreamSeekOrigin::Begin);
-
-		const u32 magic = s.Read<u32>();
+		const u32 magic = s.ReadAt<u32>(0);
 		Expects(magic == HeaderMagic);
 
-		const u32 entryCount = s.Read<u32>();
+		const u32 entryCount = s.ReadAt<u32>(sizeof(u32));
 
 		mEntries.reserve(entryCount);
 
 		if (entryCount)
 		{
 			// read entries
-			for (size i = 0; i < entryCount; ++i)
+			std::vector<byte> buffer{};
+			const u64 entriesSize = sizeof(WADRawEntry) * entryCount;
+			gsl::span<const byte> entries = ReadJournalTable(s, entryCount, buffer);
+			if (entries.empty())
 			{
-				const u32 hash = s.Read<u32>();
-				const u32 offset = s.Read<u32>();
-				const u32 size = s.Read<u32>();
+				entries = s.ReadContiguous(sizeof(u32) * 2, entriesSize, buffer);
+			}
+			Expects(gsl::narrow<u64>(entries.size()) == entriesSize);
 
-				mEntries.emplace_back("", hash, offset, size);
+			for (size i = 0; i < entryCount; ++i)
+			{
+				const WADRawEntry e =
+					LoadUnaligned<WADRawEntry>(entries.data() + i * sizeof(WADRawEntry));
+				mEntries.emplace_back("", e.PathHash, e.Offset, e.Size);
 			}
 
 			Ensures(IsSorted());
 
+			RebuildEntryIndex();
+
 			// read paths
 			const WADEntry& lastEntry = mEntries.back();
-			s.Seek(gsl::narrow<i64>(lastEntry.Offset) + lastEntry.Size, StreamSeekOrigin::Begin);
+			const u64 pathsOffset = u64{ lastEntry.Offset } + lastEntry.Size;
+			Expects(pathsOffset <= s.Size());
+			const u64 pathsSize = s.Size() - pathsOffset;
+			const gsl::span<const byte> paths = s.ReadContiguous(pathsOffset, pathsSize, buffer);
+			Expects(gsl::narrow<u64>(paths.size()) == pathsSize);
+
+			u64 pathOffset = 0;
 			for (size i = 0; i < entryCount; ++i)
 			{
-				const u64 t = s.Tell();
-				const u16 strLength = s.Read<u16>();
 				WADEntry& e = mEntries[i];
 				std::string& str = e.Path;
-				str.resize(strLength);
 
-				s.Read(str.data(), strLength);
+				Expects(pathOffset + sizeof(u16) <= pathsSize);
+				const u16 strLength = LoadUnaligned<u16>(paths.data() + pathOffset);
+				pathOffset += sizeof(u16);
 
-				const noire::Path filePath = Path::Root / str;
-				mVFS.RegisterExistingFile(filePath, mEntries[i].PathHash);
+				Expects(pathOffset + strLength <= pathsSize);
+				str.assign(reinterpret_cast<const char*>(paths.data() + pathOffset), strLength);
+				pathOffset += strLength;
 
-				SubStream entryStream{ s, e.Offset, e.Size };
-				e.FileType = File::FindTypeOfStream(entryStream);
-				e.File = File::New(*this, filePath, false, e.FileType);
+				// the type and File of the entry are created once needed, see EntryFile
+				mVFS.RegisterExistingFile(Path::Root / str, e.PathHash);
 			}
 		}
 	}
 
-	void WAD::Save()
+	bool WAD::LoadFromIndexImpl(gsl::span<const IndexEntry> entries)
+	{
+		mEntries.reserve(entries.size());
+		for (const IndexEntry& i : entries)
+		{
+			WADEntry& e =
+				mEntries.emplace_back(std::string{ i.Path }, i.NameHash, i.Fields[0], i.Fields[1]);
+			e.FileType = i.FileType;
+			mVFS.RegisterExistingFile(Path::Root / e.Path, e.PathHash);
+		}
+
+		Ensures(IsSorted());
+		RebuildEntryIndex();
+		return true;
+	}
+
+	// An entry is written from its File if it changed, otherwise its original data is copied
+	static bool UsesEntryFile(const WADEntry& e) { return e.File && e.File->HasChanged(); }
+
+	// Paths are stored as a u16 length followed by the characters
+	static void AppendPath(std::vector<byte>& paths, const std::string& path)
+	{
+		const u16 length = gsl::narrow<u16>(path.size());
+		const size offset = paths.size();
+		paths.resize(offset + sizeof(u16) + length);
+		std::memcpy(paths.data() + offset, &length, sizeof(u16));
+		std::memcpy(paths.data() + offset + sizeof(u16), path.data(), length);
+	}
+
+	void WAD::SaveTo(Stream& output)
 	{
 		if (!HasChanged())
 		{
+			File::SaveTo(output);
 			return;
 		}
 
-		FixUpOffsets();
+		if (mLayoutDirty)
+		{
+			FixUpOffsets();
+		}
 
 		Ensures(IsSorted());
 
-		Stream& s = Raw();
-		s.Seek(0, StreamSeekOrigin::Begin);
-		s.Write<u32>(HeaderMagic);
-
+		// offsets are relative to the beginning of the WAD, which may not be the beginning of
+		// the output if this WAD is inside another one
+		const u64 baseOffset = output.Tell();
 		const u32 entryCount = gsl::narrow<u32>(mEntries.size());
-		s.Write(entryCount);
 
-		// write entries
+		// header and entries
+		std::vector<byte> header(sizeof(u32) * 2 + sizeof(WADRawEntry) * entryCount);
+		std::memcpy(header.data(), &HeaderMagic, sizeof(u32));
+		std::memcpy(header.data() + sizeof(u32), &entryCount, sizeof(u32));
 		for (size i = 0; i < entryCount; ++i)
 		{
 			const WADEntry& e = mEntries[i];
-			s.Write<u32>(e.PathHash);
-			s.Write<u32>(e.NewOffset);
-			s.Write<u32>(e.NewSize);
+			const WADRawEntry r{ e.PathHash, e.NewOffset, e.NewSize };
+			std::memcpy(header.data() + sizeof(u32) * 2 + i * sizeof(WADRawEntry), &r, sizeof(r));
 		}
+		output.Write(header.data(), header.size());
 
-		// write data
-		std::ofstream fs{ "output.log" };
-		for (size i = 0; i < entryCount; ++i)
+		// data, unchanged entries are copied straight from their range in the raw stream
+		Stream& s = Raw();
+		for (const WADEntry& e : mEntries)
 		{
-			WADEntry& e = mEntries[i];
-			fs << e.Path << ':' << e.Offset << ", " << e.Size << ", " << e.NewOffset << ", "
-			   << e.NewSize << ", " << s.Tell() << ", ";
-			Ensures(e.NewOffset == s.Tell());
+			Ensures(e.NewOffset == output.Tell() - baseOffset);
+			if (UsesEntryFile(e))
 			{
-				auto ef = e.File;
-				if (ef->HasChanged())
-				{
-					ef->Save();
-				}
-				ef->Raw().CopyTo(s);
+				e.File->SaveTo(output);
 			}
-			fs << (e.NewOffset + e.NewSize) << ", " << s.Tell() << '\n';
-			if ((e.NewOffset + e.NewSize) != s.Tell())
+			else if (e.Size != 0)
 			{
-				Ensures((e.NewOffset + e.NewSize) == s.Tell());
+				SubStream{ s, e.Offset, e.Size }.CopyTo(output);
 			}
-			e.Offset = e.NewOffset;
-			e.Size = e.NewSize;
-			e.NewOffset = 0;
-			e.NewSize = 0;
-			e.File = File::New(*this, Path::Root / e.Path, false, e.FileType);
+			Ensures(e.NewOffset + e.NewSize == output.Tell() - baseOffset);
 		}
 
-		// write path
-		for (size i = 0; i < entryCount; ++i)
+		// paths
+		std::vector<byte> paths{};
+		for (const WADEntry& e : mEntries)
 		{
-			const WADEntry& e = mEntries[i];
-			s.Write<u16>(gsl::narrow<u16>(e.Path.size()));
-			s.Write(e.Path.data(), e.Path.size());
+			AppendPath(paths, e.Path);
+		}
+		output.Write(paths.data(), paths.size());
+	}
+
+	bool WAD::SaveInPlace(Stream& target)
+	{
+		// added or removed entries change the size of the entry table, which moves all the data
+		if (mHasChanged || mEntries.empty() || target.Size() != Raw().Size())
+		{
+			return false;
+		}
+
+		// the new data of the changed entries is kept aside first, building it may read the
+		// ranges of the current data
+		std::vector<std::pair<size, TempStream>> changed{};
+		for (size i = 0; i < mEntries.size(); ++i)
+		{
+			if (UsesEntryFile(mEntries[i]))
+			{
+				TempStream& data = changed.emplace_back(i, TempStream{}).second;
+				mEntries[i].File->SaveTo(data);
+			}
+		}
+
+		if (changed.empty())
+		{
+			OnSaved();
+			return true;
+		}
+
+		// the space of the replaced data, paths and table copies is never reused, once there is
+		// too much of it the WAD is written again without it
+		u64 liveSize = sizeof(u32) * 2 + sizeof(WADRawEntry) * mEntries.size();
+		u64 appendedSize = sizeof(WADRawEntry) * mEntries.size() + sizeof(WADRawJournalFooter);
+		for (const WADEntry& e : mEntries)
+		{
+			liveSize += e.Size + sizeof(u16) + e.Path.size();
+			appendedSize += sizeof(u16) + e.Path.size();
+		}
+		for (auto& [index, data] : changed)
+		{
+			liveSize = liveSize - mEntries[index].Size + data.Size();
+			appendedSize += data.Size();
+		}
+
+		const u64 deadSpace = target.Size() + appendedSize - liveSize;
+		if (deadSpace > InPlaceDeadSpaceLimit && deadSpace > liveSize / 4)
+		{
+			return false;
+		}
+
+		// the current data is never overwritten, the changed entries are moved after the end of
+		// the file, followed by the paths, which start right after the last entry
+		for (WADEntry& e : mEntries)
+		{
+			e.NewOffset = e.Offset;
+			e.NewSize = e.Size;
+		}
+		u64 appendOffset = target.Size();
+		for (auto& [index, data] : changed)
+		{
+			WADEntry& e = mEntries[index];
+			e.NewOffset = gsl::narrow<u32>(appendOffset);
+			e.NewSize = gsl::narrow<u32>(data.Size());
+			appendOffset += e.NewSize;
+		}
+
+		std::vector<size> order(mEntries.size());
+		std::iota(order.begin(), order.end(), size{ 0 });
+		std::stable_sort(order.begin(), order.end(), [this](size a, size b) {
+			return mEntries[a].NewOffset < mEntries[b].NewOffset;
+		});
+
+		std::vector<byte> table(sizeof(WADRawEntry) * mEntries.size());
+		for (size i = 0; i < order.size(); ++i)
+		{
+			const WADEntry& e = mEntries[order[i]];
+			const WADRawEntry r{ e.PathHash, e.NewOffset, e.NewSize };
+			std::memcpy(table.data() + i * sizeof(WADRawEntry), &r, sizeof(r));
+		}
+
+		// 1. data, paths and a copy of the new entry table, all past the end of the file so the
+		// current entry table never refers to them
+		for (auto& [index, data] : changed)
+		{
+			target.Seek(mEntries[index].NewOffset, StreamSeekOrigin::Begin);
+			data.CopyTo(target);
+		}
+
+		std::vector<byte> paths{};
+		for (size i : order)
+		{
+			AppendPath(paths, mEntries[i].Path);
+		}
+		target.WriteAt(paths.data(), paths.size(), appendOffset);
+
+		const WADRawJournalFooter footer{ gsl::narrow<u32>(mEntries.size()),
+										  crc32({ reinterpret_cast<const char*>(table.data()),
+												  table.size() }),
+										  JournalMagic };
+		const u64 journalOffset = appendOffset + paths.size();
+		target.WriteAt(table.data(), table.size(), journalOffset);
+		target.WriteAt(&footer, sizeof(footer), journalOffset + table.size());
+		target.Flush();
+
+		// 2. entry table, once everything it refers to is written. If this write is interrupted,
+		// loading the WAD uses the copy of the table instead.
+		target.WriteAt(table.data(), table.size(), sizeof(u32) * 2);
+		target.Flush();
+
+		// 3. the copy is not needed anymore, it must not replace the entry table if that is
+		// changed later
+		const WADRawJournalFooter cleared{};
+		target.WriteAt(&cleared, sizeof(cleared), journalOffset + table.size());
+		target.Flush();
+
+		OnSaved();
+
+		std::stable_sort(
+			mEntries.begin(), mEntries.end(), [](const WADEntry& a, const WADEntry& b) {
+				return a.Offset < b.Offset;
+			});
+		RebuildEntryIndex();
+
+		Ensures(IsSorted());
+		return true;
+	}
+
+	void WAD::OnSaved()
+	{
+		// the new offsets computed by SaveTo only exist if the WAD was rewritten, otherwise the
+		// data was copied as-is
+		const bool changed = HasChanged();
+		for (WADEntry& e : mEntries)
+		{
+			if (e.File)
+			{
+				e.File->OnSaved();
+			}
+
+			if (changed)
+			{
+				e.Offset = e.NewOffset;
+				e.Size = e.NewSize;
+			}
+			e.NewOffset = 0;
+			e.NewSize = 0;
 		}
 
 		mHasChanged = false;
+		mEntriesChanged = false;
+		mLayoutDirty = true;
+		File::OnSaved();
 	}
 
 	u64 WAD::Size()
 	{
-		// if (!HasChanged())
-		//{
-		//	return Raw()->Size();
-		//}
-
-		// TODO: hacky way to ensure child WADs also FixUpOffsets when the parent calls
-		// FixUpOffsets, otherwise the total size may be wrong. Implement common way to do this in
-		// Device or File
-		FixUpOffsets();
-
-		// TODO: maybe size should be cached?
-		size total = 0;
-		total += sizeof(u32);                       // magic
-		total += sizeof(u32);                       // entryCount
-		total += sizeof(u32) * 3 * mEntries.size(); // entries
-		for (const WADEntry& e : mEntries)
+		// unchanged WADs are copied as they are
+		if (!HasChanged())
+		{
+			return Raw().Size();
+		}
+
+		if (mLayoutDirty)
 		{
-			total += e.NewSize;                   // entry data
-			total += sizeof(u16) + e.Path.size(); // entry path
+			FixUpOffsets();
 		}
-		return total;
+		return mNewSize;
 	}
 
-	bool WAD::HasChanged() const
+	bool WAD::HasChanged() const { return mHasChanged || mEntriesChanged; }
+
+	bool WAD::GetIndexEntries(std::vector<IndexEntry>& entries)
 	{
-		return mHasChanged || std::any_of(mEntries.begin(), mEntries.end(), [](const WADEntry& e) {
-				   return e.File->HasChanged();
-			   });
+		if (!IsLoaded() || HasChanged())
+		{
+			return false;
+		}
+
+		DetectFileTypes();
+		entries.reserve(entries.size() + mEntries.size());
+		for (const WADEntry& e : mEntries)
+		{
+			entries.push_back(
+				IndexEntry{ e.PathHash, { e.Offset, e.Size, 0, 0 }, e.FileType, e.Path });
+		}
+		return true;
 	}
 
 	size WAD::GetEntryIndex(PathView path) const
@@ -243,16 +513,13 @@ namespace noire
 
 	size WAD::GetEntryIndex(size pathHash) const
 	{
-		// TODO: don't use linear search here
-		for (size i = 0; i < mEntries.size(); ++i)
+		if (pathHash > std::numeric_limits<u32>::max())
 		{
-			if (mEntries[i].PathHash == pathHash)
-			{
-				return i;
-			}
+			return static_cast<size>(-1);
 		}
 
-		return static_cast<size>(-1);
+		const u32 index = mEntryIndex.Find(static_cast<u32>(pathHash));
+		return index != HashIndex::NotFound ? index : static_cast<size>(-1);
 	}
 
 	const WADEntry& WAD::GetEntry(PathView path) const
@@ -269,7 +536,66 @@ namespace noire
 		return mEntries[index];
 	}
 
-	// TODO: FixUpOffsets is getting called more times than needed
+	size WAD::GetEntryFileType(PathView path)
+	{
+		return EntryFileType(mEntries[GetEntryIndex(path)]);
+	}
+
+	void WAD::DetectFileTypes()
+	{
+		// entries are sorted by offset, so the streams are read front to back
+		for (WADEntry& e : mEntries)
+		{
+			EntryFileType(e);
+		}
+	}
+
+	size WAD::EntryFileType(WADEntry& e)
+	{
+		if (e.FileType == File::InvalidTypeId)
+		{
+			SubStream entryStream{ Raw(), e.Offset, e.Size };
+			e.FileType = File::FindTypeOfStream(entryStream);
+		}
+
+		return e.FileType;
+	}
+
+	std::shared_ptr<File> WAD::EntryFile(WADEntry& e)
+	{
+		if (!e.File)
+		{
+			e.File = File::New(*this, Path::Root / e.Path, false, EntryFileType(e));
+		}
+
+		return e.File;
+	}
+
+	void WAD::RebuildEntryIndex()
+	{
+		mEntryIndex.Clear();
+		mEntryIndex.Reserve(mEntries.size());
+		for (size i = 0; i < mEntries.size(); ++i)
+		{
+			mEntryIndex.Insert(mEntries[i].PathHash, gsl::narrow<u32>(i));
+		}
+	}
+
+	// Must be called before the change is recorded in mHasChanged/mEntriesChanged
+	void WAD::InvalidateLayout()
+	{
+		// if the layout wasn't computed since the last change, the parent was already notified
+		// and it didn't get the new size yet either
+		const bool notifyParent = !HasChanged() || !mLayoutDirty;
+		mLayoutDirty = true;
+		if (notifyParent)
+		{
+			MarkChanged();
+		}
+	}
+
+	// Only called when the layout is dirty, the sizes of the changed entries are cached by them
+	// too, so only the modified subtrees are visited
 	void WAD::FixUpOffsets()
 	{
 		const size startingOffset = sizeof(u32) /*magic*/ + sizeof(u32) /*entryCount*/ +
@@ -278,12 +604,21 @@ namespace noire
 		for (WADEntry& e : mEntries)
 		{
 			// NOTE: writing to NewOffset/NewSize because we still need the original Offset/Size
-			// when calling Save() to open the streams at the appropriate locations
+			// when calling SaveTo() to read the unchanged entries from their original location
 			e.NewOffset = currOffset;
-			e.NewSize = gsl::narrow<u32>(e.File->Size());
+			e.NewSize = UsesEntryFile(e) ? gsl::narrow<u32>(e.File->Size()) : e.Size;
 			currOffset += e.NewSize;
 		}
 
+		u64 pathsSize = 0;
+		for (const WADEntry& e : mEntries)
+		{
+			pathsSize += sizeof(u16) + e.Path.size();
+		}
+
+		mNewSize = currOffset + pathsSize;
+		mLayoutDirty = false;
+
 		Ensures(IsSorted());
 	}
 
@@ -312,6 +647,19 @@ namespace noire
 		return magic == WAD::HeaderMagic;
 	}
 
+	static File::SignatureMatch SignatureMatcher(const File::Signature& signature)
+	{
+		if (signature.StreamSize < 8) // min required bytes
+		{
+			return File::SignatureMatch::No;
+		}
+
+		const std::optional<u32> magic = signature.U32At(0);
+		return !magic ? File::SignatureMatch::Maybe :
+						(*magic == WAD::HeaderMagic ? File::SignatureMatch::Yes :
+													  File::SignatureMatch::No);
+	}
+
 	static std::shared_ptr<File> Creator(Device& parent, PathView path, bool created)
 	{
 		return std::make_shared<WAD>(parent, path, created);
@@ -320,7 +668,8 @@ namespace noire
 	const File::TypeDefinition WAD::Type{ std::hash<std::string_view>{}("WAD"),
 										  1,
 										  &Validator,
-										  &Creator };
+										  &Creator,
+										  &SignatureMatcher };
 }
 
 // ifndef because line 'WAD& w = *wad;' gets compiler error 'illegal indirection' when
@@ -329,6 +678,254 @@ namespace noire
 TEST_SUITE("WAD")
 {
 	using namespace noire;
+	using namespace noire::test;
+
+	TEST_CASE("Save, modify and save again")
+	{
+		namespace fs = std::filesystem;
+
+		const TempDirectory temp{ "noire_wad_save_test" };
+		const fs::path& root = temp.Path;
+
+		{
+			LocalDevice d{ root };
+			auto w = std::static_pointer_cast<WAD>(d.Create("/test.wad.pc", WAD::Type.Id));
+			WriteAll(*w->Create("/a.bin", File::Type.Id), "first file");
+			WriteAll(*w->Create("/dir/b.bin", File::Type.Id), "second file");
+			auto inner = std::static_pointer_cast<WAD>(w->Create("/inner.wad.pc", WAD::Type.Id));
+			WriteAll(*inner->Create("/c.bin", File::Type.Id), "nested file");
+			d.Commit();
+		}
+
+		{
+			LocalDevice d{ root };
+			auto w = std::static_pointer_cast<WAD>(d.Open("/test.wad.pc"));
+			REQUIRE(w != nullptr);
+			w->Load();
+			WriteAll(*w->Open("/dir/b.bin"), "second file, now longer");
+			d.Commit();
+
+			// the WAD keeps working after saving, now reading from the new file
+			CHECK_FALSE(w->HasChanged());
+			CHECK_EQ(ReadAll(w->OpenStream("/a.bin")), "first file");
+			CHECK_EQ(ReadAll(w->OpenStream("/dir/b.bin")), "second file, now longer");
+			CHECK_EQ(ReadAll(w->Open("/dir/b.bin")->Raw()), "second file, now longer");
+		}
+
+		{
+			LocalDevice d{ root };
+			auto w = std::static_pointer_cast<WAD>(d.Open("/test.wad.pc"));
+			REQUIRE(w != nullptr);
+			w->Load();
+			CHECK_EQ(w->GetEntries().size(), 3);
+			CHECK_EQ(ReadAll(w->OpenStream("/a.bin")), "first file");
+			CHECK_EQ(ReadAll(w->OpenStream("/dir/b.bin")), "second file, now longer");
+
+			auto inner = std::dynamic_pointer_cast<WAD>(w->Open("/inner.wad.pc"));
+			REQUIRE(inner != nullptr);
+			inner->Load();
+			CHECK_EQ(ReadAll(inner->OpenStream("/c.bin")), "nested file");
+		}
+	}
+
+	TEST_CASE("Size follows changes in nested entries")
+	{
+		namespace fs = std::filesystem;
+
+		const TempDirectory temp{ "noire_wad_size_test" };
+		const fs::path& root = temp.Path;
+
+		{
+			LocalDevice d{ root };
+			auto w = std::static_pointer_cast<WAD>(d.Create("/test.wad.pc", WAD::Type.Id));
+			WriteAll(*w->Create("/a.bin", File::Type.Id), "first file");
+			auto inner = std::static_pointer_cast<WAD>(w->Create("/inner.wad.pc", WAD::Type.Id));
+			WriteAll(*inner->Create("/b.bin", File::Type.Id), "nested file");
+			d.Commit();
+		}
+
+		LocalDevice d{ root };
+		auto w = std::static_pointer_cast<WAD>(d.Open("/test.wad.pc"));
+		w->Load();
+		const u64 originalSize = fs::file_size(root / "test.wad.pc");
+		CHECK_EQ(w->Size(), originalSize);
+
+		auto inner = std::static_pointer_cast<WAD>(w->Open("/inner.wad.pc"));
+		inner->Load();
+		auto a = w->Open("/a.bin");
+		auto nested = inner->Open("/b.bin");
+		CHECK_FALSE(w->HasChanged());
+
+		WriteAll(*nested, "nested file, 10");
+		CHECK(inner->HasChanged());
+		CHECK(w->HasChanged());
+		CHECK_EQ(w->Size(), originalSize + 4);
+
+		// the sizes were computed already, later changes must still reach the parent
+		WriteAll(*nested, "nested file, now 20 longer");
+		CHECK_EQ(w->Size(), originalSize + 15);
+		WriteAll(*a, "first file, ten more");
+		CHECK_EQ(w->Size(), originalSize + 25);
+
+		d.Commit();
+		CHECK_EQ(fs::file_size(root / "test.wad.pc"), originalSize + 25);
+		CHECK_EQ(w->Size(), originalSize + 25);
+	}
+
+	TEST_CASE("Save in place")
+	{
+		namespace fs = std::filesystem;
+
+		const TempDirectory temp{ "noire_wad_save_in_place_test" };
+		const fs::path& root = temp.Path;
+		const fs::path wadPath = root / "test.wad.pc";
+
+		{
+			LocalDevice d{ root };
+			auto w = std::static_pointer_cast<WAD>(d.Create("/test.wad.pc", WAD::Type.Id));
+			WriteAll(*w->Create("/a.bin", File::Type.Id), "first file");
+			WriteAll(*w->Create("/b.bin", File::Type.Id), "second file");
+			WriteAll(*w->Create("/c.bin", File::Type.Id), "third file");
+			d.Commit();
+		}
+		const u64 originalSize = fs::file_size(wadPath);
+
+		SUBCASE("Current data is not overwritten")
+		{
+			const std::string original = ReadFile(wadPath);
+
+			LocalDevice d{ root };
+			d.EnableInPlaceCommit(true);
+			auto w = std::static_pointer_cast<WAD>(d.Open("/test.wad.pc"));
+			w->Load();
+			WriteAll(*w->Open("/a.bin"), "FIRST");
+			WriteAll(*w->Open("/c.bin"), "THIRD FILE");
+			d.Commit();
+
+			// only the entry table changes
+			const std::string saved = ReadFile(wadPath);
+			const size tableEnd = sizeof(u32) * 2 + sizeof(WADRawEntry) * 3;
+			REQUIRE(saved.size() > original.size());
+			CHECK_EQ(saved.substr(0, sizeof(u32) * 2), original.substr(0, sizeof(u32) * 2));
+			CHECK_EQ(saved.substr(tableEnd, original.size() - tableEnd),
+					 original.substr(tableEnd));
+			CHECK_EQ(ReadAll(w->OpenStream("/a.bin")), "FIRST file");
+			CHECK_EQ(ReadAll(w->OpenStream("/c.bin")), "THIRD FILE");
+		}
+
+		SUBCASE("Interrupted entry table write")
+		{
+			{
+				LocalDevice d{ root };
+				d.EnableInPlaceCommit(true);
+				auto w = std::static_pointer_cast<WAD>(d.Open("/test.wad.pc"));
+				w->Load();
+				WriteAll(*w->Open("/c.bin"), "THIRD FILE");
+				d.Commit();
+			}
+
+			// the footer of the copy of the table is cleared once the entry table is written
+			CHECK_NE(ReadFile(wadPath).substr(fs::file_size(wadPath) - sizeof(u32)),
+					 std::string(reinterpret_cast<const char*>(&JournalMagic), sizeof(u32)));
+
+			// the entry table is left half written, before the footer was cleared
+			{
+				const std::string saved = ReadFile(wadPath);
+				const size tableSize = sizeof(WADRawEntry) * 3;
+				const std::string_view copy{ saved.data() + saved.size() -
+												 sizeof(WADRawJournalFooter) - tableSize,
+											 tableSize };
+				const WADRawJournalFooter footer{ 3, crc32(copy), JournalMagic };
+
+				std::fstream f{ wadPath, std::ios::binary | std::ios::in | std::ios::out };
+				f.seekp(sizeof(u32) * 2 + sizeof(WADRawEntry) + 2);
+				const std::string garbage(sizeof(WADRawEntry), '\xFF');
+				f.write(garbage.data(), garbage.size());
+				f.seekp(-static_cast<std::streamoff>(sizeof(footer)), std::ios::end);
+				f.write(reinterpret_cast<const char*>(&footer), sizeof(footer));
+			}
+
+			LocalDevice d{ root };
+			auto w = std::static_pointer_cast<WAD>(d.Open("/test.wad.pc"));
+			w->Load();
+			CHECK_EQ(ReadAll(w->OpenStream("/c.bin")), "THIRD FILE");
+		}
+
+		SUBCASE("Entries that are moved to the end")
+		{
+			LocalDevice d{ root };
+			d.EnableInPlaceCommit(true);
+			auto w = std::static_pointer_cast<WAD>(d.Open("/test.wad.pc"));
+			w->Load();
+			WriteAll(*w->Open("/a.bin"), "first file, now longer");
+			d.Commit();
+
+			CHECK(fs::file_size(wadPath) > originalSize);
+			CHECK_EQ(w->GetEntries().back().Path, "a.bin");
+			CHECK_EQ(ReadAll(w->OpenStream("/a.bin")), "first file, now longer");
+			CHECK_EQ(ReadAll(w->OpenStream("/b.bin")), "second file");
+		}
+
+		SUBCASE("Added entries rewrite the archive")
+		{
+			LocalDevice d{ root };
+			d.EnableInPlaceCommit(true);
+			auto w = std::static_pointer_cast<WAD>(d.Open("/test.wad.pc"));
+			w->Load();
+			WriteAll(*w->Create("/d.bin", File::Type.Id), "fourth file");
+			d.Commit();
+
+			CHECK_EQ(w->GetEntries().size(), 4);
+		}
+
+		{
+			LocalDevice d{ root };
+			auto w = std::static_pointer_cast<WAD>(d.Open("/test.wad.pc"));
+			w->Load();
+			for (const WADEntry& e : w->GetEntries())
+			{
+				CHECK_EQ(ReadAll(w->OpenStream(Path::Root / e.Path)),
+						 ReadAll(w->Open(Path::Root / e.Path)->Raw()));
+			}
+			CHECK_EQ(ReadAll(w->OpenStream("/b.bin")), "second file");
+		}
+	}
+
+	TEST_CASE("Save in place writes the WAD again once there is too much unused space")
+	{
+		namespace fs = std::filesystem;
+
+		const TempDirectory temp{ "noire_wad_dead_space_test" };
+		const fs::path& root = temp.Path;
+		const fs::path wadPath = root / "test.wad.pc";
+
+		const std::string big(gsl::narrow<size>(WAD::InPlaceDeadSpaceLimit / 2 + 1000), 'x');
+		{
+			LocalDevice d{ root };
+			auto w = std::static_pointer_cast<WAD>(d.Create("/test.wad.pc", WAD::Type.Id));
+			WriteAll(*w->Create("/a.bin", File::Type.Id), big);
+			WriteAll(*w->Create("/b.bin", File::Type.Id), "second file");
+			d.Commit();
+		}
+		const u64 originalSize = fs::file_size(wadPath);
+
+		LocalDevice d{ root };
+		d.EnableInPlaceCommit(true);
+		auto w = std::static_pointer_cast<WAD>(d.Open("/test.wad.pc"));
+		w->Load();
+
+		// the old data is left behind
+		WriteAll(*w->Open("/a.bin"), "X");
+		d.Commit();
+		CHECK(fs::file_size(wadPath) > originalSize + big.size());
+
+		// it would pass the limit now
+		WriteAll(*w->Open("/a.bin"), "Y");
+		d.Commit();
+		CHECK_EQ(fs::file_size(wadPath), originalSize);
+		CHECK_EQ(ReadAll(w->OpenStream("/a.bin")), "Y" + big.substr(1));
+		CHECK_EQ(ReadAll(w->OpenStream("/b.bin")), "second file");
+	}
 
 	TEST_CASE("Load/Delete/Create/Save" * doctest::skip(true))
 	{
@@ -452,7 +1049,8 @@ TEST_SUITE("WAD")
 					const Path fullPath = Path{ parent } / e.Path;
 					std::cout << "'" << fullPath.String() << "'\n";
 
-					if (std::shared_ptr<WAD> c = std::dynamic_pointer_cast<WAD>(e.File))
+					if (std::shared_ptr<WAD> c =
+							std::dynamic_pointer_cast<WAD>(w.Open(Path::Root / e.Path)))
 					{
 						traverse(*c, fullPath);
 					}
@@ -1,6 +1,7 @@
 #pragma once
 #include "Common.h"
 #include "File.h"
+#include "HashIndex.h"
 #include "VFS.h"
 #include "devices/Device.h"
 #include <memory>
@@ -16,8 +17,8 @@ namespace noire
 		u32 PathHash;
 		u32 Offset;
 		u32 Size;
-		std::shared_ptr<File> File;
-		size FileType;
+		std::shared_ptr<noire::File> File; // nullptr until the entry is opened
+		size FileType;                     // InvalidTypeId until the type is detected
 		u32 NewOffset;
 		u32 NewSize;
 
@@ -27,7 +28,7 @@ namespace noire
 			  Offset{ 0 },
 			  Size{ 0 },
 			  File{ nullptr },
-			  FileType{ File::InvalidTypeId },
+			  FileType{ noire::File::InvalidTypeId },
 			  NewOffset{ 0 },
 			  NewSize{ 0 }
 		{
@@ -39,7 +40,7 @@ namespace noire
 			  Offset{ offset },
 			  Size{ size },
 			  File{ nullptr },
-			  FileType{ File::InvalidTypeId },
+			  FileType{ noire::File::InvalidTypeId },
 			  NewOffset{ 0 },
 			  NewSize{ 0 }
 		{
@@ -60,14 +61,27 @@ namespace noire
 				   PathView path,
 				   bool recursive) override;
 		ReadOnlyStream OpenStream(PathView path) override;
+		void OnFileChanged(File& file) override;
 
 	protected:
 		void LoadImpl() override;
+		bool LoadFromIndexImpl(gsl::span<const IndexEntry> entries) override;
 
 	public:
-		void Save() override;
+		void SaveTo(Stream& output) override;
+		void OnSaved() override;
+		// Changed entries are appended at the end of the archive, followed by the paths and a copy
+		// of the new entry table, then the entry table is overwritten. The current data is never
+		// overwritten, and loading uses the copy if the entry table was left half written, so the
+		// archive stays valid if interrupted. The space of the old data is not reused, once it
+		// would pass InPlaceDeadSpaceLimit and a quarter of the archive, false is returned so the
+		// WAD is written again. Not possible if entries were added or removed.
+		bool SaveInPlace(Stream& target) override;
 		u64 Size() override;
 		bool HasChanged() const override;
+		// Stores the entries and their types, detecting the types not known yet. Nothing is
+		// stored if the WAD has changes that are not saved.
+		bool GetIndexEntries(std::vector<IndexEntry>& entries) override;
 
 		size GetEntryIndex(PathView path) const;
 		size GetEntryIndex(size pathHash) const;
@@ -75,16 +89,31 @@ namespace noire
 		const WADEntry& GetEntry(size pathHash) const;
 		const std::vector<WADEntry>& GetEntries() const { return mEntries; }
 
+		// Returns the type of the file, detecting it if it wasn't known yet.
+		size GetEntryFileType(PathView path);
+		// Detects the type of all the entries, reading their data in file order. Types are
+		// otherwise detected one at a time as entries are opened.
+		void DetectFileTypes();
+
 	private:
+		size EntryFileType(WADEntry& e);
+		std::shared_ptr<File> EntryFile(WADEntry& e);
+		void InvalidateLayout();
 		void FixUpOffsets();
 		bool IsSorted() const;
+		void RebuildEntryIndex();
 
 		std::vector<WADEntry> mEntries;
+		HashIndex mEntryIndex; // PathHash -> index in mEntries
 		VirtualFileSystem mVFS; // VFS entry info refers to PathHash of the WADEntry
-		bool mHasChanged;
+		bool mHasChanged;     // entries were added or removed
+		bool mEntriesChanged; // an opened entry was modified
+		bool mLayoutDirty;    // the NewOffset/NewSize of the entries and mNewSize are outdated
+		u64 mNewSize;         // size of the WAD once saved
 
 	public:
 		static constexpr u32 HeaderMagic{ 0x01444157 }; // WAD\01
+		static constexpr u64 InPlaceDeadSpaceLimit{ 1024 * 1024 };
 		static const TypeDefinition Type;
 	};
 }
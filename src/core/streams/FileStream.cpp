@@ -1,26 +1,38 @@
 #include "FileStream.h"
+#include <algorithm>
 #include <cstring>
 #include <doctest/doctest.h>
 #include <iostream>
 #include <iterator>
+#include <thread>
 #include <utility>
+#include <vector>
+#ifndef _WIN32
+#include <cerrno>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
 
 namespace noire
 {
+#ifdef _WIN32
 	FileStream::FileStream(std::filesystem::path path)
 		: mPath{ std::move(path) },
 		  mHandle{ CreateFileW(mPath.native().c_str(),
 							   FILE_GENERIC_READ | FILE_GENERIC_WRITE,
-							   FILE_SHARE_READ,
+							   FILE_SHARE_READ | FILE_SHARE_WRITE,
 							   nullptr,
 							   OPEN_ALWAYS,
 							   FILE_ATTRIBUTE_NORMAL,
-							   nullptr) }
+							   nullptr) },
+		  mPosition{ 0 }
 	{
 		Ensures(mHandle != INVALID_HANDLE_VALUE);
 	}
 
-	FileStream::FileStream(TempFileTag) : mHandle{ INVALID_HANDLE_VALUE }, mPath{}
+	FileStream::FileStream(TempFileTag)
+		: mPath{}, mHandle{ INVALID_HANDLE_VALUE }, mPosition{ 0 }
 	{
 		if (wchar_t tempPath[MAX_PATH]; GetTempPathW(std::size(tempPath), tempPath))
 		{
@@ -42,7 +54,8 @@ namespace noire
 
 	FileStream::FileStream(FileStream&& other) noexcept
 		: mPath{ std::move(other.mPath) },
-		  mHandle{ std::exchange(other.mHandle, INVALID_HANDLE_VALUE) }
+		  mHandle{ std::exchange(other.mHandle, INVALID_HANDLE_VALUE) },
+		  mPosition{ std::exchange(other.mPosition, 0) }
 	{
 	}
 
@@ -60,37 +73,23 @@ namespace noire
 		{
 			mPath = std::move(other.mPath);
 			mHandle = std::exchange(other.mHandle, INVALID_HANDLE_VALUE);
+			mPosition = std::exchange(other.mPosition, 0);
 		}
 
 		return *this;
 	}
 
-	u64 FileStream::Read(void* dstBuffer, u64 count)
-	{
-		// NOTE: limited to 4gb
-		if (DWORD bytesRead;
-			ReadFile(mHandle, dstBuffer, gsl::narrow<DWORD>(count), &bytesRead, nullptr))
-		{
-			return bytesRead;
-		}
-		else
-		{
-			return static_cast<u64>(0);
-		}
-	}
-
 	u64 FileStream::ReadAt(void* dstBuffer, u64 count, u64 offset)
 	{
+		// explicit offset, the file pointer is ignored so concurrent reads don't interfere
 		OVERLAPPED ol = { 0 };
 		ol.Offset = static_cast<DWORD>(offset);
 		ol.OffsetHigh = static_cast<DWORD>(offset >> 32);
 
 		// NOTE: limited to 4gb
-		const u64 oldPos = Tell();
 		if (DWORD bytesRead;
 			ReadFile(mHandle, dstBuffer, gsl::narrow<DWORD>(count), &bytesRead, &ol))
 		{
-			Seek(gsl::narrow<i64>(oldPos), StreamSeekOrigin::Begin);
 			return bytesRead;
 		}
 		else
@@ -99,11 +98,15 @@ namespace noire
 		}
 	}
 
-	u64 FileStream::Write(const void* buffer, u64 count)
+	u64 FileStream::WriteAt(const void* buffer, u64 count, u64 offset)
 	{
+		OVERLAPPED ol = { 0 };
+		ol.Offset = static_cast<DWORD>(offset);
+		ol.OffsetHigh = static_cast<DWORD>(offset >> 32);
+
 		// NOTE: limited to 4gb
 		if (DWORD bytesWritten;
-			WriteFile(mHandle, buffer, gsl::narrow<DWORD>(count), &bytesWritten, nullptr))
+			WriteFile(mHandle, buffer, gsl::narrow<DWORD>(count), &bytesWritten, &ol))
 		{
 			return bytesWritten;
 		}
@@ -114,72 +117,171 @@ namespace noire
 		}
 	}
 
-	u64 FileStream::WriteAt(const void* buffer, u64 count, u64 offset)
+	u64 FileStream::Size()
 	{
-		OVERLAPPED ol = { 0 };
-		ol.Offset = static_cast<DWORD>(offset);
-		ol.OffsetHigh = static_cast<DWORD>(offset >> 32);
-
-		// NOTE: limited to 4gb
-		const u64 oldPos = Tell();
-		if (DWORD bytesWritten;
-			WriteFile(mHandle, buffer, gsl::narrow<DWORD>(count), &bytesWritten, &ol))
+		if (LARGE_INTEGER fsize; GetFileSizeEx(mHandle, &fsize))
 		{
-			Seek(gsl::narrow<i64>(oldPos), StreamSeekOrigin::Begin);
-			return bytesWritten;
+			return static_cast<u64>(fsize.QuadPart);
 		}
 		else
 		{
-			return static_cast<u64>(0);
+			return static_cast<u64>(-1);
 		}
 	}
 
-	u64 FileStream::Seek(i64 offset, StreamSeekOrigin origin)
+	void FileStream::Flush() { Ensures(FlushFileBuffers(mHandle)); }
+#else
+	FileStream::FileStream(std::filesystem::path path)
+		: mPath{ std::move(path) },
+		  mHandle{ open(mPath.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644) },
+		  mPosition{ 0 }
 	{
-		DWORD moveMethod;
-		switch (origin)
-		{
-		case StreamSeekOrigin::Begin: moveMethod = FILE_BEGIN; break;
-		case StreamSeekOrigin::Current: moveMethod = FILE_CURRENT; break;
-		case StreamSeekOrigin::End: moveMethod = FILE_END; break;
-		default: Expects(false);
-		}
+		Ensures(mHandle != -1);
+	}
 
-		LARGE_INTEGER o;
-		o.QuadPart = offset;
-		if (LARGE_INTEGER newPos; SetFilePointerEx(mHandle, o, &newPos, moveMethod))
+	FileStream::FileStream(TempFileTag)
+		: mPath{ std::filesystem::temp_directory_path() }, mHandle{ -1 }, mPosition{ 0 }
+	{
+#ifdef O_TMPFILE
+		// unnamed file in the temp directory, it is deleted once closed
+		mHandle = open(mPath.c_str(), O_TMPFILE | O_RDWR | O_CLOEXEC, 0600);
+		if (mHandle == -1)
+#endif
 		{
-			return static_cast<u64>(newPos.QuadPart);
+			// O_TMPFILE not supported, create a file and remove its name right away
+			std::string fileName = (mPath / "noiXXXXXX").string();
+			mHandle = mkostemp(fileName.data(), O_CLOEXEC);
+			if (mHandle != -1)
+			{
+				unlink(fileName.c_str());
+				mPath = fileName;
+			}
 		}
-		else
+
+		Ensures(mHandle != -1);
+	}
+
+	FileStream::FileStream(FileStream&& other) noexcept
+		: mPath{ std::move(other.mPath) },
+		  mHandle{ std::exchange(other.mHandle, -1) },
+		  mPosition{ std::exchange(other.mPosition, 0) }
+	{
+	}
+
+	FileStream::~FileStream()
+	{
+		if (mHandle != -1)
 		{
-			return static_cast<u64>(-1);
+			close(mHandle);
 		}
 	}
 
-	u64 FileStream::Tell()
+	FileStream& FileStream::operator=(FileStream&& other) noexcept
 	{
-		if (LARGE_INTEGER pos; SetFilePointerEx(mHandle, { 0 }, &pos, FILE_CURRENT))
+		if (this != &other)
 		{
-			return static_cast<u64>(pos.QuadPart);
+			if (mHandle != -1)
+			{
+				close(mHandle);
+			}
+
+			mPath = std::move(other.mPath);
+			mHandle = std::exchange(other.mHandle, -1);
+			mPosition = std::exchange(other.mPosition, 0);
 		}
-		else
+
+		return *this;
+	}
+
+	// Calls 'op' until 'count' bytes are transferred, the end of the file is reached or an error
+	// occurs. Returns the number of bytes transferred.
+	template<class TOp>
+	static u64 TransferAll(u64 count, TOp op)
+	{
+		u64 total = 0;
+		while (total < count)
 		{
-			return static_cast<u64>(-1);
+			const ssize_t n = op(total, static_cast<size_t>(count - total));
+			if (n > 0)
+			{
+				total += static_cast<u64>(n);
+			}
+			else if (n == -1 && errno == EINTR)
+			{
+				continue;
+			}
+			else
+			{
+				break;
+			}
 		}
+
+		return total;
+	}
+
+	u64 FileStream::ReadAt(void* dstBuffer, u64 count, u64 offset)
+	{
+		return TransferAll(count, [this, dstBuffer, offset](u64 done, size_t remaining) {
+			return pread(mHandle,
+						 static_cast<u8*>(dstBuffer) + done,
+						 remaining,
+						 gsl::narrow<off_t>(offset + done));
+		});
+	}
+
+	u64 FileStream::WriteAt(const void* buffer, u64 count, u64 offset)
+	{
+		return TransferAll(count, [this, buffer, offset](u64 done, size_t remaining) {
+			return pwrite(mHandle,
+						  static_cast<const u8*>(buffer) + done,
+						  remaining,
+						  gsl::narrow<off_t>(offset + done));
+		});
 	}
 
 	u64 FileStream::Size()
 	{
-		if (LARGE_INTEGER fsize; GetFileSizeEx(mHandle, &fsize))
+		struct stat st;
+		return fstat(mHandle, &st) == 0 ? static_cast<u64>(st.st_size) : static_cast<u64>(-1);
+	}
+
+	void FileStream::Flush() { Ensures(fsync(mHandle) == 0); }
+#endif
+
+	u64 FileStream::Read(void* dstBuffer, u64 count)
+	{
+		const u64 read = ReadAt(dstBuffer, count, mPosition);
+		mPosition += read;
+		return read;
+	}
+
+	u64 FileStream::Write(const void* buffer, u64 count)
+	{
+		const u64 written = WriteAt(buffer, count, mPosition);
+		mPosition += written;
+		return written;
+	}
+
+	u64 FileStream::Seek(i64 offset, StreamSeekOrigin origin)
+	{
+		switch (origin)
 		{
-			return static_cast<u64>(fsize.QuadPart);
+		case StreamSeekOrigin::Begin: break;
+		case StreamSeekOrigin::Current: offset += mPosition; break;
+		case StreamSeekOrigin::End: offset += Size(); break;
+		default: Expects(false);
 		}
-		else
+
+		if (offset < 0)
 		{
 			return static_cast<u64>(-1);
 		}
+
+		mPosition = static_cast<u64>(offset);
+		return mPosition;
 	}
+
+	u64 FileStream::Tell() { return mPosition; }
 }
 
 TEST_SUITE("FileStream")
@@ -227,6 +329,19 @@ TEST_SUITE("FileStream")
 
 			CHECK_EQ(std::memcmp(readData, data, std::size(readData)), 0);
 		}
+
+		{
+			// not in memory, copied to the buffer
+			std::vector<byte> buffer{};
+			const gsl::span<const byte> block = f.ReadContiguous(2, 8, buffer);
+			CHECK_EQ(block.size(), 8);
+			CHECK_EQ(block.data(), buffer.data());
+			CHECK_EQ(std::to_integer<u8>(block[0]), 7);
+			CHECK_EQ(std::to_integer<u8>(block[7]), 0);
+
+			// truncated at the end of the file
+			CHECK_EQ(f.ReadContiguous(8, 8, buffer).size(), 4);
+		}
 #endif // !DOCTEST_CONFIG_DISABLE
 	}
 
@@ -237,7 +352,7 @@ TEST_SUITE("FileStream")
 			FileStream f{ p };
 			TestStream(f);
 		}
-		DeleteFileW(p.native().c_str());
+		std::filesystem::remove(p);
 	}
 
 	TEST_CASE("Temp files")
@@ -245,4 +360,49 @@ TEST_SUITE("FileStream")
 		FileStream f{ TempFile };
 		TestStream(f);
 	}
+
+	TEST_CASE("Concurrent ReadAt")
+	{
+		constexpr u64 ChunkSize{ 0x1000 };
+		constexpr u64 ChunkCount{ 8 };
+
+		FileStream f{ TempFile };
+		for (u64 i = 0; i < ChunkCount; i++)
+		{
+			const std::vector<u8> chunk(ChunkSize, static_cast<u8>(i));
+			f.Write(chunk.data(), chunk.size());
+		}
+		f.Seek(0, StreamSeekOrigin::Begin);
+
+		// each thread reads its own chunk through a SubStream, as done when extracting entries
+		std::vector<u64> mismatches(ChunkCount, 0);
+		std::vector<std::thread> threads{};
+		for (u64 i = 0; i < ChunkCount; i++)
+		{
+			threads.emplace_back([&f, &mismatches, i]() {
+				SubStream s{ f, i * ChunkSize, ChunkSize };
+				std::vector<u8> buffer(ChunkSize);
+				for (int iteration = 0; iteration < 64; iteration++)
+				{
+					if (s.ReadAt(buffer.data(), buffer.size(), 0) != ChunkSize ||
+						std::count(buffer.begin(), buffer.end(), static_cast<u8>(i)) !=
+							static_cast<ptrdiff>(ChunkSize))
+					{
+						mismatches[i]++;
+					}
+				}
+			});
+		}
+
+		for (std::thread& t : threads)
+		{
+			t.join();
+		}
+
+		for (u64 i = 0; i < ChunkCount; i++)
+		{
+			CHECK_EQ(mismatches[i], 0);
+		}
+		CHECK_EQ(f.Tell(), 0);
+	}
 }
@@ -1,8 +1,10 @@
 #pragma once
 #include "Common.h"
 #include "Stream.h"
-#include <Windows.h>
 #include <filesystem>
+#ifdef _WIN32
+#include <Windows.h>
+#endif
 
 namespace noire
 {
@@ -12,6 +14,9 @@ namespace noire
 	};
 	inline constexpr TempFileTag TempFile{};
 
+	// Stream backed by a file on disk. The stream position is tracked here instead of using the
+	// file pointer, ReadAt/WriteAt always pass an explicit offset to the system so they can be used
+	// from several threads at the same time.
 	class FileStream final : public Stream
 	{
 	public:
@@ -37,10 +42,18 @@ namespace noire
 
 		u64 Size() override;
 
+		// Blocks until the written data reaches the disk
+		void Flush() override;
+
 		const std::filesystem::path& Path() const { return mPath; }
 
 	private:
 		std::filesystem::path mPath;
+#ifdef _WIN32
 		HANDLE mHandle;
+#else
+		int mHandle;
+#endif
+		u64 mPosition;
 	};
 }
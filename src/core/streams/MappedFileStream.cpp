@@ -0,0 +1,291 @@
+#include "MappedFileStream.h"
+#include "FileStream.h"
+#include <algorithm>
+#include <cstring>
+#include <doctest/doctest.h>
+#include <iterator>
+#include <utility>
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace noire
+{
+#ifdef _WIN32
+	MappedFileStream::MappedFileStream(std::filesystem::path path)
+		: mPath{ std::move(path) },
+		  mFileHandle{ CreateFileW(mPath.native().c_str(),
+								   GENERIC_READ,
+								   FILE_SHARE_READ | FILE_SHARE_WRITE,
+								   nullptr,
+								   OPEN_EXISTING,
+								   FILE_ATTRIBUTE_NORMAL,
+								   nullptr) },
+		  mMappingHandle{ nullptr },
+		  mData{ nullptr },
+		  mSize{ 0 },
+		  mPosition{ 0 }
+	{
+		Ensures(mFileHandle != INVALID_HANDLE_VALUE);
+
+		LARGE_INTEGER fsize;
+		Ensures(GetFileSizeEx(mFileHandle, &fsize));
+		mSize = static_cast<u64>(fsize.QuadPart);
+		Ensures(mSize <= MaxMappedSize);
+
+		// empty files cannot be mapped, nothing will be read from them anyway
+		if (mSize != 0)
+		{
+			mMappingHandle = CreateFileMappingW(mFileHandle, nullptr, PAGE_READONLY, 0, 0, nullptr);
+			Ensures(mMappingHandle != nullptr);
+
+			mData = reinterpret_cast<const byte*>(
+				MapViewOfFile(mMappingHandle, FILE_MAP_READ, 0, 0, 0));
+			Ensures(mData != nullptr);
+		}
+	}
+
+	MappedFileStream::MappedFileStream(MappedFileStream&& other) noexcept
+		: mPath{ std::move(other.mPath) },
+		  mFileHandle{ std::exchange(other.mFileHandle, INVALID_HANDLE_VALUE) },
+		  mMappingHandle{ std::exchange(other.mMappingHandle, nullptr) },
+		  mData{ std::exchange(other.mData, nullptr) },
+		  mSize{ std::exchange(other.mSize, 0) },
+		  mPosition{ std::exchange(other.mPosition, 0) }
+	{
+	}
+
+	MappedFileStream::~MappedFileStream() { Close(); }
+
+	MappedFileStream& MappedFileStream::operator=(MappedFileStream&& other) noexcept
+	{
+		if (this != &other)
+		{
+			Close();
+
+			mPath = std::move(other.mPath);
+			mFileHandle = std::exchange(other.mFileHandle, INVALID_HANDLE_VALUE);
+			mMappingHandle = std::exchange(other.mMappingHandle, nullptr);
+			mData = std::exchange(other.mData, nullptr);
+			mSize = std::exchange(other.mSize, 0);
+			mPosition = std::exchange(other.mPosition, 0);
+		}
+
+		return *this;
+	}
+
+	void MappedFileStream::Close()
+	{
+		if (mData)
+		{
+			UnmapViewOfFile(mData);
+			mData = nullptr;
+		}
+
+		if (mMappingHandle)
+		{
+			CloseHandle(mMappingHandle);
+			mMappingHandle = nullptr;
+		}
+
+		if (mFileHandle != INVALID_HANDLE_VALUE)
+		{
+			CloseHandle(mFileHandle);
+			mFileHandle = INVALID_HANDLE_VALUE;
+		}
+	}
+#else
+	MappedFileStream::MappedFileStream(std::filesystem::path path)
+		: mPath{ std::move(path) },
+		  mFileHandle{ open(mPath.c_str(), O_RDONLY | O_CLOEXEC) },
+		  mData{ nullptr },
+		  mSize{ 0 },
+		  mPosition{ 0 }
+	{
+		Ensures(mFileHandle != -1);
+
+		struct stat st;
+		Ensures(fstat(mFileHandle, &st) == 0);
+		mSize = static_cast<u64>(st.st_size);
+		Ensures(mSize <= MaxMappedSize);
+
+		// empty files cannot be mapped, nothing will be read from them anyway
+		if (mSize != 0)
+		{
+			void* data =
+				mmap(nullptr, gsl::narrow<size>(mSize), PROT_READ, MAP_SHARED, mFileHandle, 0);
+			Ensures(data != MAP_FAILED);
+
+			mData = reinterpret_cast<const byte*>(data);
+		}
+	}
+
+	MappedFileStream::MappedFileStream(MappedFileStream&& other) noexcept
+		: mPath{ std::move(other.mPath) },
+		  mFileHandle{ std::exchange(other.mFileHandle, -1) },
+		  mData{ std::exchange(other.mData, nullptr) },
+		  mSize{ std::exchange(other.mSize, 0) },
+		  mPosition{ std::exchange(other.mPosition, 0) }
+	{
+	}
+
+	MappedFileStream::~MappedFileStream() { Close(); }
+
+	MappedFileStream& MappedFileStream::operator=(MappedFileStream&& other) noexcept
+	{
+		if (this != &other)
+		{
+			Close();
+
+			mPath = std::move(other.mPath);
+			mFileHandle = std::exchange(other.mFileHandle, -1);
+			mData = std::exchange(other.mData, nullptr);
+			mSize = std::exchange(other.mSize, 0);
+			mPosition = std::exchange(other.mPosition, 0);
+		}
+
+		return *this;
+	}
+
+	void MappedFileStream::Close()
+	{
+		if (mData)
+		{
+			munmap(const_cast<byte*>(mData), gsl::narrow<size>(mSize));
+			mData = nullptr;
+		}
+
+		if (mFileHandle != -1)
+		{
+			close(mFileHandle);
+			mFileHandle = -1;
+		}
+	}
+#endif
+
+	u64 MappedFileStream::Read(void* dstBuffer, u64 count)
+	{
+		const u64 read = ReadAt(dstBuffer, count, mPosition);
+		mPosition += read;
+		return read;
+	}
+
+	u64 MappedFileStream::ReadAt(void* dstBuffer, u64 count, u64 offset)
+	{
+		if (offset < mSize)
+		{
+			const size bytesToRead = gsl::narrow<size>(std::min(count, mSize - offset));
+			std::memcpy(dstBuffer, mData + offset, bytesToRead);
+			return bytesToRead;
+		}
+		else
+		{
+			return 0;
+		}
+	}
+
+	u64 MappedFileStream::Write(const void*, u64) { return 0; }
+
+	u64 MappedFileStream::WriteAt(const void*, u64, u64) { return 0; }
+
+	u64 MappedFileStream::Seek(i64 offset, StreamSeekOrigin origin)
+	{
+		switch (origin)
+		{
+		case StreamSeekOrigin::Begin: break;
+		case StreamSeekOrigin::Current: offset += mPosition; break;
+		case StreamSeekOrigin::End: offset += mSize; break;
+		default: Expects(false);
+		}
+
+		mPosition = gsl::narrow<u64>(std::clamp<i64>(offset, 0, mSize));
+
+		return mPosition;
+	}
+
+	u64 MappedFileStream::Tell() { return mPosition; }
+
+	u64 MappedFileStream::Size() { return mSize; }
+
+	gsl::span<const byte> MappedFileStream::TryGetContiguous(u64 offset, u64 count)
+	{
+		if (offset > mSize || count > (mSize - offset))
+		{
+			return {};
+		}
+
+		return { mData + offset, gsl::narrow<ptrdiff>(count) };
+	}
+}
+
+TEST_SUITE("MappedFileStream")
+{
+	using namespace noire;
+
+	TEST_CASE("Read")
+	{
+		const std::filesystem::path p{ "test_mapped" };
+		{
+			FileStream f{ p };
+			u8 data[]{ 0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11 };
+			CHECK_EQ(f.Write(data, std::size(data)), std::size(data));
+		}
+
+		{
+			MappedFileStream m{ p };
+			CHECK_EQ(m.Size(), 12);
+			CHECK_EQ(m.Tell(), 0);
+
+			u8 readData[8]{ 0 };
+			u8 expectedReadData[8]{ 0, 1, 2, 3, 4, 5, 6, 7 };
+			CHECK_EQ(m.Read(readData, std::size(readData)), std::size(readData));
+			CHECK_EQ(std::memcmp(readData, expectedReadData, std::size(readData)), 0);
+			CHECK_EQ(m.Tell(), 8);
+
+			// reads past the end are truncated
+			u8 expectedTailData[4]{ 8, 9, 10, 11 };
+			CHECK_EQ(m.Read(readData, std::size(readData)), 4);
+			CHECK_EQ(std::memcmp(readData, expectedTailData, std::size(expectedTailData)), 0);
+			CHECK_EQ(m.Tell(), 12);
+
+			u8 expectedReadAtData[8]{ 2, 3, 4, 5, 6, 7, 8, 9 };
+			CHECK_EQ(m.ReadAt(readData, std::size(readData), 2), std::size(readData));
+			CHECK_EQ(std::memcmp(readData, expectedReadAtData, std::size(readData)), 0);
+			CHECK_EQ(m.Tell(), 12);
+			CHECK_EQ(m.ReadAt(readData, std::size(readData), 0x100), 0);
+
+			CHECK_EQ(m.Seek(-4, StreamSeekOrigin::End), 8);
+			CHECK_EQ(m.Read(readData, 1), 1);
+			CHECK_EQ(readData[0], 8);
+
+			u8 data[]{ 0xFF };
+			CHECK_EQ(m.Write(data, std::size(data)), 0);
+			CHECK_EQ(m.WriteAt(data, std::size(data), 0), 0);
+			CHECK_EQ(m.Size(), 12);
+		}
+
+		std::filesystem::remove(p);
+	}
+
+	TEST_CASE("Empty file")
+	{
+		const std::filesystem::path p{ "test_mapped_empty" };
+		{
+			FileStream f{ p };
+		}
+
+		{
+			MappedFileStream m{ p };
+			CHECK_EQ(m.Size(), 0);
+
+			u8 readData[8]{ 0 };
+			CHECK_EQ(m.Read(readData, std::size(readData)), 0);
+			CHECK_EQ(m.ReadAt(readData, std::size(readData), 0), 0);
+		}
+
+		std::filesystem::remove(p);
+	}
+}
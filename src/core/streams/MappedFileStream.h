@@ -0,0 +1,61 @@
+#pragma once
+#include "Common.h"
+#include "Stream.h"
+#include <filesystem>
+#ifdef _WIN32
+#include <Windows.h>
+#endif
+
+namespace noire
+{
+	// Read-only stream that maps the whole file into memory. Once opened, reads are copies from the
+	// mapping and don't need any system call. The mapping is backed by the system page cache, so it
+	// is shared with any other process that maps the same file.
+	class MappedFileStream final : public Stream
+	{
+	public:
+		// Files bigger than this cannot be mapped, in 32-bit builds there isn't enough address
+		// space to map the big archives.
+		static constexpr u64 MaxMappedSize{ sizeof(void*) >= 8 ? ~u64{ 0 } : 0x40000000 }; // 1GiB
+
+		MappedFileStream(std::filesystem::path path);
+		~MappedFileStream() override;
+
+		MappedFileStream(const MappedFileStream&) = delete;
+		MappedFileStream(MappedFileStream&&) noexcept;
+
+		MappedFileStream& operator=(const MappedFileStream&) = delete;
+		MappedFileStream& operator=(MappedFileStream&&) noexcept;
+
+		u64 Read(void* dstBuffer, u64 count) override;
+		u64 ReadAt(void* dstBuffer, u64 count, u64 offset) override;
+
+		// Write/WriteAt do nothing and always return 0 bytes written.
+		u64 Write(const void* buffer, u64 count) override;
+		u64 WriteAt(const void* buffer, u64 count, u64 offset) override;
+
+		u64 Seek(i64 offset, StreamSeekOrigin origin) override;
+
+		u64 Tell() override;
+
+		u64 Size() override;
+
+		gsl::span<const byte> TryGetContiguous(u64 offset, u64 count) override;
+
+		const std::filesystem::path& Path() const { return mPath; }
+
+	private:
+		void Close();
+
+		std::filesystem::path mPath;
+#ifdef _WIN32
+		HANDLE mFileHandle;
+		HANDLE mMappingHandle;
+#else
+		int mFileHandle;
+#endif
+		const byte* mData;
+		u64 mSize;
+		u64 mPosition;
+	};
+}
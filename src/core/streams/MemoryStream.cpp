@@ -82,6 +82,16 @@ namespace noire
 
 	u64 MemoryStream::Size() { return mSize; }
 
+	gsl::span<const byte> MemoryStream::TryGetContiguous(u64 offset, u64 count)
+	{
+		if (offset > mSize || count > (mSize - offset))
+		{
+			return {};
+		}
+
+		return { &mBuffer[gsl::narrow<size>(offset)], gsl::narrow<ptrdiff>(count) };
+	}
+
 	void MemoryStream::Grow(size minSize)
 	{
 		if (mBufferSize >= minSize)
@@ -193,6 +203,25 @@ TEST_SUITE("MemoryStream")
 		CHECK_EQ(std::memcmp(readData, data, std::size(readData)), 0);
 	}
 
+	TEST_CASE("TryGetContiguous")
+	{
+		MemoryStream s{};
+
+		u8 data[]{ 0x12, 0x34, 0x56, 0x78, 0x9A, 0xBC, 0xDE, 0xF0 };
+		CHECK_EQ(s.Write(data, std::size(data)), std::size(data));
+
+		const gsl::span<const byte> all = s.TryGetContiguous(0, std::size(data));
+		CHECK_EQ(all.size(), std::size(data));
+		CHECK_EQ(std::memcmp(all.data(), data, std::size(data)), 0);
+
+		const gsl::span<const byte> part = s.TryGetContiguous(2, 4);
+		CHECK_EQ(part.size(), 4);
+		CHECK_EQ(std::memcmp(part.data(), data + 2, 4), 0);
+
+		CHECK(s.TryGetContiguous(4, std::size(data)).empty());
+		CHECK(s.TryGetContiguous(0x100, 1).empty());
+	}
+
 	TEST_CASE("Read greater than current Size")
 	{
 		MemoryStream s{};
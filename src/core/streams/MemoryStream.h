@@ -32,6 +32,8 @@ namespace noire
 
 		u64 Size() override;
 
+		gsl::span<const byte> TryGetContiguous(u64 offset, u64 count) override;
+
 		void Grow(size minSize);
 		inline size BufferSize() const { return mBufferSize; };
 
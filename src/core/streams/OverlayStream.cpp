@@ -0,0 +1,309 @@
+#include "OverlayStream.h"
+#include "MemoryStream.h"
+#include <algorithm>
+#include <cstring>
+#include <doctest/doctest.h>
+#include <iterator>
+#include <vector>
+
+namespace noire
+{
+	OverlayStream::OverlayStream(ReadOnlyStream baseStream)
+		: mBaseStream{ std::move(baseStream) },
+		  mBaseSize{ mBaseStream.Size() },
+		  mExtents{},
+		  mData{},
+		  mSize{ mBaseSize },
+		  mPosition{ 0 }
+	{
+	}
+
+	u64 OverlayStream::Read(void* dstBuffer, u64 count)
+	{
+		const u64 read = ReadAt(dstBuffer, count, mPosition);
+		mPosition += read;
+		return read;
+	}
+
+	u64 OverlayStream::ReadAt(void* dstBuffer, u64 count, u64 offset)
+	{
+		if (offset >= mSize)
+		{
+			return 0;
+		}
+
+		count = std::min(count, mSize - offset);
+		byte* const dst = static_cast<byte*>(dstBuffer);
+		const u64 end = offset + count;
+		u64 pos = offset;
+		auto it = FindExtent(offset);
+		while (pos < end)
+		{
+			if (it != mExtents.end() && it->first <= pos)
+			{
+				// inside a written range
+				const u64 n = std::min(end, it->first + it->second.Size) - pos;
+				const u64 dataOffset = it->second.DataOffset + (pos - it->first);
+				const u64 read = mData.ReadAt(dst + (pos - offset), n, dataOffset);
+				Ensures(read == n);
+
+				pos += n;
+				++it;
+			}
+			else
+			{
+				// up to the next written range, from the base stream or zeros past its end
+				const u64 gapEnd = it != mExtents.end() ? std::min(end, it->first) : end;
+				const u64 baseEnd = std::min(gapEnd, std::max(pos, mBaseSize));
+				if (pos < baseEnd)
+				{
+					const u64 read = mBaseStream.ReadAt(dst + (pos - offset), baseEnd - pos, pos);
+					Ensures(read == baseEnd - pos);
+				}
+				std::memset(dst + (baseEnd - offset), 0, gsl::narrow<size>(gapEnd - baseEnd));
+
+				pos = gapEnd;
+			}
+		}
+
+		return count;
+	}
+
+	u64 OverlayStream::Write(const void* buffer, u64 count)
+	{
+		const u64 written = WriteAt(buffer, count, mPosition);
+		mPosition += written;
+		return written;
+	}
+
+	u64 OverlayStream::WriteAt(const void* buffer, u64 count, u64 offset)
+	{
+		if (count == 0)
+		{
+			return 0;
+		}
+
+		const u64 end = offset + count;
+
+		// trim the range that starts before 'offset', splitting it if it also ends after 'end'
+		if (auto it = mExtents.upper_bound(offset); it != mExtents.begin())
+		{
+			auto prev = std::prev(it);
+			const u64 prevEnd = prev->first + prev->second.Size;
+			if (prevEnd > offset)
+			{
+				if (prevEnd > end)
+				{
+					const u64 tailDataOffset = prev->second.DataOffset + (end - prev->first);
+					mExtents.emplace(end, Extent{ prevEnd - end, tailDataOffset });
+				}
+
+				prev->second.Size = offset - prev->first;
+				if (prev->second.Size == 0)
+				{
+					mExtents.erase(prev);
+				}
+			}
+		}
+
+		// drop the ranges that start inside the new one, keeping the tail of the last one
+		for (auto it = mExtents.lower_bound(offset); it != mExtents.end() && it->first < end;)
+		{
+			const u64 itEnd = it->first + it->second.Size;
+			if (itEnd > end)
+			{
+				const Extent tail{ itEnd - end, it->second.DataOffset + (end - it->first) };
+				mExtents.emplace_hint(mExtents.erase(it), end, tail);
+				break;
+			}
+
+			it = mExtents.erase(it);
+		}
+
+		const u64 dataOffset = mData.Size();
+		const u64 written = mData.WriteAt(buffer, count, dataOffset);
+		Ensures(written == count);
+
+		// sequential writes extend the previous range instead of adding a new one
+		auto next = mExtents.lower_bound(offset);
+		if (next != mExtents.begin())
+		{
+			Extent& prev = std::prev(next)->second;
+			if (std::prev(next)->first + prev.Size == offset &&
+				prev.DataOffset + prev.Size == dataOffset)
+			{
+				prev.Size += count;
+				mSize = std::max(mSize, end);
+				return count;
+			}
+		}
+
+		mExtents.emplace_hint(next, offset, Extent{ count, dataOffset });
+		mSize = std::max(mSize, end);
+		return count;
+	}
+
+	u64 OverlayStream::Seek(i64 offset, StreamSeekOrigin origin)
+	{
+		switch (origin)
+		{
+		case StreamSeekOrigin::Begin: break;
+		case StreamSeekOrigin::Current: offset += mPosition; break;
+		case StreamSeekOrigin::End: offset += mSize; break;
+		default: Expects(false);
+		}
+
+		mPosition = gsl::narrow<u64>(offset);
+		mSize = std::max(mSize, mPosition);
+		return mPosition;
+	}
+
+	u64 OverlayStream::Tell() { return mPosition; }
+
+	u64 OverlayStream::Size() { return mSize; }
+
+	gsl::span<const byte> OverlayStream::TryGetContiguous(u64 offset, u64 count)
+	{
+		if (offset > mSize || count > (mSize - offset))
+		{
+			return {};
+		}
+
+		const auto it = FindExtent(offset);
+		if (it == mExtents.end() || it->first >= offset + count)
+		{
+			// not written, may still be contiguous in the base stream
+			return offset + count <= mBaseSize ? mBaseStream.TryGetContiguous(offset, count) :
+												 gsl::span<const byte>{};
+		}
+		else if (it->first <= offset && it->first + it->second.Size >= offset + count)
+		{
+			return mData.TryGetContiguous(it->second.DataOffset + (offset - it->first), count);
+		}
+
+		return {};
+	}
+
+	std::map<u64, OverlayStream::Extent>::const_iterator OverlayStream::FindExtent(u64 offset) const
+	{
+		auto it = mExtents.upper_bound(offset);
+		if (it != mExtents.begin())
+		{
+			if (auto prev = std::prev(it); prev->first + prev->second.Size > offset)
+			{
+				return prev;
+			}
+		}
+		return it;
+	}
+}
+
+TEST_SUITE("OverlayStream")
+{
+	using namespace noire;
+
+	static ReadOnlyStream MakeBase(size baseSize)
+	{
+		auto m = std::make_unique<MemoryStream>();
+		for (size i = 0; i < baseSize; i++)
+		{
+			const u8 v = static_cast<u8>(i);
+			m->Write(&v, sizeof(v));
+		}
+		return ReadOnlyStream{ std::move(m) };
+	}
+
+	static std::vector<u8> ReadAll(Stream& s)
+	{
+		std::vector<u8> data(gsl::narrow<size>(s.Size()));
+		CHECK_EQ(s.ReadAt(data.data(), data.size(), 0), data.size());
+		return data;
+	}
+
+	TEST_CASE("Reads the base stream")
+	{
+		OverlayStream s{ MakeBase(256) };
+		CHECK_EQ(s.Size(), 256);
+		CHECK_EQ(s.ExtentCount(), 0);
+		ReadOnlyStream base = MakeBase(256);
+		CHECK_EQ(ReadAll(s), ReadAll(base));
+	}
+
+	TEST_CASE("Writes are merged with the base stream")
+	{
+		constexpr size BaseSize{ 1000 };
+
+		// same writes applied to a copy of the base stream, which is then compared with the
+		// overlay
+		OverlayStream s{ MakeBase(BaseSize) };
+		ReadOnlyStream base = MakeBase(BaseSize);
+		std::vector<u8> expected = ReadAll(base);
+
+		u32 seed = 12345;
+		const auto random = [&seed](u32 max) {
+			seed = seed * 1664525 + 1013904223;
+			return (seed >> 8) % max;
+		};
+
+		for (u32 i = 0; i < 500; i++)
+		{
+			const size offset = random(BaseSize + 100);
+			const size count = random(i % 10 == 0 ? 300 : 16) + 1;
+			std::vector<u8> data(count);
+			for (u8& b : data)
+			{
+				b = static_cast<u8>(random(256));
+			}
+
+			CHECK_EQ(s.WriteAt(data.data(), count, offset), count);
+			if (offset + count > expected.size())
+			{
+				expected.resize(offset + count, 0);
+			}
+			std::copy(data.begin(), data.end(), expected.begin() + offset);
+
+			REQUIRE_EQ(s.Size(), expected.size());
+			REQUIRE(ReadAll(s) == expected);
+		}
+	}
+
+	TEST_CASE("Sequential writes extend a single range")
+	{
+		OverlayStream s{ MakeBase(64) };
+		s.Seek(16, StreamSeekOrigin::Begin);
+		for (u32 i = 0; i < 100; i++)
+		{
+			static_cast<Stream&>(s).Write(i);
+		}
+		CHECK_EQ(s.ExtentCount(), 1);
+		CHECK_EQ(s.Size(), 16 + 100 * sizeof(u32));
+		CHECK_EQ(static_cast<Stream&>(s).ReadAt<u32>(16 + 99 * sizeof(u32)), 99);
+		CHECK_EQ(static_cast<Stream&>(s).ReadAt<u8>(15), 15);
+	}
+
+	TEST_CASE("Writes past the end leave zeros")
+	{
+		OverlayStream s{ MakeBase(8) };
+		const u8 v = 0xFF;
+		s.WriteAt(&v, 1, 15);
+		CHECK_EQ(s.Size(), 16);
+
+		const std::vector<u8> data = ReadAll(s);
+		CHECK_EQ(data[7], 7);
+		CHECK_EQ(data[8], 0);
+		CHECK_EQ(data[14], 0);
+		CHECK_EQ(data[15], 0xFF);
+	}
+
+	TEST_CASE("TryGetContiguous")
+	{
+		OverlayStream s{ MakeBase(64) };
+		CHECK_EQ(s.TryGetContiguous(0, 64).size(), 64);
+
+		const u8 data[]{ 1, 2, 3, 4 };
+		s.WriteAt(data, std::size(data), 10);
+		CHECK_EQ(s.TryGetContiguous(0, 10).size(), 10);
+		CHECK_EQ(s.TryGetContiguous(11, 2).size(), 2);
+		CHECK(s.TryGetContiguous(8, 4).empty());
+	}
+}
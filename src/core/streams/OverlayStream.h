@@ -0,0 +1,57 @@
+#pragma once
+#include "Common.h"
+#include "Stream.h"
+#include "TempStream.h"
+#include <map>
+
+namespace noire
+{
+	// Copy-on-write stream on top of a read-only base stream. Writes are appended to a TempStream
+	// and only the written ranges are recorded, reads merge them with the base stream. Modifying a
+	// few bytes of a big stream doesn't need to copy it.
+	class OverlayStream final : public Stream
+	{
+	public:
+		OverlayStream(ReadOnlyStream baseStream);
+
+		OverlayStream(const OverlayStream&) = delete;
+		OverlayStream(OverlayStream&&) = default;
+
+		OverlayStream& operator=(const OverlayStream&) = delete;
+		OverlayStream& operator=(OverlayStream&&) = default;
+
+		u64 Read(void* dstBuffer, u64 count) override;
+		u64 ReadAt(void* dstBuffer, u64 count, u64 offset) override;
+
+		u64 Write(const void* buffer, u64 count) override;
+		u64 WriteAt(const void* buffer, u64 count, u64 offset) override;
+
+		u64 Seek(i64 offset, StreamSeekOrigin origin) override;
+
+		u64 Tell() override;
+
+		u64 Size() override;
+
+		gsl::span<const byte> TryGetContiguous(u64 offset, u64 count) override;
+
+		// Number of written ranges that are not merged with each other
+		size ExtentCount() const { return mExtents.size(); }
+
+	private:
+		struct Extent
+		{
+			u64 Size;
+			u64 DataOffset; // offset of the written bytes in mData
+		};
+
+		// Returns the first extent that ends after 'offset'
+		std::map<u64, Extent>::const_iterator FindExtent(u64 offset) const;
+
+		ReadOnlyStream mBaseStream;
+		u64 mBaseSize;
+		std::map<u64, Extent> mExtents; // key is the offset in the stream, extents never overlap
+		TempStream mData;
+		u64 mSize;
+		u64 mPosition;
+	};
+}
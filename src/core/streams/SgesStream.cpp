@@ -0,0 +1,389 @@
+#include "SgesStream.h"
+#include "MemoryStream.h"
+#include <algorithm>
+#include <cstddef>
+#include <cstring>
+#include <doctest/doctest.h>
+#include <iterator>
+#include <string>
+#include <type_traits>
+#include <zlib.h>
+
+namespace noire
+{
+	// Header as stored in the stream, followed by BlockCount SgesRawBlocks
+	struct SgesRawHeader
+	{
+		u32 Magic;
+		u16 Unk;
+		u16 BlockCount;
+		u32 Size;           // decompressed
+		u32 CompressedSize; // header included
+	};
+	static_assert(sizeof(SgesRawHeader) == 16 && std::is_trivially_copyable_v<SgesRawHeader>);
+
+	struct SgesRawBlock
+	{
+		u16 CompressedSize; // 0 means 0x10000
+		u16 Size;           // 0 means 0x10000
+		u32 Offset;         // from the beginning of the header
+	};
+	static_assert(sizeof(SgesRawBlock) == 8 && std::is_trivially_copyable_v<SgesRawBlock>);
+
+	static u32 BlockSize(u16 s) { return s == 0 ? static_cast<u32>(SgesStream::MaxBlockSize) : s; }
+
+	SgesStream::SgesStream(ReadOnlyStream baseStream)
+		: mBaseStream{ std::move(baseStream) },
+		  mBlocks{},
+		  mSize{ 0 },
+		  mPosition{ 0 },
+		  mCacheMutex{},
+		  mCache{},
+		  mUseCounter{ 0 },
+		  mInflatedBlockCount{ 0 }
+	{
+		const bool valid = LoadBlocks(mBaseStream, mBlocks, mSize);
+		Expects(valid);
+
+		for (CachedBlock& c : mCache)
+		{
+			c.Index = static_cast<size>(-1);
+			c.LastUse = 0;
+		}
+	}
+
+	u64 SgesStream::Read(void* dstBuffer, u64 count)
+	{
+		const u64 read = ReadAt(dstBuffer, count, mPosition);
+		mPosition += read;
+		return read;
+	}
+
+	u64 SgesStream::ReadAt(void* dstBuffer, u64 count, u64 offset)
+	{
+		if (offset >= mSize)
+		{
+			return 0;
+		}
+
+		count = std::min(count, mSize - offset);
+		byte* const dst = static_cast<byte*>(dstBuffer);
+		const u64 end = offset + count;
+		u64 pos = offset;
+		for (size i = FindBlock(offset); pos < end; ++i)
+		{
+			const Block& b = mBlocks[i];
+			const std::shared_ptr<const std::vector<byte>> data = GetBlock(i);
+
+			const u64 blockOffset = pos - b.DecompressedOffset;
+			const u64 n = std::min<u64>(end - pos, b.Size - blockOffset);
+			std::memcpy(dst + (pos - offset), data->data() + blockOffset, gsl::narrow<size>(n));
+			pos += n;
+		}
+
+		return count;
+	}
+
+	u64 SgesStream::Write(const void*, u64) { return 0; }
+
+	u64 SgesStream::WriteAt(const void*, u64, u64) { return 0; }
+
+	u64 SgesStream::Seek(i64 offset, StreamSeekOrigin origin)
+	{
+		switch (origin)
+		{
+		case StreamSeekOrigin::Begin: break;
+		case StreamSeekOrigin::Current: offset += mPosition; break;
+		case StreamSeekOrigin::End: offset += mSize; break;
+		default: Expects(false);
+		}
+
+		mPosition = gsl::narrow<u64>(offset);
+		return mPosition;
+	}
+
+	u64 SgesStream::Tell() { return mPosition; }
+
+	u64 SgesStream::Size() { return mSize; }
+
+	// Returns the index of the block that contains 'offset', which must be less than mSize
+	size SgesStream::FindBlock(u64 offset) const
+	{
+		const auto it = std::upper_bound(
+			mBlocks.begin(), mBlocks.end(), offset, [](u64 o, const Block& b) {
+				return o < b.DecompressedOffset;
+			});
+		Ensures(it != mBlocks.begin());
+		return gsl::narrow<size>(std::distance(mBlocks.begin(), it) - 1);
+	}
+
+	std::shared_ptr<const std::vector<byte>> SgesStream::GetBlock(size index)
+	{
+		{
+			std::lock_guard<std::mutex> lock{ mCacheMutex };
+			for (CachedBlock& c : mCache)
+			{
+				if (c.Index == index)
+				{
+					c.LastUse = ++mUseCounter;
+					return c.Data;
+				}
+			}
+		}
+
+		// inflated without holding the lock, other threads may read other blocks meanwhile
+		auto data = std::make_shared<const std::vector<byte>>(Inflate(mBlocks[index]));
+
+		std::lock_guard<std::mutex> lock{ mCacheMutex };
+		mInflatedBlockCount++;
+		CachedBlock& lru = *std::min_element(
+			mCache.begin(), mCache.end(), [](const CachedBlock& a, const CachedBlock& b) {
+				return a.LastUse < b.LastUse;
+			});
+		lru.Index = index;
+		lru.LastUse = ++mUseCounter;
+		lru.Data = data;
+		return data;
+	}
+
+	std::vector<byte> SgesStream::Inflate(const Block& block)
+	{
+		std::vector<byte> compressedBuffer{};
+		const gsl::span<const byte> compressed =
+			mBaseStream.ReadContiguous(block.Offset, block.CompressedSize, compressedBuffer);
+		Expects(gsl::narrow<u64>(compressed.size()) == block.CompressedSize);
+
+		std::vector<byte> data(block.Size);
+
+		// blocks that don't get smaller are stored as they are
+		if (block.CompressedSize == block.Size)
+		{
+			std::memcpy(data.data(), compressed.data(), data.size());
+			return data;
+		}
+
+		// raw deflate, zlib streams are accepted too in case some blocks have the zlib header
+		for (const int windowBits : { -MAX_WBITS, MAX_WBITS })
+		{
+			z_stream z{};
+			Expects(inflateInit2(&z, windowBits) == Z_OK);
+			auto endInflate = gsl::finally([&z]() { inflateEnd(&z); });
+
+			z.next_in = reinterpret_cast<Bytef*>(const_cast<byte*>(compressed.data()));
+			z.avail_in = block.CompressedSize;
+			z.next_out = reinterpret_cast<Bytef*>(data.data());
+			z.avail_out = block.Size;
+			if (inflate(&z, Z_FINISH) == Z_STREAM_END && z.total_out == block.Size)
+			{
+				return data;
+			}
+		}
+
+		Expects(false && "Invalid 'sges' block");
+		return data;
+	}
+
+	// Reads the block table, returns false if it doesn't decode cleanly: a block outside of the
+	// stream or the sizes of the blocks not adding up to the decompressed size
+	bool SgesStream::LoadBlocks(Stream& stream, std::vector<Block>& blocks, u64& totalSize)
+	{
+		blocks.clear();
+		totalSize = 0;
+
+		const u64 streamSize = stream.Size();
+		if (streamSize < sizeof(SgesRawHeader))
+		{
+			return false;
+		}
+
+		const SgesRawHeader h = stream.ReadAt<SgesRawHeader>(0);
+		const u64 tableSize = sizeof(SgesRawBlock) * u64{ h.BlockCount };
+		if (h.Magic != HeaderMagic || sizeof(SgesRawHeader) + tableSize > streamSize)
+		{
+			return false;
+		}
+
+		std::vector<byte> buffer{};
+		const gsl::span<const byte> table =
+			stream.ReadContiguous(sizeof(SgesRawHeader), tableSize, buffer);
+		if (gsl::narrow<u64>(table.size()) != tableSize)
+		{
+			return false;
+		}
+
+		blocks.reserve(h.BlockCount);
+		for (size i = 0; i < h.BlockCount; ++i)
+		{
+			const SgesRawBlock r =
+				LoadUnaligned<SgesRawBlock>(table.data() + i * sizeof(SgesRawBlock));
+			const Block b{ r.Offset, BlockSize(r.CompressedSize), BlockSize(r.Size), totalSize };
+			if (b.Offset < sizeof(SgesRawHeader) + tableSize ||
+				b.Offset + b.CompressedSize > streamSize)
+			{
+				return false;
+			}
+
+			blocks.emplace_back(b);
+			totalSize += b.Size;
+		}
+
+		return totalSize == h.Size;
+	}
+
+	bool SgesStream::IsValid(Stream& stream)
+	{
+		std::vector<Block> blocks{};
+		u64 totalSize = 0;
+		return LoadBlocks(stream, blocks, totalSize);
+	}
+}
+
+TEST_SUITE("SgesStream")
+{
+	using namespace noire;
+
+	// Compresses 'data' in blocks of 'blockSize' bytes, in the layout SgesStream reads. This is
+	// not data from the game files, it only checks the reader against its own guess.
+	static ReadOnlyStream Compress(const std::string& data, size blockSize, bool compress = true)
+	{
+		const size blockCount = (data.size() + blockSize - 1) / blockSize;
+		std::vector<SgesRawBlock> blocks{};
+		std::string blockData{};
+		const u64 dataOffset = sizeof(SgesRawHeader) + sizeof(SgesRawBlock) * blockCount;
+		for (size offset = 0; offset < data.size(); offset += blockSize)
+		{
+			const size n = std::min(blockSize, data.size() - offset);
+			std::string compressed(compressBound(gsl::narrow<uLong>(n)), '\0');
+
+			z_stream z{};
+			REQUIRE_EQ(deflateInit2(&z, 9, Z_DEFLATED, -MAX_WBITS, 8, Z_DEFAULT_STRATEGY), Z_OK);
+			z.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(data.data() + offset));
+			z.avail_in = gsl::narrow<uInt>(n);
+			z.next_out = reinterpret_cast<Bytef*>(compressed.data());
+			z.avail_out = gsl::narrow<uInt>(compressed.size());
+			REQUIRE_EQ(deflate(&z, Z_FINISH), Z_STREAM_END);
+			compressed.resize(z.total_out);
+			deflateEnd(&z);
+
+			if (!compress || compressed.size() >= n)
+			{
+				compressed = data.substr(offset, n);
+			}
+
+			blocks.push_back(SgesRawBlock{ static_cast<u16>(compressed.size()),
+										   static_cast<u16>(n),
+										   gsl::narrow<u32>(dataOffset + blockData.size()) });
+			blockData += compressed;
+		}
+
+		const SgesRawHeader h{ SgesStream::HeaderMagic,
+							   0,
+							   gsl::narrow<u16>(blockCount),
+							   gsl::narrow<u32>(data.size()),
+							   gsl::narrow<u32>(dataOffset + blockData.size()) };
+
+		auto m = std::make_unique<MemoryStream>();
+		Stream& s = *m;
+		s.Write(h);
+		s.Write(blocks.data(), blocks.size() * sizeof(SgesRawBlock));
+		s.Write(blockData.data(), blockData.size());
+		return ReadOnlyStream{ std::move(m) };
+	}
+
+	static std::string TestData(size n)
+	{
+		std::string data(n, '\0');
+		u32 seed = 1234;
+		for (char& c : data)
+		{
+			seed = seed * 1664525 + 1013904223;
+			c = "abcdefgh"[(seed >> 16) % 8];
+		}
+		return data;
+	}
+
+	static std::string ReadAt(Stream& s, u64 offset, u64 count)
+	{
+		std::string str(gsl::narrow<size>(count), '\0');
+		str.resize(gsl::narrow<size>(s.ReadAt(str.data(), str.size(), offset)));
+		return str;
+	}
+
+	TEST_CASE("Reads the decompressed data")
+	{
+		const std::string data = TestData(SgesStream::MaxBlockSize * 3 + 1000);
+		SgesStream s{ Compress(data, SgesStream::MaxBlockSize) };
+		CHECK_EQ(s.Size(), data.size());
+		CHECK_EQ(s.BlockCount(), 4);
+		CHECK_EQ(ReadAt(s, 0, s.Size()), data);
+
+		// ranges across block boundaries and past the end
+		CHECK_EQ(ReadAt(s, SgesStream::MaxBlockSize - 10, 20),
+				 data.substr(SgesStream::MaxBlockSize - 10, 20));
+		CHECK_EQ(ReadAt(s, data.size() - 5, 100), data.substr(data.size() - 5));
+		CHECK_EQ(ReadAt(s, data.size(), 100), "");
+
+		std::string read(100, '\0');
+		s.Seek(50, StreamSeekOrigin::Begin);
+		CHECK_EQ(s.Read(read.data(), read.size()), 100);
+		CHECK_EQ(read, data.substr(50, 100));
+		CHECK_EQ(s.Tell(), 150);
+	}
+
+	TEST_CASE("Blocks that are not compressed")
+	{
+		const std::string data = TestData(1000);
+		SgesStream s{ Compress(data, 300, false) };
+		CHECK_EQ(s.BlockCount(), 4);
+		CHECK_EQ(ReadAt(s, 0, s.Size()), data);
+	}
+
+	TEST_CASE("Inflated blocks are cached")
+	{
+		constexpr size BlockSize{ 1000 };
+		const std::string data = TestData(BlockSize * 10);
+		SgesStream s{ Compress(data, BlockSize) };
+
+		// small reads inside the same block
+		for (size i = 0; i < BlockSize; i += 10)
+		{
+			CHECK_EQ(ReadAt(s, i, 10), data.substr(i, 10));
+		}
+		CHECK_EQ(s.InflatedBlockCount(), 1);
+
+		// random reads keep hitting the cache as long as they stay in a few blocks
+		u32 seed = 42;
+		for (size i = 0; i < 100; i++)
+		{
+			seed = seed * 1664525 + 1013904223;
+			const size offset = BlockSize * 4 + (seed >> 8) % (BlockSize * 3 - 16);
+			REQUIRE_EQ(ReadAt(s, offset, 16), data.substr(offset, 16));
+		}
+		CHECK_EQ(s.InflatedBlockCount(), 4);
+	}
+
+	TEST_CASE("IsValid")
+	{
+		ReadOnlyStream valid = Compress(TestData(100), 50);
+		CHECK(SgesStream::IsValid(valid));
+
+		auto m = std::make_unique<MemoryStream>();
+		const std::string notSges = TestData(100);
+		m->Write(notSges.data(), notSges.size());
+		ReadOnlyStream invalid{ std::move(m) };
+		CHECK_FALSE(SgesStream::IsValid(invalid));
+
+		// the magic is there but the block table doesn't match the data
+		auto truncated = std::make_unique<MemoryStream>();
+		const std::string data = ReadAt(valid, 0, valid.Size());
+		truncated->Write(data.data(), data.size() - 1);
+		ReadOnlyStream invalidBlocks{ std::move(truncated) };
+		CHECK_FALSE(SgesStream::IsValid(invalidBlocks));
+
+		auto wrongSize = std::make_unique<MemoryStream>();
+		wrongSize->Write(data.data(), data.size());
+		static_cast<Stream&>(*wrongSize).WriteAt(u32{ 99 }, offsetof(SgesRawHeader, Size));
+		ReadOnlyStream invalidSize{ std::move(wrongSize) };
+		CHECK_FALSE(SgesStream::IsValid(invalidSize));
+	}
+}
@@ -0,0 +1,88 @@
+#pragma once
+#include "Common.h"
+#include "Stream.h"
+#include <array>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace noire
+{
+	// Read-only stream with the decompressed contents of an 'sges' stream, as found in some
+	// Container entries. The data is split in blocks of up to 64 KiB, each one compressed on its
+	// own with deflate, so blocks are inflated only when read. The last few inflated blocks are
+	// cached, reading close to the previous read doesn't inflate the same block again.
+	// The layout of the header and block table is a best guess that has not been checked
+	// against the game files yet, so streams whose block table doesn't decode cleanly are not
+	// considered 'sges' streams, see IsValid. Containers only use it when enabled, see
+	// Container::EnableSgesDecompression.
+	class SgesStream final : public Stream
+	{
+	public:
+		SgesStream(ReadOnlyStream baseStream);
+
+		SgesStream(const SgesStream&) = delete;
+		SgesStream(SgesStream&&) = delete;
+
+		SgesStream& operator=(const SgesStream&) = delete;
+		SgesStream& operator=(SgesStream&&) = delete;
+
+		u64 Read(void* dstBuffer, u64 count) override;
+		u64 ReadAt(void* dstBuffer, u64 count, u64 offset) override;
+
+		// read only, always return 0 bytes written
+		u64 Write(const void* buffer, u64 count) override;
+		u64 WriteAt(const void* buffer, u64 count, u64 offset) override;
+
+		u64 Seek(i64 offset, StreamSeekOrigin origin) override;
+
+		u64 Tell() override;
+
+		// Decompressed size
+		u64 Size() override;
+
+		size BlockCount() const { return mBlocks.size(); }
+		// Number of blocks inflated so far, including the ones inflated again after leaving the
+		// cache
+		size InflatedBlockCount() const { return mInflatedBlockCount; }
+
+	private:
+		struct Block
+		{
+			u64 Offset;          // offset of the compressed data in the base stream
+			u32 CompressedSize;
+			u32 Size;
+			u64 DecompressedOffset;
+		};
+
+		struct CachedBlock
+		{
+			size Index;
+			u64 LastUse;
+			std::shared_ptr<const std::vector<byte>> Data;
+		};
+
+		static bool LoadBlocks(Stream& stream, std::vector<Block>& blocks, u64& totalSize);
+		size FindBlock(u64 offset) const;
+		std::shared_ptr<const std::vector<byte>> GetBlock(size index);
+		std::vector<byte> Inflate(const Block& block);
+
+		ReadOnlyStream mBaseStream;
+		std::vector<Block> mBlocks; // sorted by DecompressedOffset
+		u64 mSize;
+		u64 mPosition;
+
+		static constexpr size CacheSize{ 4 };
+		std::mutex mCacheMutex; // ReadAt may be called from several threads
+		std::array<CachedBlock, CacheSize> mCache;
+		u64 mUseCounter;
+		size mInflatedBlockCount;
+
+	public:
+		static constexpr u32 HeaderMagic{ 0x73656773 }; // 'sges'
+		static constexpr u64 MaxBlockSize{ 0x10000 };
+
+		// Whether the stream starts with an 'sges' header and its block table fits the stream
+		static bool IsValid(Stream& stream);
+	};
+}
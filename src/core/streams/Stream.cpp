@@ -3,8 +3,35 @@
 
 namespace noire
 {
+	void Stream::Flush() {}
+
+	gsl::span<const byte> Stream::TryGetContiguous(u64, u64) { return {}; }
+
+	gsl::span<const byte>
+	Stream::ReadContiguous(u64 offset, u64 count, std::vector<byte>& buffer)
+	{
+		if (const gsl::span<const byte> contiguous = TryGetContiguous(offset, count);
+			!contiguous.empty() || count == 0)
+		{
+			return contiguous;
+		}
+
+		buffer.resize(gsl::narrow<size>(count));
+		const u64 read = ReadAt(buffer.data(), count, offset);
+		return { buffer.data(), gsl::narrow<ptrdiff>(read) };
+	}
+
 	void Stream::CopyTo(Stream& stream)
 	{
+		// streams kept in memory are written directly, without going through the buffer
+		const u64 streamSize = Size();
+		if (const gsl::span<const byte> data = TryGetContiguous(0, streamSize);
+			!data.empty() && gsl::narrow<u64>(data.size()) == streamSize)
+		{
+			stream.Write(data.data(), streamSize);
+			return;
+		}
+
 		constexpr size BufferSize{ 81920 };
 		std::unique_ptr<u8[]> buffer = std::make_unique<u8[]>(BufferSize);
 
@@ -35,6 +62,11 @@ namespace noire
 	{
 		Expects(dstBuffer);
 
+		if (offset >= mSize)
+		{
+			return 0;
+		}
+
 		if (const u64 maxCount = (mSize - offset); count > maxCount)
 		{
 			count = maxCount;
@@ -63,6 +95,16 @@ namespace noire
 
 	u64 SubStream::Size() { return mSize; }
 
+	gsl::span<const byte> SubStream::TryGetContiguous(u64 offset, u64 count)
+	{
+		if (offset > mSize || count > (mSize - offset))
+		{
+			return {};
+		}
+
+		return mBaseStream.TryGetContiguous(mOffset + offset, count);
+	}
+
 	ReadOnlyStream::ReadOnlyStream(std::unique_ptr<Stream> baseStream)
 		: mBaseStream{ std::move(baseStream) }
 	{
@@ -92,6 +134,11 @@ namespace noire
 
 	u64 ReadOnlyStream::Size() { return mBaseStream->Size(); }
 
+	gsl::span<const byte> ReadOnlyStream::TryGetContiguous(u64 offset, u64 count)
+	{
+		return mBaseStream->TryGetContiguous(offset, count);
+	}
+
 	EmptyStream::EmptyStream() {}
 	u64 EmptyStream::Read(void*, u64) { return 0; }
 	u64 EmptyStream::ReadAt(void*, u64, u64) { return 0; }
@@ -1,6 +1,8 @@
 #pragma once
 #include "Common.h"
+#include <cstring>
 #include <memory>
+#include <vector>
 
 namespace noire
 {
@@ -18,7 +20,9 @@ namespace noire
 
 		// Returns number of bytes read
 		virtual u64 Read(void* dstBuffer, u64 count) = 0;
-		// Reads at specified offset without modifying stream position
+		// Reads at specified offset without modifying stream position. Implementations must not
+		// depend on or change any shared cursor, so ReadAt can be called from several threads at
+		// the same time as long as nobody writes to the stream concurrently.
 		virtual u64 ReadAt(void* dstBuffer, u64 count, u64 offset) = 0;
 
 		// Returns number of bytes written
@@ -33,6 +37,21 @@ namespace noire
 
 		virtual u64 Size() = 0;
 
+		// Makes sure the data written so far is stored durably, so writes issued after Flush()
+		// returns are never persisted before the ones issued before it. Default Flush() does
+		// nothing.
+		virtual void Flush();
+
+		// Returns a view of the 'count' bytes at the specified offset if the stream keeps them
+		// contiguous in memory, otherwise, an empty span. The view is valid until the stream is
+		// written to or destroyed. Default implementation always returns an empty span.
+		virtual gsl::span<const byte> TryGetContiguous(u64 offset, u64 count);
+
+		// Returns a view of the 'count' bytes at the specified offset. If the stream doesn't keep
+		// them contiguous in memory, they are copied to 'buffer' with a single ReadAt and the view
+		// refers to it. The view is shorter than 'count' if the end of the stream is reached.
+		gsl::span<const byte> ReadContiguous(u64 offset, u64 count, std::vector<byte>& buffer);
+
 		void CopyTo(Stream& stream);
 
 		template<class T>
@@ -101,6 +120,8 @@ namespace noire
 
 		u64 Size() override;
 
+		gsl::span<const byte> TryGetContiguous(u64 offset, u64 count) override;
+
 	private:
 		Stream& mBaseStream;
 		u64 mOffset;
@@ -127,6 +148,8 @@ namespace noire
 
 		u64 Size() override;
 
+		gsl::span<const byte> TryGetContiguous(u64 offset, u64 count) override;
+
 	private:
 		std::unique_ptr<Stream> mBaseStream;
 	};
@@ -149,4 +172,15 @@ namespace noire
 
 		u64 Size() override;
 	};
-}
+
+	// Reads a POD value from a memory location that may not be aligned.
+	template<class T>
+	T LoadUnaligned(const byte* src)
+	{
+		static_assert(std::is_pod_v<T>, "Expected a POD type for T");
+
+		T tmp;
+		std::memcpy(&tmp, src, sizeof(tmp));
+		return tmp;
+	}
+}
\ No newline at end of file
@@ -52,6 +52,12 @@ namespace noire
 		return std::visit([](Stream& s) { return s.Size(); }, mStream);
 	}
 
+	gsl::span<const byte> TempStream::TryGetContiguous(u64 offset, u64 count)
+	{
+		return std::visit([offset, count](Stream& s) { return s.TryGetContiguous(offset, count); },
+						  mStream);
+	}
+
 	bool TempStream::IsUsingTempFile() const
 	{
 		constexpr size FileStreamIndex{ 1 };
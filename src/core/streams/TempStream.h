@@ -34,6 +34,8 @@ namespace noire
 
 		u64 Size() override;
 
+		gsl::span<const byte> TryGetContiguous(u64 offset, u64 count) override;
+
 		bool IsUsingTempFile() const;
 
 	private:
@@ -0,0 +1,60 @@
+#pragma once
+#include "Common.h"
+#include "files/File.h"
+#include "streams/Stream.h"
+#include <doctest/doctest.h>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <string>
+#include <string_view>
+#include <system_error>
+
+// Helpers shared by the test suites
+namespace noire::test
+{
+	inline std::string ReadAll(Stream& s)
+	{
+		std::string str(gsl::narrow<size>(s.Size()), '\0');
+		CHECK_EQ(s.ReadAt(str.data(), str.size(), 0), str.size());
+		return str;
+	}
+
+	inline std::string ReadAll(ReadOnlyStream&& s) { return ReadAll(static_cast<Stream&>(s)); }
+
+	// Overwrites the start of the file with 'str'
+	inline void WriteAll(File& f, std::string_view str)
+	{
+		Stream& s = f.Raw();
+		s.Seek(0, StreamSeekOrigin::Begin);
+		s.Write(str.data(), str.size());
+	}
+
+	inline std::string ReadFile(const std::filesystem::path& path)
+	{
+		std::ifstream f{ path, std::ios::binary };
+		return { std::istreambuf_iterator<char>{ f }, std::istreambuf_iterator<char>{} };
+	}
+
+	// Empty directory in the temp directory, removed with its contents when destroyed
+	struct TempDirectory
+	{
+		const std::filesystem::path Path;
+
+		inline TempDirectory(std::string_view name)
+			: Path{ std::filesystem::temp_directory_path() / name }
+		{
+			std::filesystem::remove_all(Path);
+			std::filesystem::create_directories(Path);
+		}
+
+		inline ~TempDirectory()
+		{
+			std::error_code ec;
+			std::filesystem::remove_all(Path, ec);
+		}
+
+		TempDirectory(const TempDirectory&) = delete;
+		TempDirectory& operator=(const TempDirectory&) = delete;
+	};
+}
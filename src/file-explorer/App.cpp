@@ -44,7 +44,7 @@ namespace noire::explorer
 		mMainWindow->OnRootPathChanged();
 	}
 
-	static wxImage CreateImageFromDDS(gsl::span<byte> ddsData)
+	static wxImage CreateImageFromDDS(gsl::span<const byte> ddsData)
 	{
 		ILuint imgId = ilGenImage();
 		ilBindImage(imgId);
@@ -101,20 +101,25 @@ namespace noire::explorer
 		}
 
 		Stream& s = file->Raw();
-		s.Seek(0, StreamSeekOrigin::Begin);
 
 		constexpr u32 DDSHeaderMagic{ 0x20534444 }; // 'DDS '
-		const u32 headerMagic = s.Read<u32>();
+		const u32 headerMagic = s.ReadAt<u32>(0);
 
 		if (headerMagic == DDSHeaderMagic)
 		{
 			const size ddsSize = gsl::narrow<size>(s.Size());
 
-			std::unique_ptr buffer = std::make_unique<byte[]>(ddsSize);
-			s.Seek(0, StreamSeekOrigin::Begin);
-			s.Read(buffer.get(), ddsSize);
+			// use the data in place if possible, otherwise copy it to a buffer
+			std::unique_ptr<byte[]> buffer{ nullptr };
+			gsl::span<const byte> ddsData = s.TryGetContiguous(0, ddsSize);
+			if (ddsData.empty())
+			{
+				buffer = std::make_unique<byte[]>(ddsSize);
+				s.ReadAt(buffer.get(), ddsSize, 0);
+				ddsData = { buffer.get(), gsl::narrow<ptrdiff>(ddsSize) };
+			}
 
-			const wxImage img = CreateImageFromDDS({ buffer.get(), gsl::narrow<ptrdiff>(ddsSize) });
+			const wxImage img = CreateImageFromDDS(ddsData);
 			ImageWindow* imgWin =
 				new ImageWindow(mMainWindow,
 								wxID_ANY,
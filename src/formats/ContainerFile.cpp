@@ -1,8 +1,22 @@
 #include "ContainerFile.h"
 #include <gsl/gsl>
+#include <type_traits>
+#include <vector>
 
 namespace noire
 {
+	// entry as stored in the file
+	struct SContainerRawEntry
+	{
+		std::uint32_t NameHash;
+		std::uint32_t Field1;
+		std::uint32_t Field2;
+		std::uint32_t Field3;
+		std::uint32_t Field4;
+	};
+	static_assert(sizeof(SContainerRawEntry) == 20 &&
+				  std::is_trivially_copyable_v<SContainerRawEntry>);
+
 	CContainerFile::CContainerFile(fs::IFileStream& stream) : mStream{ stream }, mEntries{}
 	{
 		LoadEntries();
@@ -25,16 +39,15 @@ namespace noire
 		mStream.Read<std::uint32_t>(); // magicValue
 
 		const std::uint32_t entryCount = mStream.Read<std::uint32_t>();
+
+		// read the whole entry table at once
+		std::vector<SContainerRawEntry> rawEntries(entryCount);
+		mStream.Read(rawEntries.data(), rawEntries.size() * sizeof(SContainerRawEntry));
+
 		mEntries.reserve(entryCount);
-		for (std::size_t i = 0; i < entryCount; i++)
+		for (const SContainerRawEntry& e : rawEntries)
 		{
-			const std::uint32_t f0 = mStream.Read<std::uint32_t>();
-			const std::uint32_t f1 = mStream.Read<std::uint32_t>();
-			const std::uint32_t f2 = mStream.Read<std::uint32_t>();
-			const std::uint32_t f3 = mStream.Read<std::uint32_t>();
-			const std::uint32_t f4 = mStream.Read<std::uint32_t>();
-
-			mEntries.emplace_back(f0, f1, f2, f3, f4);
+			mEntries.emplace_back(e.NameHash, e.Field1, e.Field2, e.Field3, e.Field4);
 		}
 	}
 
@@ -1,12 +1,23 @@
 #include "Hash.h"
+#include <Windows.h>
 #include <algorithm>
+#include <array>
 #include <charconv>
 #include <fstream>
 #include <gsl/gsl>
+#include <iterator>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+#if defined(_M_X64) || defined(_M_IX86)
+#define NOIRE_CRC32_PCLMUL
+#include <intrin.h>
+#endif
 
 namespace noire
 {
-	static std::uint32_t crc32Table[256]{
+	static constexpr std::uint32_t crc32Table[256]{
 		0x00000000, 0x77073096, 0xEE0E612C, 0x990951BA, 0x076DC419, 0x706AF48F, 0xE963A535,
 		0x9E6495A3, 0x0EDB8832, 0x79DCB8A4, 0xE0D5E91E, 0x97D2D988, 0x09B64C2B, 0x7EB17CBD,
 		0xE7B82D07, 0x90BF1D91, 0x1DB71064, 0x6AB020F2, 0xF3B97148, 0x84BE41DE, 0x1ADAD47D,
@@ -46,48 +57,320 @@ namespace noire
 		0xB40BBE37, 0xC30C8EA1, 0x5A05DF1B, 0x2D02EF8D,
 	};
 
-	std::uint32_t crc32Partial(std::string_view str, std::uint32_t inHash)
+	using Crc32Tables = std::array<std::array<std::uint32_t, 256>, 8>;
+
+	// crc32Tables[k][b] is the CRC of byte 'b' followed by 'k' zero bytes
+	static constexpr Crc32Tables MakeCrc32Tables()
 	{
-		std::uint32_t hash = inHash;
-		for (std::size_t i = 0; i < str.size(); ++i)
+		Crc32Tables tables{};
+		for (std::size_t i = 0; i < 256; i++)
 		{
-			hash = crc32Table[str[i] ^ (hash & 0xFF)] ^ (hash >> 8);
+			tables[0][i] = crc32Table[i];
 		}
 
-		return hash;
+		for (std::size_t k = 1; k < tables.size(); k++)
+		{
+			for (std::size_t i = 0; i < 256; i++)
+			{
+				const std::uint32_t prev = tables[k - 1][i];
+				tables[k][i] = (prev >> 8) ^ crc32Table[prev & 0xFF];
+			}
+		}
+
+		return tables;
 	}
 
-	std::uint32_t crc32(std::string_view str, std::uint32_t inHash)
+	static constexpr Crc32Tables crc32Tables{ MakeCrc32Tables() };
+
+	static inline std::uint32_t LoadLE32(const std::uint8_t* p)
 	{
-		return ~crc32Partial(str, inHash);
+		return static_cast<std::uint32_t>(p[0]) | (static_cast<std::uint32_t>(p[1]) << 8) |
+			   (static_cast<std::uint32_t>(p[2]) << 16) | (static_cast<std::uint32_t>(p[3]) << 24);
 	}
 
-	std::uint32_t crc32LowercasePartial(std::string_view str, std::uint32_t inHash)
+	// Lowercases 'A'-'Z' in the 4 bytes of 'v', other bytes are not modified
+	static inline std::uint32_t ToLower4(std::uint32_t v)
+	{
+		const std::uint32_t heptets = v & 0x7F7F7F7F;
+		const std::uint32_t aboveZ = heptets + 0x25252525; // high bit set if above 'Z'
+		const std::uint32_t fromA = heptets + 0x3F3F3F3F;  // high bit set if 'A' or above
+		const std::uint32_t upper = ~v & (fromA ^ aboveZ) & 0x80808080;
+		return v | (upper >> 2);
+	}
+
+	static inline std::uint8_t ToLower(std::uint8_t c)
+	{
+		return (c >= 'A' && c <= 'Z') ? static_cast<std::uint8_t>(c + 32) : c;
+	}
+
+	template<bool Lowercase>
+	static std::uint32_t crc32Slicing8(const std::uint8_t* p, std::size_t n, std::uint32_t hash)
 	{
-		std::uint32_t hash = inHash;
-		for (std::size_t i = 0; i < str.size(); ++i)
+		for (; n >= 8; p += 8, n -= 8)
+		{
+			std::uint32_t lo = LoadLE32(p);
+			std::uint32_t hi = LoadLE32(p + 4);
+			if constexpr (Lowercase)
+			{
+				lo = ToLower4(lo);
+				hi = ToLower4(hi);
+			}
+
+			lo ^= hash;
+			hash = crc32Tables[7][lo & 0xFF] ^ crc32Tables[6][(lo >> 8) & 0xFF] ^
+				   crc32Tables[5][(lo >> 16) & 0xFF] ^ crc32Tables[4][lo >> 24] ^
+				   crc32Tables[3][hi & 0xFF] ^ crc32Tables[2][(hi >> 8) & 0xFF] ^
+				   crc32Tables[1][(hi >> 16) & 0xFF] ^ crc32Tables[0][hi >> 24];
+		}
+
+		for (; n > 0; p++, n--)
 		{
-			hash = crc32Table[std::tolower(str[i]) ^ (hash & 0xFF)] ^ (hash >> 8);
+			const std::uint8_t c = Lowercase ? ToLower(*p) : *p;
+			hash = crc32Table[c ^ (hash & 0xFF)] ^ (hash >> 8);
 		}
 
 		return hash;
 	}
 
+#ifdef NOIRE_CRC32_PCLMUL
+	// strings shorter than this don't gain enough from the folding to make up for the setup
+	static constexpr std::size_t PclmulMinLength{ 64 };
+
+	static bool HasPclmul()
+	{
+		static const bool hasPclmul = []() {
+			// CPUID leaf 1, ECX bit 1 is PCLMULQDQ and bit 19 is SSE4.1
+			int info[4]{};
+			__cpuid(info, 1);
+			const unsigned int ecx = static_cast<unsigned int>(info[2]);
+			return (ecx & (1u << 1)) != 0 && (ecx & (1u << 19)) != 0;
+		}();
+		return hasPclmul;
+	}
+
+	template<bool Lowercase>
+	static inline __m128i Load128(const std::uint8_t* p)
+	{
+		__m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+		if constexpr (Lowercase)
+		{
+			// bytes above 0x7F are negative and never between 'A' and 'Z'
+			const __m128i upper = _mm_and_si128(_mm_cmpgt_epi8(v, _mm_set1_epi8('A' - 1)),
+												_mm_cmplt_epi8(v, _mm_set1_epi8('Z' + 1)));
+			v = _mm_or_si128(v, _mm_and_si128(upper, _mm_set1_epi8(0x20)));
+		}
+		return v;
+	}
+
+	static inline __m128i Fold128(__m128i x, __m128i next, __m128i k)
+	{
+		const __m128i lo = _mm_clmulepi64_si128(x, k, 0x00);
+		const __m128i hi = _mm_clmulepi64_si128(x, k, 0x11);
+		return _mm_xor_si128(_mm_xor_si128(hi, next), lo);
+	}
+
+	// Folds 'n' bytes into the CRC with carry-less multiplications, as described in Intel's
+	// "Fast CRC Computation for Generic Polynomials Using PCLMULQDQ Instruction". 'n' must be a
+	// multiple of 16 and at least 64.
+	template<bool Lowercase>
+	static std::uint32_t crc32Pclmul(const std::uint8_t* p, std::size_t n, std::uint32_t hash)
+	{
+		Expects(n >= 64 && (n % 16) == 0);
+
+		// constants for the bit-reflected CRC-32 polynomial
+		const __m128i k1k2 = _mm_set_epi64x(0x01C6E41596, 0x0154442BD4);
+		const __m128i k3k4 = _mm_set_epi64x(0x00CCAA009E, 0x01751997D0);
+		const __m128i k5 = _mm_set_epi64x(0, 0x0163CD6124);
+		const __m128i poly = _mm_set_epi64x(0x01F7011641, 0x01DB710641);
+		const __m128i mask32 = _mm_setr_epi32(~0, 0, ~0, 0);
+
+		__m128i x1 = Load128<Lowercase>(p + 0x00);
+		__m128i x2 = Load128<Lowercase>(p + 0x10);
+		__m128i x3 = Load128<Lowercase>(p + 0x20);
+		__m128i x4 = Load128<Lowercase>(p + 0x30);
+		x1 = _mm_xor_si128(x1, _mm_cvtsi32_si128(static_cast<int>(hash)));
+		p += 64;
+		n -= 64;
+
+		// fold 64 bytes at a time
+		for (; n >= 64; p += 64, n -= 64)
+		{
+			const __m128i x5 = _mm_clmulepi64_si128(x1, k1k2, 0x00);
+			const __m128i x6 = _mm_clmulepi64_si128(x2, k1k2, 0x00);
+			const __m128i x7 = _mm_clmulepi64_si128(x3, k1k2, 0x00);
+			const __m128i x8 = _mm_clmulepi64_si128(x4, k1k2, 0x00);
+
+			x1 = _mm_clmulepi64_si128(x1, k1k2, 0x11);
+			x2 = _mm_clmulepi64_si128(x2, k1k2, 0x11);
+			x3 = _mm_clmulepi64_si128(x3, k1k2, 0x11);
+			x4 = _mm_clmulepi64_si128(x4, k1k2, 0x11);
+
+			x1 = _mm_xor_si128(_mm_xor_si128(x1, x5), Load128<Lowercase>(p + 0x00));
+			x2 = _mm_xor_si128(_mm_xor_si128(x2, x6), Load128<Lowercase>(p + 0x10));
+			x3 = _mm_xor_si128(_mm_xor_si128(x3, x7), Load128<Lowercase>(p + 0x20));
+			x4 = _mm_xor_si128(_mm_xor_si128(x4, x8), Load128<Lowercase>(p + 0x30));
+		}
+
+		// fold the 4 lanes and the remaining 16-byte blocks into one
+		x1 = Fold128(x1, x2, k3k4);
+		x1 = Fold128(x1, x3, k3k4);
+		x1 = Fold128(x1, x4, k3k4);
+		for (; n >= 16; p += 16, n -= 16)
+		{
+			x1 = Fold128(x1, Load128<Lowercase>(p), k3k4);
+		}
+
+		// fold 128 bits to 64 bits
+		x2 = _mm_clmulepi64_si128(x1, k3k4, 0x10);
+		x1 = _mm_xor_si128(_mm_srli_si128(x1, 8), x2);
+
+		x2 = _mm_srli_si128(x1, 4);
+		x1 = _mm_and_si128(x1, mask32);
+		x1 = _mm_clmulepi64_si128(x1, k5, 0x00);
+		x1 = _mm_xor_si128(x1, x2);
+
+		// Barrett reduction to 32 bits
+		x2 = _mm_and_si128(x1, mask32);
+		x2 = _mm_clmulepi64_si128(x2, poly, 0x10);
+		x2 = _mm_and_si128(x2, mask32);
+		x2 = _mm_clmulepi64_si128(x2, poly, 0x00);
+		x1 = _mm_xor_si128(x1, x2);
+
+		return static_cast<std::uint32_t>(_mm_extract_epi32(x1, 1));
+	}
+#endif
+
+	template<bool Lowercase>
+	static std::uint32_t crc32Runtime(std::string_view str, std::uint32_t hash)
+	{
+		const std::uint8_t* p = reinterpret_cast<const std::uint8_t*>(str.data());
+		std::size_t n = str.size();
+
+#ifdef NOIRE_CRC32_PCLMUL
+		if (n >= PclmulMinLength && HasPclmul())
+		{
+			const std::size_t blocksSize = n & ~std::size_t{ 15 };
+			hash = crc32Pclmul<Lowercase>(p, blocksSize, hash);
+			p += blocksSize;
+			n -= blocksSize;
+		}
+#endif
+
+		return crc32Slicing8<Lowercase>(p, n, hash);
+	}
+
+	std::uint32_t crc32Partial(std::string_view str, std::uint32_t inHash)
+	{
+		return crc32Runtime<false>(str, inHash);
+	}
+
+	std::uint32_t crc32(std::string_view str, std::uint32_t inHash)
+	{
+		return ~crc32Partial(str, inHash);
+	}
+
+	std::uint32_t crc32LowercasePartial(std::string_view str, std::uint32_t inHash)
+	{
+		return crc32Runtime<true>(str, inHash);
+	}
+
 	std::uint32_t crc32Lowercase(std::string_view str, std::uint32_t inHash)
 	{
 		return ~crc32LowercasePartial(str, inHash);
 	}
 
+	// Layout of the databases compiled by 'noire-cli compile-hashes', see core/Hash.cpp: a
+	// header, then the hashes (in Eytzinger order) and string offsets of each table and the
+	// strings. The top bits of the string offsets tell which case of the string has the hash.
+	struct HashDbRawHeader
+	{
+		std::uint32_t Magic;
+		std::uint32_t Version;
+		std::uint32_t Counts[3];
+		std::uint32_t StringsSize;
+	};
+	static_assert(sizeof(HashDbRawHeader) == 24);
+
+	static constexpr std::uint32_t HashDbMagic{ 0x4244484E }; // 'NHDB'
+	static constexpr std::uint32_t HashDbVersion{ 1 };
+	static constexpr std::size_t HashDbCaseInsensitiveTable{ 1 };
+	static constexpr std::size_t HashDbCaseSensitiveTable{ 2 }; // also has the uppercase strings
+	static constexpr std::uint32_t HashDbCaseShift{ 30 };
+	static constexpr std::uint32_t HashDbOffsetMask{ (std::uint32_t{ 1 } << HashDbCaseShift) - 1 };
+
+	enum class HashDbCase : std::uint32_t
+	{
+		Original = 0,
+		Lowercase,
+		Uppercase,
+	};
+
+	// Same conversion as loading the text database
+	static std::string ToCase(std::string str, HashDbCase strCase)
+	{
+		if (strCase != HashDbCase::Original)
+		{
+			for (auto& c : str)
+			{
+				c = static_cast<char>(strCase == HashDbCase::Lowercase ? std::tolower(c) :
+																		 std::toupper(c));
+			}
+		}
+		return str;
+	}
+
 	CHashDatabase::CHashDatabase(const std::filesystem::path& dbPath, bool caseSensitive)
-		: mHashToStr{}, mCaseSensitive{ caseSensitive }
+		: mHashToStr{},
+		  mCaseSensitive{ caseSensitive },
+		  mCompiledFile{ INVALID_HANDLE_VALUE },
+		  mCompiledMapping{ nullptr },
+		  mCompiledView{ nullptr },
+		  mCompiledHashes{ nullptr },
+		  mCompiledOffsets{ nullptr },
+		  mCompiledCount{ 0 },
+		  mCompiledStrings{}
 	{
 		Load(dbPath);
 	}
 
+	CHashDatabase::CHashDatabase(const std::filesystem::path& dbPath,
+								 bool caseSensitive,
+								 std::size_t threadCount)
+		: mHashToStr{},
+		  mCaseSensitive{ caseSensitive },
+		  mCompiledFile{ INVALID_HANDLE_VALUE },
+		  mCompiledMapping{ nullptr },
+		  mCompiledView{ nullptr },
+		  mCompiledHashes{ nullptr },
+		  mCompiledOffsets{ nullptr },
+		  mCompiledCount{ 0 },
+		  mCompiledStrings{}
+	{
+		Load(dbPath, threadCount);
+	}
+
+	CHashDatabase::~CHashDatabase()
+	{
+		if (mCompiledView)
+		{
+			UnmapViewOfFile(mCompiledView);
+		}
+
+		if (mCompiledMapping)
+		{
+			CloseHandle(mCompiledMapping);
+		}
+
+		if (mCompiledFile != INVALID_HANDLE_VALUE)
+		{
+			CloseHandle(mCompiledFile);
+		}
+	}
+
 	std::string CHashDatabase::TryGetString(std::uint32_t hash) const
 	{
-		auto it = mHashToStr.find(hash);
-		if (it == mHashToStr.end())
+		std::optional<std::string> found = Find(hash);
+		if (!found)
 		{
 			std::array<char, 16> buffer{};
 			const auto [p, ec] =
@@ -98,19 +381,52 @@ namespace noire
 		}
 		else
 		{
-			return it->second;
+			return std::move(*found);
 		}
 	}
 
 	std::optional<std::string> CHashDatabase::GetString(std::uint32_t hash) const
 	{
-		auto it = mHashToStr.find(hash);
-		return it == mHashToStr.end() ? std::nullopt : std::make_optional(it->second);
+		return Find(hash);
+	}
+
+	std::optional<std::string> CHashDatabase::Find(std::uint32_t hash) const
+	{
+		if (!mCompiledView)
+		{
+			auto it = mHashToStr.find(hash);
+			return it == mHashToStr.end() ? std::nullopt : std::make_optional(it->second);
+		}
+
+		std::size_t k = 1;
+		while (k <= mCompiledCount)
+		{
+			k = 2 * k + (mCompiledHashes[k - 1] < hash);
+		}
+		while (k & 1)
+		{
+			k >>= 1;
+		}
+		k >>= 1;
+
+		const std::uint32_t offset = k == 0 ? 0 : mCompiledOffsets[k - 1] & HashDbOffsetMask;
+		if (k == 0 || mCompiledHashes[k - 1] != hash || offset >= mCompiledStrings.size())
+		{
+			return std::nullopt;
+		}
+
+		const std::string_view str = mCompiledStrings.substr(offset);
+		return ToCase(std::string{ str.substr(0, str.find('\0')) },
+					  static_cast<HashDbCase>(mCompiledOffsets[k - 1] >> HashDbCaseShift));
 	}
 
 	void CHashDatabase::Load(const std::filesystem::path& dbPath)
 	{
-		auto fp = std::filesystem::absolute(dbPath);
+		if (LoadCompiled(dbPath))
+		{
+			return;
+		}
+
 		std::ifstream f{ dbPath, std::ios::in };
 
 		if (mCaseSensitive)
@@ -145,17 +461,231 @@ namespace noire
 		}
 	}
 
+	// Loads the same strings as the single-threaded Load. Each thread parses a chunk of lines and
+	// sorts their hashes into shards, then each shard is filled from the chunks in order so the
+	// first string with each hash is kept, and the shards are merged into the lookup table.
+	void CHashDatabase::Load(const std::filesystem::path& dbPath, std::size_t threadCount)
+	{
+		if (LoadCompiled(dbPath))
+		{
+			return;
+		}
+
+		constexpr std::size_t ShardCount{ 64 };
+		constexpr std::size_t MinChunkSize{ 64 * 1024 };
+
+		std::string text{};
+		{
+			std::ifstream f{ dbPath, std::ios::in | std::ios::binary };
+			std::error_code ec;
+			const auto fileSize = std::filesystem::file_size(dbPath, ec);
+			if (!f || ec)
+			{
+				return;
+			}
+
+			text.resize(gsl::narrow<std::size_t>(fileSize));
+			f.read(text.data(), text.size());
+			text.resize(gsl::narrow<std::size_t>(f.gcount()));
+		}
+
+		if (threadCount == 0)
+		{
+			threadCount = std::max(1u, std::thread::hardware_concurrency());
+		}
+
+		// chunks end after a '\n', so no line is split between them
+		const std::size_t chunkCount =
+			std::max<std::size_t>(1, std::min(threadCount, text.size() / MinChunkSize));
+		std::vector<std::string_view> chunks{};
+		const std::string_view textView{ text };
+		for (std::size_t i = 1, begin = 0; i <= chunkCount && begin < text.size(); i++)
+		{
+			std::size_t end =
+				i == chunkCount ?
+					std::string_view::npos :
+					textView.find('\n', std::max(begin, text.size() * i / chunkCount));
+			end = end == std::string_view::npos ? text.size() : end + 1;
+			chunks.emplace_back(textView.substr(begin, end - begin));
+			begin = end;
+		}
+
+		struct PendingString
+		{
+			std::uint32_t Hash;
+			HashDbCase Case;
+			std::string_view Line;
+		};
+		using ChunkShards = std::array<std::vector<PendingString>, ShardCount>;
+		std::vector<ChunkShards> pending(chunks.size());
+		std::vector<std::thread> threads{};
+		for (std::size_t c = 0; c < chunks.size(); c++)
+		{
+			threads.emplace_back([this, &chunks, &pending, c]() {
+				const std::string_view chunk = chunks[c];
+				ChunkShards& shards = pending[c];
+				const auto add = [&shards](std::string_view line, HashDbCase strCase) {
+					const std::uint32_t hash = crc32(ToCase(std::string{ line }, strCase));
+					shards[hash % ShardCount].push_back({ hash, strCase, line });
+				};
+
+				// same lines as std::getline
+				for (std::size_t pos = 0; pos < chunk.size();)
+				{
+					const std::size_t newLine = chunk.find('\n', pos);
+					const std::string_view line = chunk.substr(pos, newLine - pos);
+					pos = newLine == std::string_view::npos ? chunk.size() : newLine + 1;
+
+					if (mCaseSensitive)
+					{
+						add(line, HashDbCase::Original);
+						add(line, HashDbCase::Uppercase);
+						add(line, HashDbCase::Lowercase);
+					}
+					else
+					{
+						const std::uint32_t hash = crc32Lowercase(line);
+						shards[hash % ShardCount].push_back({ hash, HashDbCase::Original, line });
+					}
+				}
+			});
+		}
+		for (std::thread& t : threads)
+		{
+			t.join();
+		}
+		threads.clear();
+
+		std::array<std::unordered_map<std::uint32_t, std::string>, ShardCount> shards{};
+		for (std::size_t t = 0; t < threadCount; t++)
+		{
+			threads.emplace_back([&pending, &shards, t, threadCount]() {
+				for (std::size_t s = t; s < ShardCount; s += threadCount)
+				{
+					for (const ChunkShards& chunk : pending)
+					{
+						for (const PendingString& p : chunk[s])
+						{
+							auto [it, added] = shards[s].try_emplace(p.Hash);
+							if (added)
+							{
+								it->second = ToCase(std::string{ p.Line }, p.Case);
+							}
+						}
+					}
+				}
+			});
+		}
+		for (std::thread& t : threads)
+		{
+			t.join();
+		}
+
+		// the shards have different hashes, merging only moves their nodes
+		std::size_t count = 0;
+		for (const auto& shard : shards)
+		{
+			count += shard.size();
+		}
+		mHashToStr.reserve(count);
+		for (auto& shard : shards)
+		{
+			mHashToStr.merge(shard);
+		}
+	}
+
+	// Returns false if the file is not a compiled database. A compiled database that is not valid
+	// is loaded as empty.
+	bool CHashDatabase::LoadCompiled(const std::filesystem::path& dbPath)
+	{
+		std::error_code ec;
+		if (std::filesystem::file_size(dbPath, ec) < sizeof(HashDbRawHeader) || ec)
+		{
+			return false;
+		}
+
+		HashDbRawHeader h{};
+		{
+			std::ifstream f{ dbPath, std::ios::in | std::ios::binary };
+			f.read(reinterpret_cast<char*>(&h), sizeof(h));
+			if (!f || h.Magic != HashDbMagic)
+			{
+				return false;
+			}
+		}
+
+		std::uint64_t stringsOffset = sizeof(HashDbRawHeader);
+		std::uint64_t tableOffset = 0;
+		const std::size_t table = mCaseSensitive ? HashDbCaseSensitiveTable :
+												   HashDbCaseInsensitiveTable;
+		for (std::size_t t = 0; t < std::size(h.Counts); t++)
+		{
+			tableOffset = t == table ? stringsOffset : tableOffset;
+			stringsOffset += std::uint64_t{ 2 } * sizeof(std::uint32_t) * h.Counts[t];
+		}
+
+		if (h.Version != HashDbVersion ||
+			stringsOffset + h.StringsSize != std::filesystem::file_size(dbPath, ec))
+		{
+			return true;
+		}
+
+		mCompiledFile = CreateFileW(dbPath.c_str(),
+									GENERIC_READ,
+									FILE_SHARE_READ,
+									nullptr,
+									OPEN_EXISTING,
+									FILE_ATTRIBUTE_NORMAL,
+									nullptr);
+		if (mCompiledFile == INVALID_HANDLE_VALUE)
+		{
+			return true;
+		}
+
+		mCompiledMapping = CreateFileMappingW(mCompiledFile, nullptr, PAGE_READONLY, 0, 0, nullptr);
+		mCompiledView =
+			mCompiledMapping ? MapViewOfFile(mCompiledMapping, FILE_MAP_READ, 0, 0, 0) : nullptr;
+		if (!mCompiledView)
+		{
+			return true;
+		}
+
+		const char* data = static_cast<const char*>(mCompiledView);
+		mCompiledHashes = reinterpret_cast<const std::uint32_t*>(data + tableOffset);
+		mCompiledOffsets = mCompiledHashes + h.Counts[table];
+		mCompiledCount = h.Counts[table];
+		mCompiledStrings = { data + stringsOffset, h.StringsSize };
+		return true;
+	}
+
+	// The compiled database is used unless the text one was modified after compiling it
+	static std::filesystem::path DefaultHashesPath()
+	{
+		const std::filesystem::path textPath{ "hashes.db" };
+		const std::filesystem::path compiledPath{ "hashes.bin" };
+
+		std::error_code ec;
+		const auto compiledTime = std::filesystem::last_write_time(compiledPath, ec);
+		if (ec)
+		{
+			return textPath;
+		}
+
+		const auto textTime = std::filesystem::last_write_time(textPath, ec);
+		return ec || compiledTime >= textTime ? compiledPath : textPath;
+	}
+
 	const CHashDatabase& CHashDatabase::Instance(bool caseSensitive)
 	{
 		if (caseSensitive)
 		{
-			static CHashDatabase inst{ "hashes.db", true };
+			static CHashDatabase inst{ DefaultHashesPath(), true, 0 };
 			return inst;
 		}
 		else
 		{
-			static CHashDatabase inst{ "hashes.db", false };
+			static CHashDatabase inst{ DefaultHashesPath(), false, 0 };
 			return inst;
 		}
 	}
-}
\ No newline at end of file
+}
@@ -1,4 +1,5 @@
 #pragma once
+#include <cstddef>
 #include <cstdint>
 #include <filesystem>
 #include <optional>
@@ -16,7 +17,21 @@ namespace noire
 	class CHashDatabase
 	{
 	public:
+		/// Loads a text hashes database, one string per line, or one compiled with
+		/// 'noire-cli compile-hashes'.
 		CHashDatabase(const std::filesystem::path& dbPath, bool caseSensitive);
+		/// Same as above, but a text database is split in chunks that are parsed and hashed on
+		/// 'threadCount' threads (0 for all hardware threads).
+		CHashDatabase(const std::filesystem::path& dbPath,
+					  bool caseSensitive,
+					  std::size_t threadCount);
+		~CHashDatabase();
+
+		CHashDatabase(const CHashDatabase&) = delete;
+		CHashDatabase(CHashDatabase&&) = delete;
+
+		CHashDatabase& operator=(const CHashDatabase&) = delete;
+		CHashDatabase& operator=(CHashDatabase&&) = delete;
 
 		/// Tries to translate the hash to a string. If no translation is found, the hash converted
 		/// to a hexadecimal string (without '0x' prefix) is returned.
@@ -30,8 +45,20 @@ namespace noire
 
 	private:
 		void Load(const std::filesystem::path& dbPath);
+		void Load(const std::filesystem::path& dbPath, std::size_t threadCount);
+		bool LoadCompiled(const std::filesystem::path& dbPath);
+		std::optional<std::string> Find(std::uint32_t hash) const;
 
 		std::unordered_map<std::uint32_t, std::string> mHashToStr;
 		bool mCaseSensitive;
+
+		// of a compiled database, mapped into memory
+		void* mCompiledFile;
+		void* mCompiledMapping;
+		const void* mCompiledView;
+		const std::uint32_t* mCompiledHashes;  // in Eytzinger order
+		const std::uint32_t* mCompiledOffsets; // offset and case of the string of each hash
+		std::uint32_t mCompiledCount;
+		std::string_view mCompiledStrings;
 	};
 }
@@ -1,8 +1,19 @@
 #include "TrunkFile.h"
 #include <gsl/gsl>
+#include <type_traits>
+#include <vector>
 
 namespace noire
 {
+	// entry as stored in the file
+	struct STrunkRawEntry
+	{
+		std::uint32_t NameHash;
+		std::uint32_t Size;
+		std::uint32_t Offset;
+	};
+	static_assert(sizeof(STrunkRawEntry) == 12 && std::is_trivially_copyable_v<STrunkRawEntry>);
+
 	CTrunkFile::CTrunkFile(fs::IFileStream& stream) : mStream{ stream }, mEntries{}, mHeader{}
 	{
 		LoadEntries();
@@ -32,14 +43,15 @@ namespace noire
 		mHeader.SecondaryDataSize = secondaryDataSize;
 
 		const std::uint32_t entryCount = mStream.Read<std::uint32_t>();
+
+		// read the whole entry table at once
+		std::vector<STrunkRawEntry> rawEntries(entryCount);
+		mStream.Read(rawEntries.data(), rawEntries.size() * sizeof(STrunkRawEntry));
+
 		mEntries.reserve(entryCount);
-		for (std::size_t i = 0; i < entryCount; i++)
+		for (const STrunkRawEntry& e : rawEntries)
 		{
-			const std::uint32_t nameHash = mStream.Read<std::uint32_t>();
-			const std::uint32_t size = mStream.Read<std::uint32_t>();
-			const std::uint32_t offset = mStream.Read<std::uint32_t>();
-
-			mEntries.emplace_back(nameHash, size, offset);
+			mEntries.emplace_back(e.NameHash, e.Size, e.Offset);
 		}
 	}
 
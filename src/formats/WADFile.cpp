@@ -1,11 +1,23 @@
 #include "WADFile.h"
 #include "fs/FileSystem.h"
 #include <algorithm>
+#include <cstring>
 #include <gsl/gsl>
 #include <string_view>
+#include <type_traits>
+#include <vector>
 
 namespace noire
 {
+	// entry as stored in the file
+	struct SWADRawEntry
+	{
+		std::uint32_t PathHash;
+		std::uint32_t Offset;
+		std::uint32_t Size;
+	};
+	static_assert(sizeof(SWADRawEntry) == 12 && std::is_trivially_copyable_v<SWADRawEntry>);
+
 	WADChildFile::WADChildFile(const WADFile* owner, std::size_t entryIndex)
 		: mOwner{ owner }, mEntryIndex{ entryIndex }
 	{
@@ -84,29 +96,39 @@ namespace noire
 		std::uint32_t entryCount;
 		mStream.Read(&entryCount, sizeof(entryCount));
 
-		mEntries.reserve(entryCount);
-
-		// read entries
-		for (std::size_t i = 0; i < entryCount; i++)
+		if (entryCount == 0)
 		{
-			std::uint32_t hash, offset, size;
-			mStream.Read(&hash, sizeof(hash));
-			mStream.Read(&offset, sizeof(offset));
-			mStream.Read(&size, sizeof(size));
+			return;
+		}
+
+		// read the whole entry table at once
+		std::vector<SWADRawEntry> rawEntries(entryCount);
+		mStream.Read(rawEntries.data(), rawEntries.size() * sizeof(SWADRawEntry));
 
-			mEntries.emplace_back("", hash, offset, size);
+		mEntries.reserve(entryCount);
+		for (const SWADRawEntry& e : rawEntries)
+		{
+			mEntries.emplace_back("", e.PathHash, e.Offset, e.Size);
 		}
 
-		// read path
-		mStream.Seek(mEntries.back().Offset + mEntries.back().Size);
+		// read all paths at once, they are stored after the data of the last entry until the end
+		const fs::FileStreamSize pathsOffset = mEntries.back().Offset + mEntries.back().Size;
+		Expects(pathsOffset <= mStream.Size());
+		std::vector<char> paths(gsl::narrow<std::size_t>(mStream.Size() - pathsOffset));
+		mStream.Seek(pathsOffset);
+		mStream.Read(paths.data(), paths.size());
+
+		std::size_t pathOffset = 0;
 		for (std::size_t i = 0; i < entryCount; i++)
 		{
 			std::uint16_t strLength{ 0 };
-			mStream.Read(&strLength, sizeof(strLength));
+			Expects(pathOffset + sizeof(strLength) <= paths.size());
+			std::memcpy(&strLength, paths.data() + pathOffset, sizeof(strLength));
+			pathOffset += sizeof(strLength);
 
-			std::string& str = mEntries[i].Path;
-			str.resize(strLength);
-			mStream.Read(str.data(), strLength);
+			Expects(pathOffset + strLength <= paths.size());
+			mEntries[i].Path.assign(paths.data() + pathOffset, strLength);
+			pathOffset += strLength;
 		}
 	}
 
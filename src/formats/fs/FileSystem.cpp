@@ -1,36 +1,30 @@
 #include "FileSystem.h"
 #include <algorithm>
 #include <gsl/gsl>
+#include <utility>
 
 namespace noire::fs
 {
-	CFileSystem::CFileSystem() : mDeviceScanningEnabled{ false }, mDeviceTypes{}, mMounts{} {}
+	CFileSystem::CFileSystem()
+		: mDeviceScanningEnabled{ false }, mDeviceTypes{}, mMounts{}, mMountNodes(1)
+	{
+	}
 
 	void CFileSystem::Mount(SPathView path, std::unique_ptr<IDevice> device)
 	{
 		Expects(path.IsDirectory());
 		Expects(device);
 
-		bool exists = false;
-		for (auto& m : mMounts)
+		SMountNode& node = mMountNodes[FindMountNode(path, true)];
+		if (node.Mount != NoMount)
 		{
-			if (m.Path == path)
-			{
-				m.Device = std::move(device);
-				exists = true;
-				break;
-			}
+			mMounts[node.Mount].Device = std::move(device);
 		}
-
-		if (!exists)
+		else
 		{
 			// no mount with same path already exists, add new one
+			node.Mount = mMounts.size();
 			mMounts.emplace_back(path, std::move(device));
-
-			// sort the mounts, longest paths first
-			std::sort(mMounts.begin(), mMounts.end(), [](auto& a, auto& b) {
-				return a.Path.String().size() > b.Path.String().size();
-			});
 		}
 
 		if (mDeviceScanningEnabled)
@@ -43,10 +37,20 @@ namespace noire::fs
 	{
 		// TODO: should CFileSystem::Unmount unmount any child mount points (mounts that have `path`
 		// in their path)?
-		mMounts.erase(std::remove_if(mMounts.begin(),
-									 mMounts.end(),
-									 [path](auto& m) { return m.Path == path; }),
-					  mMounts.end());
+		const std::size_t node = FindMountNode(path, false);
+		if (node == NoMount || mMountNodes[node].Mount == NoMount)
+		{
+			return;
+		}
+
+		// move the last mount to the removed one so the indices in the trie stay valid
+		const std::size_t mount = std::exchange(mMountNodes[node].Mount, NoMount);
+		if (mount != mMounts.size() - 1)
+		{
+			mMounts[mount] = std::move(mMounts.back());
+			mMountNodes[FindMountNode(mMounts[mount].Path, false)].Mount = mount;
+		}
+		mMounts.pop_back();
 	}
 
 	bool CFileSystem::PathExists(SPathView path)
@@ -119,9 +123,8 @@ namespace noire::fs
 			if (entry.Type == EDirectoryEntryType::File)
 			{
 				SPath possibleMountPath = entryFullPath + DirectorySeparator;
-				if (std::find_if(mMounts.begin(), mMounts.end(), [&possibleMountPath](auto& mount) {
-						return mount.Path == possibleMountPath;
-					}) != mMounts.end())
+				if (const std::size_t node = FindMountNode(possibleMountPath, false);
+					node != NoMount && mMountNodes[node].Mount != NoMount)
 				{
 					// found a mount with the same path as a file entry, convert it to a collection
 					// entry
@@ -138,15 +141,76 @@ namespace noire::fs
 
 	IDevice* CFileSystem::FindDevice(SPathView path, SPathView& outMountPath)
 	{
-		const std::string_view p = path.String();
-		auto it = std::find_if(mMounts.begin(), mMounts.end(), [p](const SMountPoint& m) {
-			// TODO: this check probably can be moved to SPathView
-			return p.size() >= m.Path.String().size() &&
-				   m.Path.String() == p.substr(0, m.Path.String().size());
-		});
+		const std::size_t mount = FindMount(path);
+		if (mount == NoMount)
+		{
+			outMountPath = {};
+			return nullptr;
+		}
+
+		outMountPath = mMounts[mount].Path;
+		return mMounts[mount].Device.get();
+	}
+
+	std::size_t CFileSystem::FindMountNode(SPathView dirPath, bool create)
+	{
+		Expects(dirPath.IsDirectory());
+
+		std::size_t node = 0;
+		std::string_view rest = dirPath.String();
+		while (!rest.empty())
+		{
+			const std::size_t nameLength = rest.find(DirectorySeparator);
+			const std::string_view name = rest.substr(0, nameLength);
+			rest.remove_prefix(nameLength + 1);
+
+			auto& children = mMountNodes[node].Children;
+			if (auto it = children.find(name); it != children.end())
+			{
+				node = it->second;
+			}
+			else if (create)
+			{
+				const std::size_t child = mMountNodes.size();
+				children.emplace(std::string{ name }, child);
+				mMountNodes.emplace_back();
+				node = child;
+			}
+			else
+			{
+				return NoMount;
+			}
+		}
+
+		return node;
+	}
+
+	std::size_t CFileSystem::FindMount(SPathView path) const
+	{
+		// follow the directories of the path, keeping the deepest mount found
+		std::size_t node = 0;
+		std::size_t mount = NoMount;
+		std::string_view rest = path.String();
+		for (std::size_t nameLength = rest.find(DirectorySeparator);
+			 nameLength != std::string_view::npos;
+			 nameLength = rest.find(DirectorySeparator))
+		{
+			const auto& children = mMountNodes[node].Children;
+			auto it = children.find(rest.substr(0, nameLength));
+			if (it == children.end())
+			{
+				break;
+			}
+
+			node = it->second;
+			if (mMountNodes[node].Mount != NoMount)
+			{
+				mount = mMountNodes[node].Mount;
+			}
+			rest.remove_prefix(nameLength + 1);
+		}
 
-		return it != mMounts.end() ? (outMountPath = it->Path, it->Device.get()) :
-									 (outMountPath = {}, nullptr);
+		return mount;
 	}
 
 	SPathView CFileSystem::GetDeviceMountPath(const IDevice* device) const
@@ -2,8 +2,11 @@
 #include "Device.h"
 #include "FileStream.h"
 #include "Path.h"
+#include <cstddef>
 #include <functional>
+#include <map>
 #include <memory>
+#include <string>
 #include <string_view>
 #include <utility>
 #include <vector>
@@ -72,10 +75,26 @@ namespace noire::fs
 								SDeviceType::CreatorFunction creator);
 
 	private:
+		static constexpr std::size_t NoMount{ ~std::size_t{ 0 } };
+
+		// Node of the mount paths trie, one per directory in the mount paths
+		struct SMountNode
+		{
+			// directory name -> index in mMountNodes
+			std::map<std::string, std::size_t, std::less<>> Children;
+			std::size_t Mount{ NoMount }; // index in mMounts
+		};
+
 		void ScanForDevices(SPathView path);
+		// Returns the index of the node of the directory or NoMount if it doesn't exist and
+		// 'create' is false
+		std::size_t FindMountNode(SPathView dirPath, bool create);
+		// Returns the index of the mount with the longest path that contains 'path' or NoMount
+		std::size_t FindMount(SPathView path) const;
 
 		bool mDeviceScanningEnabled;
 		std::vector<SDeviceType> mDeviceTypes;
 		std::vector<SMountPoint> mMounts;
+		std::vector<SMountNode> mMountNodes; // the first one is the empty path
 	};
 }
\ No newline at end of file
@@ -0,0 +1,370 @@
+#include "Collider.h"
+#include <algorithm>
+#include <core/Hash.h>
+#include <doctest/doctest.h>
+#include <map>
+#include <set>
+#include <tuple>
+#include <utility>
+
+namespace noire::collider
+{
+	static constexpr size NoPart{ static_cast<size>(-1) };
+	static constexpr u32 InitialState{ ~u32{ 0 } }; // CRC state before the first byte
+
+	Collider::Collider(bool lowercase, CollideMode mode)
+		: mTargets{},
+		  mTargetList{},
+		  mLowercase{ lowercase },
+		  mMode{ mode },
+		  mTestedCount{ 0 },
+		  mSplitPart{ NoPart },
+		  mTailPart{ NoPart },
+		  mSuffix{},
+		  mUseMeetInTheMiddle{ false },
+		  mTailGroups{},
+		  mMatchesMutex{},
+		  mMatches{}
+	{
+	}
+
+	bool Collider::AddTarget(u32 hash)
+	{
+		if (!mTargets.Insert(hash, 0))
+		{
+			return false;
+		}
+
+		mTargetList.push_back(~hash);
+		return true;
+	}
+
+	std::vector<Match> Collider::Run(const Template& t, ThreadPool& pool)
+	{
+		mMatches.clear();
+		Prepare(t);
+
+		std::vector<size> choices(t.Parts.size(), 0);
+		if (mSplitPart == NoPart)
+		{
+			// no variable parts, the template is a single name
+			const u32 state = Partial(mSuffix, InitialState);
+			std::vector<Match> matches{};
+			if (mTargets.Find(~state) != HashIndex::NotFound)
+			{
+				AddMatch(t, choices, ~state, matches);
+			}
+			mTestedCount++;
+			return matches;
+		}
+
+		// the literal text before the first variable part is the same for every candidate
+		u32 state = InitialState;
+		for (size i = 0; i < mSplitPart; i++)
+		{
+			state = Partial(t.Parts[i][0], state);
+		}
+
+		// the choices of the first variable part are split in batches between the tasks, the rest
+		// of the parts are enumerated by each task
+		const size splitCount = t.Parts[mSplitPart].Count();
+		size batchSize = (splitCount + pool.ThreadCount() * 8 - 1) / (pool.ThreadCount() * 8);
+		if (mUseMeetInTheMiddle && mSplitPart == mTailPart)
+		{
+			// every task would look up all the choices
+			batchSize = splitCount;
+		}
+
+		for (size begin = 0; begin < splitCount; begin += batchSize)
+		{
+			const size end = std::min(begin + batchSize, splitCount);
+			pool.Submit([this, &t, state, choices, begin, end]() mutable {
+				std::vector<Match> matches{};
+				u64 tested = 0;
+				Visit(t, mSplitPart, state, choices, begin, end, matches, tested);
+
+				mTestedCount += tested;
+				if (!matches.empty())
+				{
+					std::lock_guard lock{ mMatchesMutex };
+					for (Match& m : matches)
+					{
+						mMatches.push_back(std::move(m));
+					}
+				}
+			});
+		}
+		pool.Wait();
+
+		return std::move(mMatches);
+	}
+
+	u32 Collider::Partial(std::string_view str, u32 state) const
+	{
+		return mLowercase ? crc32LowercasePartial(str, state) : crc32Partial(str, state);
+	}
+
+	u32 Collider::AdvanceState(const TailGroup& g, u32 state) const
+	{
+		return g.Advance[0][state & 0xFF] ^ g.Advance[1][(state >> 8) & 0xFF] ^
+			   g.Advance[2][(state >> 16) & 0xFF] ^ g.Advance[3][state >> 24];
+	}
+
+	void Collider::Prepare(const Template& t)
+	{
+		mSplitPart = NoPart;
+		mTailPart = NoPart;
+		mSuffix.clear();
+		mUseMeetInTheMiddle = false;
+		mTailGroups.clear();
+
+		for (size i = 0; i < t.Parts.size(); i++)
+		{
+			if (t.Parts[i].Count() != 1)
+			{
+				mSplitPart = mSplitPart == NoPart ? i : mSplitPart;
+				mTailPart = i;
+			}
+		}
+
+		for (size i = mTailPart == NoPart ? 0 : mTailPart + 1; i < t.Parts.size(); i++)
+		{
+			mSuffix += t.Parts[i][0];
+		}
+
+		if (mTailPart == NoPart || mMode == CollideMode::Prefix)
+		{
+			return;
+		}
+
+		const TemplatePart& tail = t.Parts[mTailPart];
+		if (mMode == CollideMode::Auto)
+		{
+			// the tail table costs about as much to build as hashing the tails for one prefix
+			if (mSplitPart == mTailPart)
+			{
+				return;
+			}
+
+			// rough cost for each prefix, in hashed bytes
+			constexpr u64 LookupCost{ 16 };
+			std::set<size> lengths{};
+			u64 prefixCost = 0;
+			for (size c = 0; c < tail.Count(); c++)
+			{
+				prefixCost += tail[c].size() + mSuffix.size() + LookupCost;
+				lengths.insert(tail[c].size());
+			}
+
+			const u64 mitmCost = lengths.size() * (mTargetList.size() * LookupCost + 4);
+			if (mitmCost >= prefixCost)
+			{
+				return;
+			}
+		}
+
+		mUseMeetInTheMiddle = true;
+
+		std::map<size, size> groupOfLength{};
+		for (size c = 0; c < tail.Count(); c++)
+		{
+			const size length = tail[c].size() + mSuffix.size();
+			auto [it, added] = groupOfLength.try_emplace(length, mTailGroups.size());
+			if (added)
+			{
+				TailGroup& g = mTailGroups.emplace_back();
+				g.Length = length;
+
+				// hashing zero bytes is linear in the state, so the state after them is built from
+				// the states after each bit
+				const std::string zeros(length, '\0');
+				u32 bits[32];
+				for (u32 b = 0; b < 32; b++)
+				{
+					bits[b] = Partial(zeros, u32{ 1 } << b);
+				}
+
+				for (u32 k = 0; k < 4; k++)
+				{
+					for (u32 v = 0; v < 256; v++)
+					{
+						u32 advanced = 0;
+						for (u32 b = 0; b < 8; b++)
+						{
+							advanced ^= (v >> b) & 1 ? bits[k * 8 + b] : 0;
+						}
+						g.Advance[k][v] = advanced;
+					}
+				}
+			}
+
+			const u32 state = Partial(mSuffix, Partial(tail[c], 0));
+			mTailGroups[it->second].Tails.InsertDuplicate(state, static_cast<u32>(c));
+		}
+	}
+
+	void Collider::Visit(const Template& t,
+						 size part,
+						 u32 state,
+						 std::vector<size>& choices,
+						 size splitBegin,
+						 size splitEnd,
+						 std::vector<Match>& matches,
+						 u64& tested) const
+	{
+		const TemplatePart& p = t.Parts[part];
+		const size begin = part == mSplitPart ? splitBegin : 0;
+		const size end = part == mSplitPart ? splitEnd : p.Count();
+
+		if (part != mTailPart)
+		{
+			for (size c = begin; c < end; c++)
+			{
+				choices[part] = c;
+				Visit(t,
+					  part + 1,
+					  Partial(p[c], state),
+					  choices,
+					  splitBegin,
+					  splitEnd,
+					  matches,
+					  tested);
+			}
+		}
+		else if (!mUseMeetInTheMiddle)
+		{
+			for (size c = begin; c < end; c++)
+			{
+				u32 s = Partial(p[c], state);
+				if (!mSuffix.empty())
+				{
+					s = Partial(mSuffix, s);
+				}
+
+				if (mTargets.Find(~s) != HashIndex::NotFound)
+				{
+					choices[part] = c;
+					AddMatch(t, choices, ~s, matches);
+				}
+			}
+			tested += end - begin;
+		}
+		else
+		{
+			// the state after a tail of length L is Advance_L(state) ^ (state after the tail from
+			// state 0), so the tails that end with a target are found with one lookup per target
+			for (const TailGroup& g : mTailGroups)
+			{
+				const u32 advanced = AdvanceState(g, state);
+				for (u32 target : mTargetList)
+				{
+					g.Tails.FindIf(target ^ advanced, [&](u32 c) {
+						if (c >= begin && c < end)
+						{
+							choices[part] = c;
+							AddMatch(t, choices, ~target, matches);
+						}
+						return false; // keep looking for other tails with the same state
+					});
+				}
+			}
+			tested += end - begin;
+		}
+	}
+
+	void Collider::AddMatch(const Template& t,
+							const std::vector<size>& choices,
+							u32 hash,
+							std::vector<Match>& matches) const
+	{
+		std::string name{};
+		for (size i = 0; i < t.Parts.size(); i++)
+		{
+			name += t.Parts[i][choices[i]];
+		}
+
+		Ensures((mLowercase ? crc32Lowercase(name) : crc32(name)) == hash);
+		matches.push_back({ hash, std::move(name) });
+	}
+}
+
+TEST_SUITE("Collider")
+{
+	using namespace noire;
+	using namespace noire::collider;
+
+	static std::vector<Match> Collide(const Template& t,
+									  const std::vector<u32>& targets,
+									  bool lowercase,
+									  CollideMode mode,
+									  ThreadPool& pool)
+	{
+		Collider c{ lowercase, mode };
+		for (u32 hash : targets)
+		{
+			c.AddTarget(hash);
+		}
+
+		std::vector<Match> matches = c.Run(t, pool);
+		CHECK_EQ(c.UsedMeetInTheMiddle(), mode == CollideMode::MeetInTheMiddle);
+		std::sort(matches.begin(), matches.end(), [](const Match& a, const Match& b) {
+			return std::tie(a.Hash, a.Name) < std::tie(b.Hash, b.Name);
+		});
+		return matches;
+	}
+
+	static void CheckSameMatches(std::string_view templateStr,
+								 const std::vector<std::string>& names,
+								 bool lowercase)
+	{
+		const Choices words = std::make_shared<const std::vector<std::string>>(
+			std::vector<std::string>{ "alpha", "Beta", "gamma", "DELTA", "epsilon", "zeta" });
+		const Template t = ParseTemplate(templateStr, words);
+
+		// the names plus hashes that are not in the template
+		std::vector<u32> targets{ 0x12345678, 0xDEADBEEF, 0 };
+		for (const std::string& name : names)
+		{
+			targets.push_back(lowercase ? crc32Lowercase(name) : crc32(name));
+		}
+
+		ThreadPool pool{ 3 };
+		const std::vector<Match> prefix =
+			Collide(t, targets, lowercase, CollideMode::Prefix, pool);
+		const std::vector<Match> mitm =
+			Collide(t, targets, lowercase, CollideMode::MeetInTheMiddle, pool);
+
+		REQUIRE_EQ(prefix.size(), mitm.size());
+		for (size i = 0; i < prefix.size(); i++)
+		{
+			CHECK_EQ(prefix[i].Hash, mitm[i].Hash);
+			CHECK_EQ(prefix[i].Name, mitm[i].Name);
+		}
+
+		for (const std::string& name : names)
+		{
+			CHECK(std::any_of(prefix.begin(), prefix.end(), [&name](const Match& m) {
+				return m.Name == name;
+			}));
+		}
+	}
+
+	TEST_CASE("Prefix and MeetInTheMiddle find the same names")
+	{
+		const std::vector<std::string> names{ "out/alpha_07/zetaccc.dds",
+											  "out/DELTA_00/Betaa.dds",
+											  "out/epsilon_20/gammabb.dds" };
+		const std::string_view templateStr{ "out/{}_{00-20}/{}{a|bb|ccc}.dds" };
+
+		SUBCASE("Case sensitive") { CheckSameMatches(templateStr, names, false); }
+		SUBCASE("Lowercase") { CheckSameMatches(templateStr, names, true); }
+	}
+
+	TEST_CASE("MeetInTheMiddle with a single variable part")
+	{
+		const std::vector<std::string> names{ "dir/Beta.bin", "dir/zeta.bin" };
+
+		SUBCASE("Case sensitive") { CheckSameMatches("dir/{}.bin", names, false); }
+		SUBCASE("Lowercase") { CheckSameMatches("dir/{}.bin", names, true); }
+	}
+}
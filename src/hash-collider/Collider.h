@@ -0,0 +1,103 @@
+#pragma once
+#include "Template.h"
+#include <array>
+#include <atomic>
+#include <core/Common.h>
+#include <core/HashIndex.h>
+#include <core/ThreadPool.h>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace noire::collider
+{
+	struct Match
+	{
+		u32 Hash;
+		std::string Name;
+	};
+
+	enum class CollideMode
+	{
+		// Uses MeetInTheMiddle when it needs fewer operations than Prefix
+		Auto = 0,
+		// Walks the candidates depth-first, carrying the CRC of each prefix forward so each
+		// candidate only hashes its last part
+		Prefix,
+		// Like Prefix, but the last variable part isn't hashed for each prefix. Instead, its
+		// choices are grouped by length and their CRCs stored in a table, then looked up for
+		// each prefix and target using the linearity of CRC.
+		MeetInTheMiddle,
+	};
+
+	// Searches the candidate names of templates for the ones with an unknown hash.
+	class Collider
+	{
+	public:
+		// With 'lowercase', the candidates are hashed as if they were lowercase, like
+		// crc32Lowercase.
+		Collider(bool lowercase, CollideMode mode = CollideMode::Auto);
+
+		Collider(const Collider&) = delete;
+		Collider(Collider&&) = delete;
+
+		Collider& operator=(const Collider&) = delete;
+		Collider& operator=(Collider&&) = delete;
+
+		// Returns false if the hash was already a target
+		bool AddTarget(u32 hash);
+		size TargetCount() const { return mTargets.Count(); }
+
+		// Hashes every candidate of the template on the threads of the pool, returns the ones
+		// whose hash is a target.
+		std::vector<Match> Run(const Template& t, ThreadPool& pool);
+
+		// Number of candidates tested so far
+		u64 TestedCount() const { return mTestedCount.load(); }
+		// Whether the last Run used CollideMode::MeetInTheMiddle
+		bool UsedMeetInTheMiddle() const { return mUseMeetInTheMiddle; }
+
+	private:
+		// Choices of the last variable part with the same length, plus the literal text after it
+		struct TailGroup
+		{
+			size Length;
+			// Advance[k][b] is the CRC state after hashing 'Length' zero bytes from state
+			// b << (8 * k). Hashing the tail from state S gives Advance(S) ^ the CRC of the tail
+			// from state 0.
+			std::array<std::array<u32, 256>, 4> Advance;
+			HashIndex Tails; // CRC of the tail from state 0 -> choice index
+		};
+
+		u32 Partial(std::string_view str, u32 state) const;
+		u32 AdvanceState(const TailGroup& g, u32 state) const;
+		void Prepare(const Template& t);
+		void Visit(const Template& t,
+				   size part,
+				   u32 state,
+				   std::vector<size>& choices,
+				   size splitBegin,
+				   size splitEnd,
+				   std::vector<Match>& matches,
+				   u64& tested) const;
+		void AddMatch(const Template& t,
+					  const std::vector<size>& choices,
+					  u32 hash,
+					  std::vector<Match>& matches) const;
+
+		HashIndex mTargets;           // hash -> 0
+		std::vector<u32> mTargetList; // CRC state each target ends with, before the final NOT
+		bool mLowercase;
+		CollideMode mMode;
+		std::atomic<u64> mTestedCount;
+
+		// of the current Run
+		size mSplitPart;     // first variable part, its choices are split between tasks
+		size mTailPart;      // last variable part
+		std::string mSuffix; // literal text after the last variable part
+		bool mUseMeetInTheMiddle;
+		std::vector<TailGroup> mTailGroups;
+		std::mutex mMatchesMutex;
+		std::vector<Match> mMatches;
+	};
+}
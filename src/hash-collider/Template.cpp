@@ -0,0 +1,243 @@
+#include "Template.h"
+#include <charconv>
+#include <doctest/doctest.h>
+#include <limits>
+#include <stdexcept>
+#include <utility>
+
+namespace noire::collider
+{
+	u64 Template::CandidateCount() const
+	{
+		u64 count = 1;
+		for (const TemplatePart& p : Parts)
+		{
+			if (p.Count() != 0 && count > std::numeric_limits<u64>::max() / p.Count())
+			{
+				return std::numeric_limits<u64>::max();
+			}
+
+			count *= p.Count();
+		}
+		return count;
+	}
+
+	static bool ParseNumber(std::string_view str, u64& value)
+	{
+		const auto [p, ec] = std::from_chars(str.data(), str.data() + str.size(), value);
+		return ec == std::errc{} && p == str.data() + str.size();
+	}
+
+	// Parses '{first-last}', returns false if 'str' is not a range
+	static bool ParseRange(std::string_view str, std::vector<std::string>& values)
+	{
+		const size dash = str.find('-');
+		if (dash == std::string_view::npos || dash == 0)
+		{
+			return false;
+		}
+
+		const std::string_view firstStr = str.substr(0, dash);
+		u64 first, last;
+		if (!ParseNumber(firstStr, first) || !ParseNumber(str.substr(dash + 1), last))
+		{
+			return false;
+		}
+
+		if (first > last)
+		{
+			throw std::invalid_argument{ "range '" + std::string{ str } + "' is empty" };
+		}
+
+		const size width = firstStr.size();
+		for (u64 n = first;; n++)
+		{
+			std::string v = std::to_string(n);
+			if (v.size() < width)
+			{
+				v.insert(0, width - v.size(), '0');
+			}
+			values.emplace_back(std::move(v));
+
+			if (n == last)
+			{
+				break;
+			}
+		}
+		return true;
+	}
+
+	Template ParseTemplate(std::string_view str, const Choices& words)
+	{
+		Template t{ std::string{ str }, {} };
+
+		const auto addLiteral = [&t](std::string_view literal) {
+			if (!literal.empty())
+			{
+				t.Parts.push_back({ std::make_shared<const std::vector<std::string>>(
+					std::vector<std::string>{ std::string{ literal } }) });
+			}
+		};
+
+		size pos = 0;
+		while (pos < str.size())
+		{
+			const size open = str.find_first_of("{}", pos);
+			if (open == std::string_view::npos)
+			{
+				addLiteral(str.substr(pos));
+				break;
+			}
+
+			const size close = str.find('}', open);
+			if (str[open] == '}' || close == std::string_view::npos ||
+				str.find('{', open + 1) < close)
+			{
+				throw std::invalid_argument{ "unbalanced braces in template '" +
+											 std::string{ str } + "'" };
+			}
+
+			addLiteral(str.substr(pos, open - pos));
+
+			const std::string_view group = str.substr(open + 1, close - open - 1);
+			if (group.empty())
+			{
+				if (!words || words->empty())
+				{
+					throw std::invalid_argument{ "template '" + std::string{ str } +
+												 "' uses '{}' but no words were given" };
+				}
+
+				t.Parts.push_back({ words });
+			}
+			else
+			{
+				std::vector<std::string> values{};
+				if (!ParseRange(group, values))
+				{
+					for (size start = 0;;)
+					{
+						const size bar = group.find('|', start);
+						values.emplace_back(group.substr(start, bar - start));
+						if (bar == std::string_view::npos)
+						{
+							break;
+						}
+						start = bar + 1;
+					}
+				}
+
+				t.Parts.push_back({ std::make_shared<const std::vector<std::string>>(
+					std::move(values)) });
+			}
+
+			pos = close + 1;
+		}
+
+		return t;
+	}
+}
+
+TEST_SUITE("Template")
+{
+	using namespace noire;
+	using namespace noire::collider;
+
+	using NameList = std::vector<std::string>;
+
+	// All the candidate names, in order
+	static NameList Names(const Template& t)
+	{
+		NameList names{ "" };
+		for (const TemplatePart& p : t.Parts)
+		{
+			NameList next{};
+			for (const std::string& prefix : names)
+			{
+				for (size c = 0; c < p.Count(); c++)
+				{
+					next.push_back(prefix + p[c]);
+				}
+			}
+			names = std::move(next);
+		}
+		return names;
+	}
+
+	static NameList Names(std::string_view str)
+	{
+		return Names(ParseTemplate(str, nullptr));
+	}
+
+	TEST_CASE("Literal text")
+	{
+		const Template t = ParseTemplate("out/a.dds", nullptr);
+		CHECK_EQ(t.Source, "out/a.dds");
+		CHECK_EQ(t.Parts.size(), 1);
+		CHECK_EQ(t.CandidateCount(), 1);
+		CHECK_EQ(Names(t), (NameList{ "out/a.dds" }));
+	}
+
+	TEST_CASE("Ranges")
+	{
+		CHECK_EQ(Names("{8-10}"), (NameList{ "8", "9", "10" }));
+		CHECK_EQ(Names("a{098-100}"), (NameList{ "a098", "a099", "a100" }));
+		CHECK_EQ(Names("{00-02}.b"), (NameList{ "00.b", "01.b", "02.b" }));
+		CHECK_EQ(Names("{5-5}"), (NameList{ "5" }));
+		CHECK_THROWS_AS(ParseTemplate("{3-1}", nullptr), std::invalid_argument);
+	}
+
+	TEST_CASE("Groups that are not numbers are alternatives")
+	{
+		CHECK_EQ(Names("{a-b}"), (NameList{ "a-b" }));
+		CHECK_EQ(Names("{-5}"), (NameList{ "-5" }));
+		CHECK_EQ(Names("{1-}"), (NameList{ "1-" }));
+		CHECK_EQ(Names("{1-2x}"), (NameList{ "1-2x" }));
+	}
+
+	TEST_CASE("Alternatives")
+	{
+		CHECK_EQ(Names("x{a|bb}"), (NameList{ "xa", "xbb" }));
+		CHECK_EQ(Names("{a|}"), (NameList{ "a", "" }));
+
+		// a single choice is like literal text
+		const Template t = ParseTemplate("{only}", nullptr);
+		REQUIRE_EQ(t.Parts.size(), 1);
+		CHECK_EQ(t.Parts[0].Count(), 1);
+		CHECK_EQ(Names(t), (NameList{ "only" }));
+	}
+
+	TEST_CASE("Words")
+	{
+		const Choices words = std::make_shared<const std::vector<std::string>>(
+			NameList{ "one", "two" });
+		const Template t = ParseTemplate("{}_{0-2}", words);
+		REQUIRE_EQ(t.Parts.size(), 3);
+		CHECK_EQ(t.Parts[0].Values, words);
+		CHECK_EQ(t.CandidateCount(), 6);
+		CHECK_EQ(Names(t),
+				 (NameList{ "one_0", "one_1", "one_2", "two_0", "two_1", "two_2" }));
+
+		CHECK_THROWS_AS(ParseTemplate("{}", nullptr), std::invalid_argument);
+		CHECK_THROWS_AS(ParseTemplate("{}", std::make_shared<const std::vector<std::string>>()),
+						std::invalid_argument);
+	}
+
+	TEST_CASE("Unbalanced braces")
+	{
+		CHECK_THROWS_AS(ParseTemplate("a{b", nullptr), std::invalid_argument);
+		CHECK_THROWS_AS(ParseTemplate("a}b", nullptr), std::invalid_argument);
+		CHECK_THROWS_AS(ParseTemplate("{a{b}}", nullptr), std::invalid_argument);
+		CHECK_THROWS_AS(ParseTemplate("{a}}", nullptr), std::invalid_argument);
+	}
+
+	TEST_CASE("CandidateCount saturates")
+	{
+		std::string str{};
+		for (size i = 0; i < 8; i++)
+		{
+			str += "{0-999999}";
+		}
+		CHECK_EQ(ParseTemplate(str, nullptr).CandidateCount(), std::numeric_limits<u64>::max());
+	}
+}
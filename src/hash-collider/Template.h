@@ -0,0 +1,38 @@
+#pragma once
+#include <core/Common.h>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace noire::collider
+{
+	using Choices = std::shared_ptr<const std::vector<std::string>>;
+
+	// Piece of a template, each candidate uses one of its choices. Literal text is a part with a
+	// single choice.
+	struct TemplatePart
+	{
+		Choices Values;
+
+		size Count() const { return Values->size(); }
+		const std::string& operator[](size index) const { return (*Values)[index]; }
+	};
+
+	// Candidate names are built by concatenating one choice of each part, in order.
+	struct Template
+	{
+		std::string Source;
+		std::vector<TemplatePart> Parts;
+
+		// Number of candidate names, saturates at the maximum u64
+		u64 CandidateCount() const;
+	};
+
+	// Parses a template such as 'out/textures/{}_{0-3}.dds', where:
+	//   {}        is each word of the wordlist
+	//   {a|b|c}   is each of the alternatives
+	//   {0-15}    is each number in the range, zero-padded to the width of the first number
+	// Throws std::invalid_argument if the template is not valid or uses '{}' without words.
+	Template ParseTemplate(std::string_view str, const Choices& words);
+}
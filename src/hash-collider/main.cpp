@@ -0,0 +1,359 @@
+#include "Collider.h"
+#include "Template.h"
+#include <charconv>
+#include <chrono>
+#include <core/Common.h>
+#include <core/Hash.h>
+#include <core/ThreadPool.h>
+#include <cstdlib>
+#include <exception>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <unordered_set>
+#include <vector>
+
+namespace noire::collider
+{
+	namespace fs = std::filesystem;
+
+	static constexpr std::string_view Usage{
+		"Usage: noire-hash-collider --hashes <file> [options] [template...]\n"
+		"\n"
+		"Finds the names of unknown hashes by hashing every candidate name of the templates.\n"
+		"Found names are appended to the hashes database.\n"
+		"\n"
+		"Options:\n"
+		"  --hashes <file>     Unknown hashes, one per line, as '?#XXXXXXXX#?' names (such as\n"
+		"                      the ones shown for unknown entries) or hexadecimal values.\n"
+		"  --words <file>      Wordlist used by '{}' in the templates, one word per line.\n"
+		"  --templates <file>  Reads more templates from the file, one per line.\n"
+		"  --db <file>         Hashes database to append the found names to (default:\n"
+		"                      'hashes.db'). Hashes already in it are not searched.\n"
+		"  --threads <count>   Number of threads (default: all hardware threads).\n"
+		"  --lowercase         Hashes the candidates as if they were lowercase.\n"
+		"  --mode <mode>       How the candidates are hashed (default: auto):\n"
+		"                        prefix  hashes each candidate from the CRC of its prefix\n"
+		"                        mitm    looks up the last variable part in a table of its\n"
+		"                                CRCs, faster when it has many choices\n"
+		"                        auto    uses mitm when it needs fewer operations\n"
+		"\n"
+		"Templates:\n"
+		"  {}        each word of the wordlist\n"
+		"  {a|b|c}   each of the alternatives\n"
+		"  {0-15}    each number in the range, zero-padded to the width of the first number\n"
+		"  e.g. 'out/textures/{}_{0-3}.dds'\n"
+	};
+
+	// Error reported to the user, the message is printed and the tool exits with a failure code
+	class Error : public std::exception
+	{
+	public:
+		Error(std::string message) : mMessage{ std::move(message) } {}
+
+		const char* what() const noexcept override { return mMessage.c_str(); }
+
+	private:
+		std::string mMessage;
+	};
+
+	struct Options
+	{
+		fs::path HashesPath;
+		fs::path WordsPath;
+		fs::path DatabasePath{ "hashes.db" };
+		size ThreadCount{ 0 };
+		bool Lowercase{ false };
+		CollideMode Mode{ CollideMode::Auto };
+		std::vector<std::string> Templates;
+	};
+
+	static std::vector<std::string> ReadLines(const fs::path& path)
+	{
+		std::ifstream f{ path, std::ios::in };
+		if (!f)
+		{
+			throw Error{ "cannot open '" + path.string() + "'" };
+		}
+
+		std::vector<std::string> lines{};
+		for (std::string line; std::getline(f, line);)
+		{
+			if (!line.empty() && line.back() == '\r')
+			{
+				line.pop_back();
+			}
+
+			if (!line.empty())
+			{
+				lines.emplace_back(std::move(line));
+			}
+		}
+		return lines;
+	}
+
+	// Gets the hashes of a line, either the '?#XXXXXXXX#?' names in it or the whole line as a
+	// hexadecimal value
+	static void
+	ParseHashes(std::string_view line, const HashLookup& lookup, std::vector<u32>& hashes)
+	{
+		constexpr size NameLength{ HashLookup::HashPrefix.size() + 8 +
+								   HashLookup::HashSuffix.size() };
+
+		bool found = false;
+		for (size pos = line.find(HashLookup::HashPrefix); pos != std::string_view::npos;
+			 pos = line.find(HashLookup::HashPrefix, pos + 1))
+		{
+			const std::string_view name = line.substr(pos, NameLength);
+			if (name.size() == NameLength &&
+				name.substr(NameLength - HashLookup::HashSuffix.size()) == HashLookup::HashSuffix)
+			{
+				hashes.push_back(lookup.GetHash(name));
+				found = true;
+			}
+		}
+
+		if (!found)
+		{
+			std::string_view hex = line;
+			if (hex.substr(0, 2) == "0x" || hex.substr(0, 2) == "0X")
+			{
+				hex.remove_prefix(2);
+			}
+
+			u32 value;
+			const auto [p, ec] = std::from_chars(hex.data(), hex.data() + hex.size(), value, 16);
+			if (hex.empty() || ec != std::errc{} || p != hex.data() + hex.size())
+			{
+				throw Error{ "'" + std::string{ line } + "' is not a hash" };
+			}
+			hashes.push_back(value);
+		}
+	}
+
+	static Options ParseOptions(const std::vector<std::string_view>& args)
+	{
+		Options o{};
+		for (size i = 0; i < args.size(); i++)
+		{
+			const std::string_view arg = args[i];
+			const auto value = [&]() {
+				if (++i == args.size())
+				{
+					throw Error{ "expected a value after '" + std::string{ arg } + "'" };
+				}
+				return args[i];
+			};
+
+			if (arg == "--hashes")
+			{
+				o.HashesPath = value();
+			}
+			else if (arg == "--words")
+			{
+				o.WordsPath = value();
+			}
+			else if (arg == "--templates")
+			{
+				for (std::string& t : ReadLines(value()))
+				{
+					o.Templates.emplace_back(std::move(t));
+				}
+			}
+			else if (arg == "--db")
+			{
+				o.DatabasePath = value();
+			}
+			else if (arg == "--threads")
+			{
+				o.ThreadCount = std::stoul(std::string{ value() });
+			}
+			else if (arg == "--lowercase")
+			{
+				o.Lowercase = true;
+			}
+			else if (arg == "--mode")
+			{
+				const std::string_view mode = value();
+				if (mode == "auto")
+				{
+					o.Mode = CollideMode::Auto;
+				}
+				else if (mode == "prefix")
+				{
+					o.Mode = CollideMode::Prefix;
+				}
+				else if (mode == "mitm")
+				{
+					o.Mode = CollideMode::MeetInTheMiddle;
+				}
+				else
+				{
+					throw Error{ "unknown mode '" + std::string{ mode } + "'" };
+				}
+			}
+			else if (arg.substr(0, 2) == "--")
+			{
+				throw Error{ "unknown option '" + std::string{ arg } + "'" };
+			}
+			else
+			{
+				o.Templates.emplace_back(arg);
+			}
+		}
+
+		if (o.HashesPath.empty())
+		{
+			throw Error{ "expected the unknown hashes, use '--hashes <file>'" };
+		}
+
+		if (o.Templates.empty())
+		{
+			throw Error{ "expected at least one template" };
+		}
+
+		return o;
+	}
+
+	static int Run(const std::vector<std::string_view>& args)
+	{
+		const Options options = ParseOptions(args);
+
+		Choices words{};
+		if (!options.WordsPath.empty())
+		{
+			words = std::make_shared<const std::vector<std::string>>(ReadLines(options.WordsPath));
+		}
+
+		std::vector<Template> templates{};
+		for (const std::string& t : options.Templates)
+		{
+			try
+			{
+				templates.emplace_back(ParseTemplate(t, words));
+			}
+			catch (const std::invalid_argument& e)
+			{
+				throw Error{ e.what() };
+			}
+		}
+
+		ThreadPool pool{ options.ThreadCount };
+		Collider collider{ options.Lowercase, options.Mode };
+		{
+			const HashLookup known{ options.DatabasePath, true, pool };
+			std::vector<u32> hashes{};
+			for (const std::string& line : ReadLines(options.HashesPath))
+			{
+				ParseHashes(line, known, hashes);
+			}
+
+			size knownCount = 0;
+			for (u32 h : hashes)
+			{
+				if (known.GetString(h))
+				{
+					knownCount++;
+				}
+				else
+				{
+					collider.AddTarget(h);
+				}
+			}
+
+			std::cout << collider.TargetCount() << " unknown hashes";
+			if (knownCount != 0)
+			{
+				std::cout << " (" << knownCount << " already in '"
+						  << options.DatabasePath.string() << "')";
+			}
+			std::cout << '\n';
+		}
+
+		if (collider.TargetCount() == 0)
+		{
+			return EXIT_SUCCESS;
+		}
+
+		std::unordered_set<std::string> found{};
+		std::ofstream db{};
+
+		const auto start = std::chrono::steady_clock::now();
+		for (const Template& t : templates)
+		{
+			std::cout << "'" << t.Source << "': " << t.CandidateCount() << " candidates\n";
+
+			std::vector<Match> matches = collider.Run(t, pool);
+			if (collider.UsedMeetInTheMiddle())
+			{
+				std::cout << "  (meet-in-the-middle)\n";
+			}
+
+			for (Match& m : matches)
+			{
+				if (!found.insert(m.Name).second)
+				{
+					continue;
+				}
+
+				std::cout << "  " << HashLookup::HashPrefix << std::hex << std::uppercase
+						  << std::setw(8) << std::setfill('0') << m.Hash << std::dec
+						  << HashLookup::HashSuffix << " = " << m.Name << '\n';
+
+				if (!db.is_open())
+				{
+					db.open(options.DatabasePath, std::ios::out | std::ios::app);
+					if (!db)
+					{
+						throw Error{ "cannot open '" + options.DatabasePath.string() + "'" };
+					}
+				}
+				db << m.Name << '\n';
+			}
+		}
+
+		const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+		std::cout << "Tested " << collider.TestedCount() << " candidates in " << elapsed.count()
+				  << " s (" << static_cast<u64>(collider.TestedCount() / elapsed.count())
+				  << " per second), found " << found.size() << " names\n";
+
+		return EXIT_SUCCESS;
+	}
+}
+
+int main(int argc, char* argv[])
+{
+	using namespace noire::collider;
+
+	if (argc < 2)
+	{
+		std::cerr << Usage;
+		return EXIT_FAILURE;
+	}
+
+	const std::vector<std::string_view> args(argv + 1, argv + argc);
+	if (args[0] == "help" || args[0] == "--help" || args[0] == "-h")
+	{
+		std::cout << Usage;
+		return EXIT_SUCCESS;
+	}
+
+	try
+	{
+		return Run(args);
+	}
+	catch (const Error& e)
+	{
+		std::cerr << "Error: " << e.what() << '\n' << "Run 'noire-hash-collider help' for usage.\n";
+	}
+	catch (const std::exception& e)
+	{
+		std::cerr << "Error: " << e.what() << '\n';
+	}
+
+	return EXIT_FAILURE;
+}